@@ -0,0 +1,203 @@
+"""
+Delta OTA patches: only the changes between the running firmware and the new
+one are sent, and Utils.applyOTAPatch() rebuilds the new image on the SD card
+
+The patch copies ranges of the running image, which the node reads from its
+Flash, and adds the bytes that are new. Its header carries the CRC-32 of the
+running image, so a node running anything else refuses it, and the CRC-32 of
+the new image, checked before Utils.loadOTA()
+
+python DeltaOTA.py --diff old.hex new.hex PATCH01 --name NEWPROG
+python DeltaOTA.py --apply old.hex PATCH01 rebuilt.bin
+
+The patch name (7 characters) goes in the FILE field of UPGRADE.TXT, together
+with the SIZE and CRC printed here. The node writes the image as NEWPROG, its
+new PID, which must differ from the patch name, in the OTA file format: a
+first sector with the start string and the PID, then the binary. --apply
+writes the same file
+"""
+
+import sys, struct, argparse, zlib
+
+MAGIC = b'WDLT'
+VERSION = 1
+HEADER = struct.Struct('<4sB3x8sIIII')
+
+PATCH_END = 0x00
+PATCH_COPY = 0x01
+PATCH_DATA = 0x02
+
+# shortest match copied: a COPY costs 7 bytes and breaks a DATA (3 bytes)
+# first sector of an OTA file: start string, PID padded with '*' to 32 bytes
+# and '*' up to 512 bytes
+OTA_START = b'FIRMWARE_FILE_FOR_WASPMOTE######'
+OTA_SECTOR = 512
+
+MIN_COPY = 12
+KEY_SIZE = 8
+MAX_CANDIDATES = 32
+MAX_LENGTH = 0xFFFF
+
+
+def read_image(path):
+    """ raw binary or OTA file (its first sector is skipped), or Intel HEX
+    padded with 0xFF as the erased Flash """
+    if not path.lower().endswith('.hex'):
+        with open(path, 'rb') as f:
+            data = f.read()
+        if data.startswith(OTA_START):
+            data = data[OTA_SECTOR:]
+        return data
+    image = bytearray()
+    base = 0
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith(':'):
+                continue
+            record = bytes.fromhex(line[1:])
+            if sum(record) & 0xFF:
+                sys.exit('%s: bad checksum in %s' % (path, line))
+            count, address, kind = record[0], (record[1] << 8) | record[2], record[3]
+            data = record[4:4 + count]
+            if kind == 0x00:
+                start = base + address
+                if len(image) < start + count:
+                    image.extend(b'\xff' * (start + count - len(image)))
+                image[start:start + count] = data
+            elif kind == 0x02:
+                base = ((data[0] << 8) | data[1]) << 4
+            elif kind == 0x04:
+                base = ((data[0] << 8) | data[1]) << 16
+            elif kind == 0x01:
+                break
+    return bytes(image)
+
+
+def crc32(data):
+    return zlib.crc32(data) & 0xFFFFFFFF
+
+
+def ota_file(name, image):
+    """ mirror of the file written by Utils.applyOTAPatch() """
+    sector = OTA_START + name.encode('ascii')
+    return sector + b'*' * (OTA_SECTOR - len(sector)) + image
+
+
+def diff(old, new):
+    """ list of ('copy', offset, length) and ('data', bytes) """
+    index = {}
+    for i in range(len(old) - KEY_SIZE + 1):
+        candidates = index.setdefault(old[i:i + KEY_SIZE], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(i)
+
+    commands = []
+    literal = bytearray()
+    i = 0
+    while i < len(new):
+        best_offset, best_length = 0, 0
+        for offset in index.get(new[i:i + KEY_SIZE], ()):
+            length = 0
+            limit = min(len(old) - offset, len(new) - i, MAX_LENGTH)
+            while length < limit and old[offset + length] == new[i + length]:
+                length += 1
+            if length > best_length:
+                best_offset, best_length = offset, length
+        if best_length >= MIN_COPY:
+            if literal:
+                commands.append(('data', bytes(literal)))
+                literal = bytearray()
+            commands.append(('copy', best_offset, best_length))
+            i += best_length
+        else:
+            literal.append(new[i])
+            if len(literal) == MAX_LENGTH:
+                commands.append(('data', bytes(literal)))
+                literal = bytearray()
+            i += 1
+    if literal:
+        commands.append(('data', bytes(literal)))
+    return commands
+
+
+def encode(name, old, new, commands):
+    patch = bytearray(HEADER.pack(MAGIC, VERSION, name.encode('ascii'),
+                                  len(old), crc32(old), len(new), crc32(new)))
+    for command in commands:
+        if command[0] == 'copy':
+            patch += struct.pack('<BIH', PATCH_COPY, command[1], command[2])
+        else:
+            patch += struct.pack('<BH', PATCH_DATA, len(command[1])) + command[1]
+    patch.append(PATCH_END)
+    return bytes(patch)
+
+
+def apply(old, patch):
+    """ mirror of Utils.applyOTAPatch() """
+    magic, version, name, base_size, base_crc, new_size, new_crc = HEADER.unpack_from(patch)
+    if magic != MAGIC or version != VERSION:
+        sys.exit('not a patch')
+    if crc32(old[:base_size]) != base_crc:
+        sys.exit('the image is not the base of the patch')
+    new = bytearray()
+    position = HEADER.size
+    while True:
+        command = patch[position]
+        position += 1
+        if command == PATCH_END:
+            break
+        elif command == PATCH_COPY:
+            offset, length = struct.unpack_from('<IH', patch, position)
+            position += 6
+            new += old[offset:offset + length]
+        elif command == PATCH_DATA:
+            length, = struct.unpack_from('<H', patch, position)
+            position += 2
+            new += patch[position:position + length]
+            position += length
+        else:
+            sys.exit('bad command %d' % command)
+    if len(new) != new_size or crc32(bytes(new)) != new_crc:
+        sys.exit('CRC mismatch')
+    return name.rstrip(b'\0').decode('ascii'), bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Delta OTA patches")
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument('--diff', nargs=3, metavar=('OLD', 'NEW', 'PATCH'),
+                       help='make PATCH to go from the OLD image to the NEW one')
+    group.add_argument('--apply', nargs=3, metavar=('OLD', 'PATCH', 'OUTPUT'),
+                       help='rebuild the new OTA file, as the node does')
+    parser.add_argument('--name', dest='name', help='PID of the new image (7 characters)')
+    args = parser.parse_args()
+
+    if args.diff:
+        old_path, new_path, patch_path = args.diff
+        patch_name = patch_path.replace('\\', '/').split('/')[-1]
+        if not args.name or len(args.name) != 7 or len(patch_name) != 7:
+            sys.exit('the PID (--name) and the patch name must have 7 characters')
+        if args.name == patch_name:
+            sys.exit('the patch name must differ from the PID')
+        old = read_image(old_path)
+        new = read_image(new_path)
+        patch = encode(args.name, old, new, diff(old, new))
+        with open(patch_path, 'wb') as f:
+            f.write(patch)
+        print('new image: %d bytes, patch: %d bytes (%.1f%%)' % (len(new), len(patch), 100.0 * len(patch) / len(new)))
+        print('')
+        print('FILE:%s' % patch_name)
+        print('SIZE:%d' % len(patch))
+        print('CRC:%08X' % crc32(patch))
+    else:
+        old_path, patch_path, output_path = args.apply
+        with open(patch_path, 'rb') as f:
+            name, new = apply(read_image(old_path), f.read())
+        with open(output_path, 'wb') as f:
+            f.write(ota_file(name, new))
+        print('%s: %d bytes, CRC %08X' % (name, len(new), crc32(new)))
+
+
+if __name__ == '__main__':
+    main()
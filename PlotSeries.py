@@ -5,9 +5,17 @@ pip install pySerial
 pip install numpy
 pip install matplotlib
 pip install argparse
+
+The Waspmote can send the samples as text lines ("time v1 v2 v3") or, with
+--binary, as the frames written by lib/UsbLog:
+
+    0xA5 0x5A | type | count | millis (uint32) | count x float | CRC-8
+
+little endian, CRC-8 with polynomial 0x07 over type..last value. Log lines
+mixed with the frames are printed and skipped.
 """
 
-import sys, serial, argparse
+import sys, serial, argparse, struct
 import numpy as np
 from time import sleep
 from collections import deque
@@ -18,12 +26,62 @@ import csv
 BAUDRATE = 115200
 LENGHT_DATA = 3
 
+FRAME_SYNC = b'\xa5\x5a'
+FRAME_IONS = 1
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+# binary frames reader, it resynchronizes on the sync bytes
+class FrameReader:
+    def __init__(self, ser):
+        self.ser = ser
+        self.text = bytearray()
+
+    def read_byte(self):
+        return self.ser.read(1)[0]
+
+    # returns (type, millis, values)
+    def read(self):
+        while True:
+            byte = self.read_byte()
+            if byte != FRAME_SYNC[0]:
+                self.log_text(byte)
+                continue
+            if self.read_byte() != FRAME_SYNC[1]:
+                continue
+            header = self.ser.read(6)
+            frame_type, count = header[0], header[1]
+            payload = self.ser.read(4 * count)
+            crc = self.read_byte()
+            if crc8(header + payload) != crc:
+                continue
+            millis = struct.unpack('<I', header[2:6])[0]
+            values = list(struct.unpack('<%df' % count, payload))
+            return frame_type, millis, values
+
+    # log lines sent between frames
+    def log_text(self, byte):
+        if byte == ord('\n'):
+            print(self.text.decode('utf-8', 'replace').rstrip())
+            self.text = bytearray()
+        else:
+            self.text.append(byte)
+
 # plot class
 class AnalogPlot:
     # constr
-    def __init__(self, strPort, maxLen):
+    def __init__(self, strPort, maxLen, binary=False):
         # open serial port
         self.ser = serial.Serial(strPort, BAUDRATE)
+        self.frames = FrameReader(self.ser) if binary else None
 
         self.measure_file = open('measures.csv', mode='w')
         header = ' '.join(map(str, ['Hora', 'Calcio', 'Nitratos', 'Potasio'])).replace(' ', ', ')
@@ -51,13 +109,22 @@ class AnalogPlot:
         self.addToBuf(self.ay, data[1])
         self.addToBuf(self.az, data[2])
 
-    # update plot
-    def update(self, frameNum, a0, a1, a2, a3):
-        try:
+    # next sample: time and data
+    def readSample(self):
+        if self.frames is None:
             line = self.ser.readline()
             vals = line.split()
             time = vals.pop(0).decode('utf-8') if vals.__len__() > 0 else ''
-            data = [float(val) for val in vals]
+            return time, [float(val) for val in vals]
+        while True:
+            frame_type, millis, values = self.frames.read()
+            if frame_type == FRAME_IONS and len(values) > 0:
+                return '%d' % values[0], values[1:]
+
+    # update plot
+    def update(self, frameNum, a0, a1, a2, a3):
+        try:
+            time, data = self.readSample()
             data_csv_row = time + ', ' + data.__str__().replace('[', '').replace(']', '')
             print(data_csv_row)
             # print data
@@ -92,6 +159,8 @@ def main():
     parser = argparse.ArgumentParser(description="LDR serial")
     # add expected arguments
     parser.add_argument('--port', dest='port', required=True)
+    parser.add_argument('--binary', dest='binary', action='store_true',
+                        help='decode the binary frames of lib/UsbLog')
 
     # parse args
     args = parser.parse_args()
@@ -102,7 +171,7 @@ def main():
     print('reading from serial port %s...' % strPort)
 
     # plot parameters
-    analogPlot = AnalogPlot(strPort, 100)
+    analogPlot = AnalogPlot(strPort, 100, args.binary)
 
     print('plotting data...')
 
@@ -0,0 +1,239 @@
+"""
+Decoder for the compact time-series format produced by lib/SeriesEncoder
+
+It also contains an encoder mirroring the C++ one, used by the benchmark to
+measure the compression ratio over a measures.csv recorded with PlotSeries.py
+
+python SeriesDecoder.py --decode batch.bin
+python SeriesDecoder.py --bench measures.csv
+"""
+
+import sys, struct, argparse, csv
+
+FORMAT_VERSION = 1
+HEADER_SIZE = 4
+SERIES_FLOAT = 0
+SERIES_SCALED = 1
+
+
+def float_to_bits(value):
+    return struct.unpack('>I', struct.pack('>f', value))[0]
+
+
+def bits_to_float(bits):
+    return struct.unpack('>f', struct.pack('>I', bits))[0]
+
+
+def to_int32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+# bit stream helpers
+class BitReader:
+    def __init__(self, data, bit):
+        self.data = data
+        self.bit = bit
+
+    def read(self, bits):
+        value = 0
+        for _ in range(bits):
+            byte = self.data[self.bit >> 3]
+            value = (value << 1) | ((byte >> (7 - (self.bit & 0x07))) & 0x01)
+            self.bit += 1
+        return value
+
+    def read_varint(self):
+        zigzag = 0
+        shift = 0
+        while True:
+            group = self.read(8)
+            zigzag |= (group & 0x7F) << shift
+            shift += 7
+            if not group & 0x80:
+                break
+        return to_int32((zigzag >> 1) ^ -(zigzag & 0x01))
+
+
+class BitWriter:
+    def __init__(self):
+        self.bits = []
+
+    def write(self, value, bits):
+        for i in range(bits - 1, -1, -1):
+            self.bits.append((value >> i) & 0x01)
+
+    def write_varint(self, value):
+        zigzag = ((value << 1) ^ (value >> 31)) & 0xFFFFFFFF
+        while True:
+            group = zigzag & 0x7F
+            zigzag >>= 7
+            if zigzag:
+                group |= 0x80
+            self.write(group, 8)
+            if not zigzag:
+                break
+
+    def to_bytes(self):
+        padded = self.bits + [0] * (-len(self.bits) % 8)
+        return bytes(int(''.join(map(str, padded[i:i + 8])), 2) for i in range(0, len(padded), 8))
+
+
+def leading_zeros(value):
+    return 32 - value.bit_length()
+
+
+def trailing_zeros(value):
+    return (value & -value).bit_length() - 1
+
+
+# decoder
+def decode(data):
+    if data[0] != FORMAT_VERSION:
+        raise ValueError('Unknown format version %d' % data[0])
+    channels = data[1]
+    samples = data[2] | (data[3] << 8)
+    types = [(d >> 4, d & 0x0F) for d in data[HEADER_SIZE:HEADER_SIZE + channels]]
+
+    reader = BitReader(data, (HEADER_SIZE + channels) * 8)
+    state = [{'previous': 0, 'leading': None, 'trailing': 0} for _ in types]
+    timestamp = 0
+    delta = 0
+    result = []
+
+    for n in range(samples):
+        if n == 0:
+            timestamp = reader.read(32)
+        else:
+            delta += reader.read_varint()
+            timestamp = (timestamp + delta) & 0xFFFFFFFF
+
+        values = []
+        for (kind, decimals), st in zip(types, state):
+            if kind == SERIES_SCALED:
+                st['previous'] += reader.read_varint()
+                values.append(st['previous'] / (10.0 ** decimals))
+                continue
+
+            if n == 0:
+                st['previous'] = reader.read(32)
+            elif reader.read(1):
+                if reader.read(1):
+                    st['leading'] = reader.read(5)
+                    meaningful = reader.read(5) + 1
+                    st['trailing'] = 32 - st['leading'] - meaningful
+                else:
+                    meaningful = 32 - st['leading'] - st['trailing']
+                st['previous'] ^= reader.read(meaningful) << st['trailing']
+            values.append(bits_to_float(st['previous']))
+
+        result.append((timestamp, values))
+    return result
+
+
+# encoder, same output as SeriesEncoder::add()
+def encode(samples, types):
+    writer = BitWriter()
+    state = [{'previous': 0, 'leading': None, 'trailing': 0} for _ in types]
+    prev_timestamp = 0
+    delta = 0
+
+    for n, (timestamp, values) in enumerate(samples):
+        if n == 0:
+            writer.write(timestamp & 0xFFFFFFFF, 32)
+        else:
+            current = to_int32(timestamp - prev_timestamp)
+            writer.write_varint(to_int32(current - delta))
+            delta = current
+        prev_timestamp = timestamp
+
+        for (kind, decimals), st, value in zip(types, state, values):
+            if kind == SERIES_SCALED:
+                scaled = int(round(value * 10 ** decimals))
+                writer.write_varint(to_int32(scaled - st['previous']))
+                st['previous'] = scaled
+                continue
+
+            bits = float_to_bits(value)
+            if n == 0:
+                writer.write(bits, 32)
+                st['previous'] = bits
+                continue
+            xored = bits ^ st['previous']
+            st['previous'] = bits
+            if xored == 0:
+                writer.write(0, 1)
+                continue
+            leading = leading_zeros(xored)
+            trailing = trailing_zeros(xored)
+            if st['leading'] is not None and leading >= st['leading'] and trailing >= st['trailing']:
+                meaningful = 32 - st['leading'] - st['trailing']
+                writer.write(0x02, 2)
+                writer.write(xored >> st['trailing'], meaningful)
+            else:
+                meaningful = 32 - leading - trailing
+                writer.write(0x03, 2)
+                writer.write(leading, 5)
+                writer.write(meaningful - 1, 5)
+                writer.write(xored >> trailing, meaningful)
+                st['leading'] = leading
+                st['trailing'] = trailing
+
+    header = bytes([FORMAT_VERSION, len(types), len(samples) & 0xFF, len(samples) >> 8])
+    header += bytes((kind << 4) | decimals for kind, decimals in types)
+    return header + writer.to_bytes()
+
+
+# benchmark over a measures.csv recorded by PlotSeries.py
+def read_measures(path):
+    samples = []
+    text_size = 0
+    with open(path) as measure_file:
+        rows = csv.reader(measure_file, skipinitialspace=True)
+        next(rows)
+        for row in rows:
+            if len(row) < 2:
+                continue
+            text_size += len(', '.join(row)) + 1
+            samples.append((int(float(row[0])), [float(v) for v in row[1:]]))
+    return samples, text_size
+
+
+def bench(path, decimals):
+    samples, text_size = read_measures(path)
+    if not samples:
+        print('No samples in %s' % path)
+        return
+    channels = len(samples[0][1])
+
+    print('Samples: %d, channels: %d' % (len(samples), channels))
+    print('%-24s %10s %8s' % ('Format', 'Bytes', 'Ratio'))
+    print('%-24s %10d %8.2f' % ('Decimal text (csv)', text_size, 1.0))
+    for name, kind, dec in (('Gorilla XOR floats', SERIES_FLOAT, 0),
+                            ('Scaled ints (%d dec)' % decimals, SERIES_SCALED, decimals)):
+        data = encode(samples, [(kind, dec)] * channels)
+        decoded = decode(data)
+        error = max(abs(a - b) for (_, va), (_, vb) in zip(samples, decoded) for a, b in zip(va, vb))
+        assert [t for t, _ in decoded] == [t & 0xFFFFFFFF for t, _ in samples]
+        print('%-24s %10d %8.2f   max error %g' % (name, len(data), text_size / float(len(data)), error))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="SeriesEncoder decoder")
+    parser.add_argument('--decode', dest='decode', help='binary batch to decode')
+    parser.add_argument('--bench', dest='bench', help='measures.csv recorded with PlotSeries.py')
+    parser.add_argument('--decimals', dest='decimals', type=int, default=3)
+    args = parser.parse_args()
+
+    if args.decode:
+        with open(args.decode, 'rb') as batch:
+            for timestamp, values in decode(batch.read()):
+                print(' '.join([str(timestamp)] + ['%g' % v for v in values]))
+    elif args.bench:
+        bench(args.bench, args.decimals)
+    else:
+        parser.print_help()
+
+
+if __name__ == '__main__':
+    main()
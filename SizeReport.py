@@ -0,0 +1,93 @@
+"""
+Flash and RAM report of the firmware per symbol, checked against budgets
+
+It reads the section sizes with avr-size and the symbols with avr-nm, and
+exits with an error when the flash or the RAM used exceed their budget, so
+`make build` stops there
+
+python SizeReport.py --flash-budget 122880 --ram-budget 6144 bin/firmware.elf
+python SizeReport.py --top 40 bin/firmware.elf
+"""
+
+import sys, argparse, subprocess
+
+# AVR ELF address spaces: flash from 0, RAM from 0x800000, EEPROM from 0x810000
+RAM_OFFSET = 0x800000
+EEPROM_OFFSET = 0x810000
+
+FLASH_SECTIONS = ('.text', '.data')
+RAM_SECTIONS = ('.data', '.bss', '.noinit')
+
+
+def read_sections(size_tool, elf):
+    output = subprocess.check_output([size_tool, '-A', '-d', elf]).decode()
+    sections = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[0].startswith('.') and fields[1].isdigit():
+            sections[fields[0]] = int(fields[1])
+    return sections
+
+
+def read_symbols(nm_tool, elf):
+    """ (flash, ram) lists of (size, type, name). Initialized variables take
+    flash for their initial value as well """
+    output = subprocess.check_output([nm_tool, '--size-sort', '-S', '-C', '--radix=d', elf]).decode()
+    flash = []
+    ram = []
+    for line in output.splitlines():
+        fields = line.split(None, 3)
+        if len(fields) < 4:
+            continue
+        address, size, kind, name = int(fields[0]), int(fields[1]), fields[2], fields[3]
+        if address >= EEPROM_OFFSET:
+            continue
+        if address >= RAM_OFFSET:
+            ram.append((size, kind, name))
+            if kind in 'Dd':
+                flash.append((size, kind, name))
+        else:
+            flash.append((size, kind, name))
+    return flash, ram
+
+
+def print_top(title, symbols, total, top):
+    print('%s (top %d of %d symbols)' % (title, min(top, len(symbols)), len(symbols)))
+    for size, kind, name in sorted(symbols, reverse=True)[:top]:
+        print('  %7d %5.1f%%  %s  %s' % (size, 100.0 * size / total if total else 0, kind, name))
+    print('')
+
+
+def check_budget(name, used, budget):
+    state = 'OK' if used <= budget else 'OVER BUDGET'
+    print('%-6s %7d of %7d bytes (%5.1f%%)  %s' % (name, used, budget, 100.0 * used / budget, state))
+    return used <= budget
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Firmware size report")
+    parser.add_argument('elf', help='firmware ELF file')
+    parser.add_argument('--nm', dest='nm', default='avr-nm')
+    parser.add_argument('--size', dest='size', default='avr-size')
+    parser.add_argument('--flash-budget', dest='flash_budget', type=int, default=122880)
+    parser.add_argument('--ram-budget', dest='ram_budget', type=int, default=6144)
+    parser.add_argument('--top', dest='top', type=int, default=20, help='symbols listed per memory')
+    args = parser.parse_args()
+
+    sections = read_sections(args.size, args.elf)
+    flash_used = sum(sections.get(name, 0) for name in FLASH_SECTIONS)
+    ram_used = sum(sections.get(name, 0) for name in RAM_SECTIONS)
+    flash, ram = read_symbols(args.nm, args.elf)
+
+    print('')
+    print_top('Flash', flash, flash_used, args.top)
+    print_top('RAM', ram, ram_used, args.top)
+
+    flash_ok = check_budget('Flash', flash_used, args.flash_budget)
+    ram_ok = check_budget('RAM', ram_used, args.ram_budget)
+    if not (flash_ok and ram_ok):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
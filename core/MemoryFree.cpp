@@ -1,15 +1,64 @@
-
 /*
   * MemoryFree.cpp
-  * returns the number of free RAM bytes
+  * returns the number of free RAM bytes, and the lowest number reached
   */
 #include "MemoryFree.h"
+#include <stddef.h>
+#include <avr/io.h>
 extern  unsigned int __data_start;
 extern  unsigned int __data_end;
 extern  unsigned int __bss_start;
 extern  unsigned int __bss_end;
 extern  unsigned int __heap_start;
 extern  void *__brkval;
+
+// free list of the avr-libc malloc(). 'sz' does not include the size field
+struct __freelist
+{
+	size_t sz;
+	struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+
+// lowest gap found before the last repaint
+static int memory_min_free = 0x7FFF;
+
+// phase being measured and lowest gap of every phase
+static uint8_t memory_phase = MEMORY_PHASE_NONE;
+static uint8_t memory_phase_seen = 0;
+static int memory_phase_min[MEMORY_PHASES];
+
+extern "C" void memoryPaint(void) __attribute__((naked, used, section(".init1")));
+
+/*
+ * memoryPaint: it paints all the RAM above the variables before anything
+ * runs, so the stack is still unused. Assembler only: r1 is not cleared yet
+ */
+void memoryPaint(void)
+{
+	__asm__ __volatile__ (
+		"	ldi r30, lo8(__heap_start)	\n"
+		"	ldi r31, hi8(__heap_start)	\n"
+		"	ldi r24, %[canary]			\n"
+		"	ldi r25, hi8(%[end])		\n"
+		"1:	st Z+, r24					\n"
+		"	cpi r30, lo8(%[end])		\n"
+		"	cpc r31, r25				\n"
+		"	brlo 1b						\n"
+		:: [canary] "M" (MEMORY_CANARY), [end] "i" (RAMEND + 1)
+	);
+}
+
+/*
+ * heapTop: first byte above the heap
+ */
+static uint8_t* heapTop()
+{
+	if (__brkval == 0)
+		return (uint8_t*)&__heap_start;
+	return (uint8_t*)__brkval;
+}
+
 int freeMemory()
 {
    int free_memory;
@@ -20,3 +69,99 @@ int freeMemory()
    return free_memory;
 }
 
+/*
+ * memoryMinFree: lowest gap between heap and stack since the last repaint,
+ * counting the bytes still painted above the heap. The heap does not give
+ * back memory painted, so the figure is conservative if it shrinks
+ */
+int memoryMinFree()
+{
+	uint8_t *p = heapTop();
+	uint8_t *sp = (uint8_t*)SP;
+	int count = 0;
+
+	while ((p <= sp) && (*p == MEMORY_CANARY))
+	{
+		p++;
+		count++;
+	}
+	return count;
+}
+
+/*
+ * memoryRepaint: it paints the current gap again, so the next
+ * memoryMinFree() only covers what runs from now on
+ */
+void memoryRepaint()
+{
+	int current = memoryMinFree();
+	uint8_t *p = heapTop();
+
+	if (current < memory_min_free)
+		memory_min_free = current;
+
+	// below the stack pointer nothing is in use; an interrupt using it
+	// meanwhile has finished before the loop goes on
+	while (p < (uint8_t*)SP)
+		*p++ = MEMORY_CANARY;
+}
+
+void memoryStats(memory_stats_t* stats)
+{
+	struct __freelist *block;
+	int current = memoryMinFree();
+
+	stats->freeGap = freeMemory();
+	stats->minFreeGap = (current < memory_min_free) ? current : memory_min_free;
+	stats->heapSize = heapTop() - (uint8_t*)&__heap_start;
+	stats->heapFree = 0;
+	stats->largestFree = 0;
+	stats->freeBlocks = 0;
+	stats->fragmentation = 0;
+
+	for (block = __flp; block != NULL; block = block->nx)
+	{
+		stats->heapFree += block->sz;
+		if ((int)block->sz > stats->largestFree)
+			stats->largestFree = block->sz;
+		stats->freeBlocks++;
+	}
+
+	if (stats->heapFree > 0)
+	{
+		stats->fragmentation = 100 - (uint8_t)(((long)stats->largestFree * 100) / stats->heapFree);
+	}
+}
+
+/*
+ * memoryPhase: it keeps the lowest gap of the phase being measured and
+ * starts measuring 'phase' (MEMORY_PHASE_NONE to stop). Every phase keeps its
+ * lowest gap over all the times it is measured
+ */
+void memoryPhase(uint8_t phase)
+{
+	if (memory_phase < MEMORY_PHASES)
+	{
+		int current = memoryMinFree();
+		uint8_t mask = 1 << memory_phase;
+
+		if (!(memory_phase_seen & mask) || (current < memory_phase_min[memory_phase]))
+		{
+			memory_phase_min[memory_phase] = current;
+		}
+		memory_phase_seen |= mask;
+	}
+
+	memoryRepaint();
+	memory_phase = phase;
+}
+
+/*
+ * memoryPhaseMinFree: lowest gap reached in 'phase'; -1 if never measured
+ */
+int memoryPhaseMinFree(uint8_t phase)
+{
+	if ((phase >= MEMORY_PHASES) || !(memory_phase_seen & (1 << phase)))
+		return -1;
+	return memory_phase_min[phase];
+}
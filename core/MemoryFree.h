@@ -1,14 +1,46 @@
 /*
   * MemoryFree header
+  *
+  * freeMemory() returns the current gap between the heap and the stack. The
+  * rest of the functions measure the peaks: the free RAM is painted with
+  * MEMORY_CANARY at start up, so the bytes still painted are the part of the
+  * gap never used by the stack.
   */
 #ifndef      MEMORY_FREE_H
 #define MEMORY_FREE_H
+
+#include <inttypes.h>
+
+// value painted on the free RAM
+#define MEMORY_CANARY		0xC5
+
+// number of phases measured by memoryPhase()
+#define MEMORY_PHASES		4
+#define MEMORY_PHASE_NONE	0xFF
+
+typedef struct
+{
+	int freeGap;			// heap top to stack pointer, as freeMemory()
+	int minFreeGap;			// lowest gap reached since start up
+	int heapSize;			// bytes taken by the heap, free blocks included
+	int heapFree;			// bytes in the free blocks of the heap
+	int largestFree;		// largest free block of the heap
+	uint8_t freeBlocks;		// number of free blocks of the heap
+	uint8_t fragmentation;	// % of heapFree not in the largest block
+} 	memory_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 int freeMemory();
+int memoryMinFree();
+void memoryRepaint();
+void memoryStats(memory_stats_t* stats);
+void memoryPhase(uint8_t phase);
+int memoryPhaseMinFree(uint8_t phase);
 #ifdef   __cplusplus
 }
 #endif
 #endif
 
+
@@ -0,0 +1,218 @@
+/*
+  StringBuilder.cpp - Fixed capacity strings for Waspmote
+*/
+
+#include "StringBuilder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/pgmspace.h>
+
+/*********************************************/
+/*  Constructor                              */
+/*********************************************/
+
+StringBuilder::StringBuilder(char *buffer, size_t capacity)
+{
+	_buffer = buffer;
+	_capacity = capacity;
+	clear();
+}
+
+void StringBuilder::clear(void)
+{
+	_length = 0;
+	_overflow = false;
+	_buffer[0] = '\0';
+	clearWriteError();
+}
+
+/*********************************************/
+/*  concat                                   */
+/*********************************************/
+
+unsigned char StringBuilder::concat(const char *data, size_t length)
+{
+	if (length > remaining()) {
+		_overflow = true;
+		return 0;
+	}
+	memcpy(_buffer + _length, data, length);
+	_length += length;
+	_buffer[_length] = '\0';
+	return 1;
+}
+
+unsigned char StringBuilder::concat(const String &str)
+{
+	return concat(str.c_str(), str.length());
+}
+
+unsigned char StringBuilder::concat(const StringBuilder &str)
+{
+	return concat(str.c_str(), str.length());
+}
+
+unsigned char StringBuilder::concat(const char *cstr)
+{
+	if (!cstr) return 0;
+	return concat(cstr, strlen(cstr));
+}
+
+unsigned char StringBuilder::concat(char c)
+{
+	return concat(&c, 1);
+}
+
+unsigned char StringBuilder::concat(unsigned char num)
+{
+	char buf[4];
+	utoa(num, buf, 10);
+	return concat(buf);
+}
+
+unsigned char StringBuilder::concat(int num)
+{
+	char buf[7];
+	itoa(num, buf, 10);
+	return concat(buf);
+}
+
+unsigned char StringBuilder::concat(unsigned int num)
+{
+	char buf[6];
+	utoa(num, buf, 10);
+	return concat(buf);
+}
+
+unsigned char StringBuilder::concat(long num)
+{
+	char buf[12];
+	ltoa(num, buf, 10);
+	return concat(buf);
+}
+
+unsigned char StringBuilder::concat(unsigned long num)
+{
+	char buf[11];
+	ultoa(num, buf, 10);
+	return concat(buf);
+}
+
+// two decimals, as String
+unsigned char StringBuilder::concat(float num)
+{
+	char buf[20];
+	dtostrf(num, 4, 2, buf);
+	return concat(buf);
+}
+
+unsigned char StringBuilder::concat(double num)
+{
+	char buf[20];
+	dtostrf(num, 4, 2, buf);
+	return concat(buf);
+}
+
+unsigned char StringBuilder::concat(const __FlashStringHelper *str)
+{
+	if (!str) return 0;
+	size_t length = strlen_P((PGM_P)str);
+	if (length > remaining()) {
+		_overflow = true;
+		return 0;
+	}
+	memcpy_P(_buffer + _length, (PGM_P)str, length);
+	_length += length;
+	_buffer[_length] = '\0';
+	return 1;
+}
+
+/*********************************************/
+/*  format                                   */
+/*********************************************/
+
+unsigned char StringBuilder::formatList(const char *fmt, va_list args, bool progmem)
+{
+	int length;
+
+	if (progmem) {
+		length = vsnprintf_P(_buffer + _length, remaining() + 1, fmt, args);
+	} else {
+		length = vsnprintf(_buffer + _length, remaining() + 1, fmt, args);
+	}
+
+	if ((length < 0) || ((size_t)length > remaining())) {
+		_buffer[_length] = '\0';
+		_overflow = true;
+		return 0;
+	}
+	_length += length;
+	return 1;
+}
+
+unsigned char StringBuilder::format(const char *fmt, ...)
+{
+	va_list args;
+	unsigned char result;
+
+	va_start(args, fmt);
+	result = formatList(fmt, args, false);
+	va_end(args);
+	return result;
+}
+
+unsigned char StringBuilder::format_P(const char *fmt, ...)
+{
+	va_list args;
+	unsigned char result;
+
+	va_start(args, fmt);
+	result = formatList(fmt, args, true);
+	va_end(args);
+	return result;
+}
+
+/*********************************************/
+/*  Comparison and character access          */
+/*********************************************/
+
+unsigned char StringBuilder::equals(const char *cstr) const
+{
+	if (!cstr) return _length == 0;
+	return strcmp(_buffer, cstr) == 0;
+}
+
+char StringBuilder::charAt(size_t index) const
+{
+	if (index >= _length) return 0;
+	return _buffer[index];
+}
+
+/*********************************************/
+/*  Print                                    */
+/*********************************************/
+
+size_t StringBuilder::write(uint8_t c)
+{
+	if (remaining() == 0) {
+		_overflow = true;
+		setWriteError();
+		return 0;
+	}
+	_buffer[_length++] = c;
+	_buffer[_length] = '\0';
+	return 1;
+}
+
+size_t StringBuilder::write(const uint8_t *buffer, size_t size)
+{
+	if (size > remaining()) {
+		size = remaining();
+		_overflow = true;
+		setWriteError();
+	}
+	memcpy(_buffer + _length, buffer, size);
+	_length += size;
+	_buffer[_length] = '\0';
+	return size;
+}
@@ -0,0 +1,119 @@
+/*
+  StringBuilder.h - Fixed capacity strings for Waspmote
+
+  String grows its buffer with realloc() on every concatenation, which
+  fragments the heap of a node running for months. StringBuilder appends to
+  a buffer given by its owner, a static or stack array, and never allocates:
+  FixedString<N> carries its own array of N characters.
+
+  The append API is the one of String (concat(), +=) plus printf style
+  format(), and as a Print it can also be the destination of print(),
+  serializeJson() and similar. concat() and format() append everything or
+  nothing and return 0 when the result does not fit; bytes written through
+  Print are truncated instead. Either way overflow() tells that something
+  was lost since the last clear().
+*/
+
+#ifndef StringBuilder_h
+#define StringBuilder_h
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+#include "Print.h"
+
+class StringBuilder : public Print
+{
+public:
+	// 'buffer' holds 'capacity' characters plus the '\0'
+	StringBuilder(char *buffer, size_t capacity);
+
+	void clear(void);
+	inline size_t length(void) const {return _length;}
+	inline size_t capacity(void) const {return _capacity;}
+	inline size_t remaining(void) const {return _capacity - _length;}
+	inline bool overflow(void) const {return _overflow;}
+	inline const char* c_str() const {return _buffer;}
+	inline char* begin() {return _buffer;}
+	inline char* end() {return _buffer + _length;}
+
+	// concatenate, like String. 1 on success, 0 if it does not fit (in
+	// which case the string is left unchanged)
+	unsigned char concat(const String &str);
+	unsigned char concat(const StringBuilder &str);
+	unsigned char concat(const char *cstr);
+	unsigned char concat(const char *data, size_t length);
+	unsigned char concat(char c);
+	unsigned char concat(unsigned char num);
+	unsigned char concat(int num);
+	unsigned char concat(unsigned int num);
+	unsigned char concat(long num);
+	unsigned char concat(unsigned long num);
+	unsigned char concat(float num);
+	unsigned char concat(double num);
+	unsigned char concat(const __FlashStringHelper *str);
+
+	StringBuilder & operator += (const String &rhs)		{concat(rhs); return (*this);}
+	StringBuilder & operator += (const StringBuilder &rhs)	{concat(rhs); return (*this);}
+	StringBuilder & operator += (const char *cstr)		{concat(cstr); return (*this);}
+	StringBuilder & operator += (char c)			{concat(c); return (*this);}
+	StringBuilder & operator += (unsigned char num)		{concat(num); return (*this);}
+	StringBuilder & operator += (int num)			{concat(num); return (*this);}
+	StringBuilder & operator += (unsigned int num)		{concat(num); return (*this);}
+	StringBuilder & operator += (long num)			{concat(num); return (*this);}
+	StringBuilder & operator += (unsigned long num)		{concat(num); return (*this);}
+	StringBuilder & operator += (float num)			{concat(num); return (*this);}
+	StringBuilder & operator += (double num)		{concat(num); return (*this);}
+	StringBuilder & operator += (const __FlashStringHelper *str){concat(str); return (*this);}
+
+	// it appends printf formatted text, the format in RAM or in Flash
+	// (PSTR). 1 on success, 0 if it does not fit (the string is left
+	// unchanged)
+	unsigned char format(const char *fmt, ...);
+	unsigned char format_P(const char *fmt, ...);
+
+	// comparison and character access
+	unsigned char equals(const char *cstr) const;
+	unsigned char operator == (const char *cstr) const {return equals(cstr);}
+	unsigned char operator != (const char *cstr) const {return !equals(cstr);}
+	char charAt(size_t index) const;
+	char operator [] (size_t index) const {return charAt(index);}
+
+	// Print: the bytes that do not fit are dropped
+	virtual size_t write(uint8_t c);
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+
+protected:
+	unsigned char formatList(const char *fmt, va_list args, bool progmem);
+
+	char *_buffer;
+	size_t _capacity;
+	size_t _length;
+	bool _overflow;
+
+private:
+	// the buffer belongs to its owner, copies would share it
+	StringBuilder(const StringBuilder &);
+	StringBuilder & operator = (const StringBuilder &);
+};
+
+// StringBuilder with its own storage of N characters
+template <size_t N>
+class FixedString : public StringBuilder
+{
+public:
+	FixedString() : StringBuilder(_storage, N) {}
+	FixedString(const char *cstr) : StringBuilder(_storage, N) {concat(cstr);}
+	FixedString(const __FlashStringHelper *str) : StringBuilder(_storage, N) {concat(str);}
+	FixedString(const FixedString &rhs) : StringBuilder(_storage, N) {concat(rhs);}
+
+	FixedString & operator = (const FixedString &rhs) {if (this != &rhs) {clear(); concat(rhs);} return (*this);}
+	FixedString & operator = (const char *cstr) {clear(); concat(cstr); return (*this);}
+	FixedString & operator = (const __FlashStringHelper *str) {clear(); concat(str); return (*this);}
+
+private:
+	char _storage[N + 1];
+};
+
+#endif
@@ -48,6 +48,7 @@
 #include "WaspPWR.h"
 #include "WaspXBeeCore.h"
 #include "MemoryFree.h"
+#include "StringBuilder.h"
 #include "WaspEEPROM.h"
 #include "WaspOneWire.h"
 
@@ -36,6 +36,7 @@ WaspEEPROM::WaspEEPROM()
 {
     _deviceAddress = I2C_ADDRESS_EEPROM;
     _lastWrite = 0;
+    _ready = false;
     TWBR = 12;          // 12=400Khz  32=200  72=100 152=50    F_CPU/16+(2*TWBR)
 }
 
@@ -46,6 +47,12 @@ uint8_t WaspEEPROM::ON()
 	// init I2C bus
 	I2C.begin();
 	
+	// already checked and not put to sleep since: skip the JEDEC command
+	if (_ready)
+	{
+		return 0;
+	}
+	
 	error = waitReady();
 	
 	// check correct comm
@@ -55,6 +62,7 @@ uint8_t WaspEEPROM::ON()
 	{		
 		if ((_response[0] == 0x00) && (_response[1] == 0x1F))
 		{
+			_ready = true;
 			return 0;
 		}
 		
@@ -92,8 +100,8 @@ int WaspEEPROM::writeByte(uint16_t address, uint8_t data)
 
 int WaspEEPROM::setBlock(uint16_t address, uint8_t data, uint16_t length)
 {
-    uint8_t buffer[I2C_TWIBUFFERSIZE];
-    for (uint8_t i =0; i< I2C_TWIBUFFERSIZE; i++) buffer[i] = data;
+    uint8_t buffer[I2C_EEPROM_PAGESIZE];
+    for (uint8_t i =0; i< I2C_EEPROM_PAGESIZE; i++) buffer[i] = data;
 
     int rv = _pageBlock(address, buffer, length, false); // todo check return value..
     return rv;
@@ -112,17 +120,46 @@ uint8_t WaspEEPROM::readByte(uint16_t address)
     return rdata;
 }
 
+// the reads are split in pages and queued on the I2C bus, so the next page
+// is requested from the TWI interrupt as soon as the previous one is done
+// returns 0 = OK otherwise the number of pages not read
 uint16_t WaspEEPROM::readBlock(uint16_t address, uint8_t* buffer, uint16_t length)
 {
+    I2CTransaction queue[I2C_EEPROM_READ_QUEUE];
     uint16_t rv = 0;
+    uint8_t slot = 0;
+
+    for (uint8_t i = 0; i < I2C_EEPROM_READ_QUEUE; i++) queue[i].state = I2C_ASYNC_IDLE;
+
+    waitReady();
+
     while (length > 0)
     {
-        uint8_t cnt = min(length, I2C_TWIBUFFERSIZE);
-        rv += _ReadBlock(address, buffer, cnt);
+        uint8_t bytesUntilPageBoundary = I2C_EEPROM_PAGESIZE - address%I2C_EEPROM_PAGESIZE;
+        uint8_t cnt = min(length, bytesUntilPageBoundary);
+
+        // reuse the oldest transaction once it is done
+        if (queue[slot].state != I2C_ASYNC_IDLE)
+        {
+            if (I2C.wait(&queue[slot]) != 0) rv++;
+        }
+
+        I2C.prepareRead(&queue[slot], _deviceAddress, address, buffer, cnt);
+        I2C.submit(&queue[slot]);
+        slot = (slot + 1) % I2C_EEPROM_READ_QUEUE;
+
         address += cnt;
         buffer += cnt;
         length -= cnt;
     }
+
+    for (uint8_t i = 0; i < I2C_EEPROM_READ_QUEUE; i++)
+    {
+        if (queue[i].state != I2C_ASYNC_IDLE)
+        {
+            if (I2C.wait(&queue[i]) != 0) rv++;
+        }
+    }
     return rv;
 }
 
@@ -171,8 +208,8 @@ uint8_t WaspEEPROM::determineSize()
 // PRIVATE
 //
 
-// _pageBlock aligns buffer to page boundaries for writing.
-// and to TWI buffer size
+// _pageBlock aligns buffer to page boundaries for writing,
+// so every page is written with a single I2C transfer
 // returns 0 = OK otherwise error
 int WaspEEPROM::_pageBlock(uint16_t address, uint8_t* buffer, uint16_t length, bool incrBuffer)
 {
@@ -181,7 +218,6 @@ int WaspEEPROM::_pageBlock(uint16_t address, uint8_t* buffer, uint16_t length, b
     {
         uint8_t bytesUntilPageBoundary = I2C_EEPROM_PAGESIZE - address%I2C_EEPROM_PAGESIZE;
         uint8_t cnt = min(length, bytesUntilPageBoundary);
-        cnt = min(cnt, I2C_TWIBUFFERSIZE);
 
         int rv = _WriteBlock(address, buffer, cnt); // todo check return value..
         if (rv != 0) return rv;
@@ -193,7 +229,7 @@ int WaspEEPROM::_pageBlock(uint16_t address, uint8_t* buffer, uint16_t length, b
     return rv;
 }
 
-// pre: length <= I2C_EEPROM_PAGESIZE  && length <= I2C_TWIBUFFERSIZE;
+// pre: length <= I2C_EEPROM_PAGESIZE and the page boundary is not crossed
 // returns 0 = OK otherwise error
 int WaspEEPROM::_WriteBlock(uint16_t address, uint8_t* buffer, uint8_t length)
 {
@@ -238,63 +274,101 @@ uint8_t WaspEEPROM::readRegister(uint16_t address, uint8_t* buffer, uint8_t leng
 
 /*************************************************************
  *
+ * sendCommand: it writes the command and waits for its response
  *
+ *************************************************************/
+uint8_t WaspEEPROM::sendCommand(uint8_t* command)
+{
+	if (_commandWrite(command) != 0)
+	{
+		return 1;
+	}
+	return _commandResponse();
+}
+
+
+/*************************************************************
  *
- *
- *
+ * _commandWrite: it appends the CRC and writes the command to
+ * the I/O buffer, without waiting for its execution
  *
  *************************************************************/
-uint8_t WaspEEPROM::sendCommand(uint8_t* command)
+uint8_t WaspEEPROM::_commandWrite(uint8_t* command)
 {
-	int retries = 3;
 	int x;
 	uint8_t crc_tx[2];
-	uint8_t crc_rx[2];
-	uint8_t crc_aux[2];
 	uint8_t length = command[0]-2;
-	uint8_t rx_length = 16;
-	uint16_t address = 0xFE00; // CMD REGISTER ADDRESS
 	
-	do
+	// calculate CRC
+	aes132c_calculate_crc(length, command, crc_tx);
+	
+	memset(_buffer,0x00,sizeof(_buffer));
+	memcpy(_buffer,command,length);
+	
+	_buffer[length] = crc_tx[0];
+	_buffer[length+1] = crc_tx[1];
+	
+	#if DEBUG_EEPROM > 0
+		PRINT_EEPROM("Command: ");
+		USB.printHexln(_buffer, length+2);
+	#endif
+	
+	for (uint8_t retries = 0; retries < 3; retries++)
 	{
-		// calculate CRC
-		aes132c_calculate_crc(length, command, crc_tx);
-
-		// wait until chip is ready
-		//~ waitReady();
-		
-		memset(_buffer,0x00,sizeof(_buffer));
-		memset(_response,0x00,sizeof(_response));
-		memcpy(_buffer,command,sizeof(_buffer));
+		x = I2C.write(_deviceAddress,(uint16_t)AES132_IO_ADDR,_buffer,length+2);
 		
-		_buffer[length] = crc_tx[0];
-		_buffer[length+1] = crc_tx[1];
+		if (x == 0)
+		{
+			return 0;
+		}
 		
-		#if DEBUG_EEPROM > 0
-			PRINT_EEPROM("Command: ");
-			USB.printHexln(_buffer, length+2);
+		#if DEBUG_EEPROM > 1
+			PRINT_EEPROM(F("Error endTransmission\r\n"));	
 		#endif
+		delay(100);
+	}
+	
+	_ready = false;
+	return 1;
+}
+
+
+/*************************************************************
+ *
+ * _commandResponse: it polls the status register until the
+ * response is ready and reads it into '_response'. The device
+ * does not answer while it is busy, so a failed status read
+ * only means not ready yet
+ *
+ *************************************************************/
+uint8_t WaspEEPROM::_commandResponse()
+{
+	int x;
+	uint8_t status_reg = 0;
+	uint8_t crc_rx[2];
+	uint8_t crc_aux[2];
+	unsigned long start = millis();
+	
+	memset(_response,0x00,sizeof(_response));
+	
+	// if the ready bit is never seen the response is read anyway once
+	// the longest command time has elapsed, and the CRC decides
+	while (millis() - start <= AES132_RESPONSE_READY_TIMEOUT)
+	{
+		x = I2C.read(_deviceAddress,(uint16_t)AES132_STATUS_ADDR,&status_reg,1);
 		
-		x = I2C.write(_deviceAddress,address,_buffer,length+2);
-		
-		
-		if (x != 0)
+		if ((x == 0) && (status_reg & AES132_RESPONSE_READY_BIT))
 		{
-			#if DEBUG_EEPROM > 1
-				PRINT_EEPROM(F("Error endTransmission\r\n"));	
-			#endif
+			break;
 		}
-		delay(100);
-		retries--;
-		if (retries == 0) return 1;
 	}
-	while(x != 0);
 
 	// read response	
-	x = I2C.read(_deviceAddress,_buffer,90);
+	x = I2C.read(_deviceAddress,(uint16_t)AES132_IO_ADDR,_buffer,AES132_RESPONSE_SIZE_MAX);
 	
 	if (x != 0)
 	{		
+		_ready = false;
 		return 1;
 	}
 	
@@ -302,6 +376,12 @@ uint8_t WaspEEPROM::sendCommand(uint8_t* command)
 	uint8_t count = _buffer[0];
 	uint8_t status = _buffer[1];
 	
+	if ((count < AES132_RESPONSE_SIZE_MIN) || (count > AES132_RESPONSE_SIZE_MAX))
+	{
+		_length = 0;
+		return 1;
+	}
+	
 	#if DEBUG_EEPROM > 0
 		PRINT_EEPROM("[EEPROM] Response count: ");
 		USB.println(count, DEC);
@@ -356,8 +436,6 @@ uint8_t WaspEEPROM::sendCommand(uint8_t* command)
 	
 	// check crc
 	aes132c_calculate_crc(count-2, _buffer, crc_aux);
-		
-	delay(10);
 	
 	if (memcmp( crc_rx, crc_aux, 2) == 0)
 	{
@@ -404,6 +482,9 @@ uint8_t WaspEEPROM::sleepCommand()
 	
 	x = I2C.write(_deviceAddress,address,_buffer,length+2);
 
+	// the next command needs a new JEDEC check in ON()
+	_ready = false;
+	
 	if (x != 0)
 	{
 		//USB.println("Error endTransmission_sleep");
@@ -523,11 +604,29 @@ uint8_t WaspEEPROM::blockRead(uint16_t address, uint8_t length)
  */
 uint8_t WaspEEPROM::encryptBlock16(uint8_t index, uint8_t *data, uint8_t len)
 {
-  uint8_t error = 0;
+  uint8_t command[1 + 1 + 1 + 2 + 2 + 16];
+
+  _encryptCommand(command, index, data, len);
+
+  return eeprom.sendCommand(command);
+}
+
+
+
+/* 
+ * @brief Build the Encrypt command (AES ECB legacy mode) of a block. The
+ * 		block is padded with zeros when 'len' is shorter than 16 bytes
+ * @param uint8_t *command: Buffer for the command (23 bytes)
+ * @param uint8_t index: Index of the key memory map (from 0x00 to 0x0F)
+ * @param uint8_t *data: Pointer to the plain text data to encrypt
+ * @param uint16_t len: Length of the plain text data left
+ * 
+ */
+void WaspEEPROM::_encryptCommand(uint8_t *command, uint8_t index, uint8_t *data, uint16_t len)
+{
   uint8_t i = 0;
 
-  uint8_t command[1 + 1 + 1 + 2 + 2 + 16];
-  memset(command, 0x00, sizeof(command));
+  memset(command, 0x00, 1 + 1 + 1 + 2 + 2 + 16);
 
   // define command
   command[i++] = 1 + 1 + 1 + 2 + 2 + 16 + 2; // Count
@@ -538,28 +637,26 @@ uint8_t WaspEEPROM::encryptBlock16(uint8_t index, uint8_t *data, uint8_t len)
   command[i++] = 0x00; // Param2 Upper byte (Zero)
   command[i++] = 0x00; // Param2 Upper byte (Zero)
 
-  
-  uint8_t length = len;
+  uint16_t length = len;
   if (length > 16) length = 16;
 
-  for (uint8_t j = 0; j < length; j++)
-  {
-    command[i++] = data[j]; // Data
-  }
-  
-  error = eeprom.sendCommand(command);
-
-  return error;
+  memcpy(&command[i], data, length); // Data
 }
 
 
 
 
 /* 
- * @brief Encrypt a
+ * @brief Encrypt a buffer in 16-byte blocks (AES ECB legacy mode). The last
+ * 		block is padded with zeros. The command of the next block is built
+ * 		while the device encrypts the current one, and the end of every
+ * 		command is detected polling the status register
  * @param uint8_t index: Index of the key memory map (from 0x00 to 0x0F)
  * @param uint8_t *data: Pointer to the plain text data to encrypt
- * @param uint8_t len: Length of the plain text data (max: 16 bytes)
+ * @param uint16_t length: Length of the plain text data
+ * @param uint8_t *encryptedData: Buffer for the encrypted data, 'length'
+ * 		rounded up to a multiple of 16 bytes
+ * @param uint16_t *encryptedLength: Length of the encrypted data
  * @return
  * 	@arg '0' OK
  * 	@arg '1' error
@@ -568,26 +665,33 @@ uint8_t WaspEEPROM::encryptBlock16(uint8_t index, uint8_t *data, uint8_t len)
 uint8_t WaspEEPROM::encrypt(uint8_t index, uint8_t *data, uint16_t length, uint8_t *encryptedData, uint16_t *encryptedLength)
 {
 	uint8_t error = 0;
+	uint8_t command[1 + 1 + 1 + 2 + 2 + 16];
 		
-	uint16_t aux = (length-1) / 16;
-	uint16_t n_iterations;
+	// Examples: 
+	// 	16-byte length requires 1 iteration
+	// 	17-byte length requires 2 iterations 
+	uint16_t n_iterations = (length + 15) / 16;
 	
-	if (aux == 0)
+	if (n_iterations == 0)
 	{
 		n_iterations = 1;
 	}
-	else 
-	{
-		n_iterations = (aux*16+16)/16;
-	}		
+
+	_encryptCommand(command, index, data, length);
+	error = _commandWrite(command);
 
 	// iterate through all 16-byte blocks of the original message
-	// Examples: 
-	// 	16-byte length requires 1 iteration
-	// 	17-byte length requires 2 iterations 
-	for (uint8_t i = 0; i < n_iterations; i++)
+	for (uint16_t i = 0; (i < n_iterations) && (error == 0); i++)
 	{
-		error = encryptBlock16(index, &data[i*16], 16);		
+		uint16_t next = (i+1)*16;
+		
+		// build the next command while the device is busy
+		if (i+1 < n_iterations)
+		{
+			_encryptCommand(command, index, &data[next], length - next);
+		}
+		
+		error = _commandResponse();
 
 		if (error == 0)
 		{
@@ -596,6 +700,11 @@ uint8_t WaspEEPROM::encrypt(uint8_t index, uint8_t *data, uint16_t length, uint8
 			
 			// update length
 			*encryptedLength = i*16+16;
+			
+			if (i+1 < n_iterations)
+			{
+				error = _commandWrite(command);
+			}
 		}		
 	}
 	
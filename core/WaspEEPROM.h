@@ -45,8 +45,8 @@
 
 
 // I2C_EEPROM_PAGESIZE must be multiple of 2 e.g. 16, 32 or 64
-// 24LC256 -> 64 bytes
-#define I2C_EEPROM_PAGESIZE 64
+// AES132 -> 32 bytes, a single write must not cross a page boundary
+#define I2C_EEPROM_PAGESIZE AES132_MEM_ACCESS_MAX
 
 // TWI buffer needs max 2 bytes for address
 #define I2C_TWIBUFFERSIZE  30
@@ -54,6 +54,9 @@
 // to break blocking read/write
 #define I2C_EEPROM_TIMEOUT  1000
 
+// page reads queued on the I2C bus at the same time by readBlock()
+#define I2C_EEPROM_READ_QUEUE  4
+
 // comment next line to keep lib small
 #define I2C_EEPROM_EXTENDED
 
@@ -98,12 +101,16 @@ public:
 private:
     uint8_t _deviceAddress;
     uint32_t _lastWrite;  // for waitReady
+    bool _ready;          // JEDEC checked by ON() and not put to sleep since
    
     int _pageBlock(uint16_t address, uint8_t* buffer, uint16_t length, bool incrBuffer);
     int _WriteBlock(uint16_t address, uint8_t* buffer, uint8_t length);
     uint8_t _ReadBlock(uint16_t address, uint8_t* buffer, uint8_t length);
 
     uint8_t waitReady();
+    uint8_t _commandWrite(uint8_t* command);
+    uint8_t _commandResponse();
+    void _encryptCommand(uint8_t* command, uint8_t index, uint8_t* data, uint16_t len);
 };
 
 extern WaspEEPROM eeprom;
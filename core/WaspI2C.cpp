@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #include "WaspI2C.h"
+#include <avr/sleep.h>
 
 
 /*!
@@ -42,6 +43,9 @@ extern "C" {
  */
 void WaspI2C::begin()
 {	
+	// Re-initializing the TWI would break the transaction in progress
+	flush();
+	
 	/* TWI master initialization options. */
 	twi_master_options_t opt;
 	
@@ -51,6 +55,7 @@ void WaspI2C::begin()
 	
 	/* Initialize the TWI master driver. */
 	twi_master_init(&TWBR,&opt);
+	twi_master_set_callback(WaspI2C::asyncComplete);
 }
 
 
@@ -520,6 +525,9 @@ uint8_t WaspI2C::readBit(uint8_t devAddr,
  */
 void WaspI2C::secureBegin()
 {		
+	// The blocking driver needs the bus, so the queued transactions go first
+	flush();
+	
 	// Get the 3V3 power supply state
 	_power_3v3_on = WaspRegister & REG_3V3;	
 	
@@ -572,9 +580,314 @@ uint8_t WaspI2C::scanSlaves()
 void WaspI2C::recover()
 {
 	I2C.close();
-	delay(1000);
+	delayIdle(1000);
 	I2C.begin();
 }
+/*!
+ * 
+ * @brief	This function prepares an asynchronous read (1-Byte register 
+ * 			address is indicated)
+ * @param	I2CTransaction* transaction: transaction to prepare
+ * @param	uint8_t devAddr: Slave address
+ * @param	uint8_t regAddr: Register address
+ * @param	uint8_t *data_received: Pointer to buffer where data is stored
+ * @param	uint16_t size: Number of bytes to read
+ * @param	I2CCallback callback: called when done, NULL for polling
+ * @return	void
+ * 
+ */
+void WaspI2C::prepareRead(	I2CTransaction* transaction,
+							uint8_t devAddr, 
+							uint8_t regAddr, 
+							uint8_t *data_received, 
+							uint16_t size,
+							I2CCallback callback)
+{
+	transaction->packet.addr[0]     = regAddr;
+	transaction->packet.addr_length = TWI_SLAVE_ONE_BYTE_SIZE;
+	transaction->packet.chip        = (devAddr << 1);
+	transaction->packet.buffer      = data_received;
+	transaction->packet.length      = size;
+	transaction->read     = true;
+	transaction->state    = I2C_ASYNC_IDLE;
+	transaction->status   = OPERATION_IN_PROGRESS;
+	transaction->callback = callback;
+	transaction->next     = NULL;
+}
+
+
+/*!
+ * 
+ * @brief	This function prepares an asynchronous write (1-Byte register 
+ * 			address is indicated)
+ * @param	I2CTransaction* transaction: transaction to prepare
+ * @param	uint8_t devAddr: Slave address
+ * @param	uint8_t regAddr: Register address
+ * @param	uint8_t *data: Pointer to buffer of data to write
+ * @param	uint16_t length: Number of bytes to write
+ * @param	I2CCallback callback: called when done, NULL for polling
+ * @return	void
+ * 
+ */
+void WaspI2C::prepareWrite(	I2CTransaction* transaction,
+							uint8_t devAddr, 
+							uint8_t regAddr, 
+							uint8_t *data, 
+							uint16_t length,
+							I2CCallback callback)
+{
+	prepareRead(transaction, devAddr, regAddr, data, length, callback);
+	transaction->read = false;
+}
+
+
+/*!
+ * 
+ * @brief	This function prepares an asynchronous read (2-Byte register 
+ * 			address is indicated)
+ * @param	I2CTransaction* transaction: transaction to prepare
+ * @param	uint8_t devAddr: Slave address
+ * @param	uint16_t regAddr: Register address
+ * @param	uint8_t *data_received: Pointer to buffer where data is stored
+ * @param	uint16_t size: Number of bytes to read
+ * @param	I2CCallback callback: called when done, NULL for polling
+ * @return	void
+ * 
+ */
+void WaspI2C::prepareRead(	I2CTransaction* transaction,
+							uint8_t devAddr, 
+							uint16_t regAddr, 
+							uint8_t *data_received, 
+							uint16_t size,
+							I2CCallback callback)
+{
+	prepareRead(transaction, devAddr, (uint8_t)(regAddr >> 8), data_received, size, callback);
+	transaction->packet.addr[1]     = regAddr & 0xFF;
+	transaction->packet.addr_length = TWI_SLAVE_TWO_BYTE_SIZE;
+}
+
+
+/*!
+ * 
+ * @brief	This function prepares an asynchronous write (2-Byte register 
+ * 			address is indicated)
+ * @param	I2CTransaction* transaction: transaction to prepare
+ * @param	uint8_t devAddr: Slave address
+ * @param	uint16_t regAddr: Register address
+ * @param	uint8_t *data: Pointer to buffer of data to write
+ * @param	uint16_t length: Number of bytes to write
+ * @param	I2CCallback callback: called when done, NULL for polling
+ * @return	void
+ * 
+ */
+void WaspI2C::prepareWrite(	I2CTransaction* transaction,
+							uint8_t devAddr, 
+							uint16_t regAddr, 
+							uint8_t *data, 
+							uint16_t length,
+							I2CCallback callback)
+{
+	prepareRead(transaction, devAddr, regAddr, data, length, callback);
+	transaction->read = false;
+}
+
+
+/*!
+ * 
+ * @brief	This function queues a transaction. It is started at once if the
+ * 			bus is free, otherwise when the previous ones are done
+ * @param	I2CTransaction* transaction: prepared transaction
+ * @return	'0' if queued; '1' if the transaction is already queued
+ * 
+ */
+uint8_t WaspI2C::submit(I2CTransaction* transaction)
+{
+	if ((transaction->state == I2C_ASYNC_PENDING) || 
+		(transaction->state == I2C_ASYNC_RUNNING))
+	{
+		return 1;
+	}
+	
+	// Same power checks as the blocking functions, only needed when idle
+	if (_queueHead == NULL)
+	{
+		secureBegin();
+	}
+	
+	transaction->state  = I2C_ASYNC_PENDING;
+	transaction->status = OPERATION_IN_PROGRESS;
+	transaction->next   = NULL;
+	
+	uint8_t oldSREG = SREG;
+	cli();
+	bool idle = (_queueHead == NULL);
+	if (idle)
+	{
+		_queueHead = transaction;
+	}
+	else
+	{
+		_queueTail->next = transaction;
+	}
+	_queueTail = transaction;
+	if (idle)
+	{
+		startNext();
+	}
+	SREG = oldSREG;
+	
+	return 0;
+}
+
+
+/*!
+ * 
+ * @brief	This function starts the transaction at the head of the queue. 
+ * 			Transactions that cannot be started are completed with the error
+ * 			Interrupts must be disabled (or called from the TWI interrupt)
+ * @return	void
+ * 
+ */
+void WaspI2C::startNext()
+{
+	while (_queueHead != NULL)
+	{
+		I2CTransaction* transaction = _queueHead;
+		status_code_t status;
+		
+		transaction->state = I2C_ASYNC_RUNNING;
+		transaction->start = millis();
+		if (transaction->read)
+		{
+			status = twi_master_read_async(&TWBR, &transaction->packet);
+		}
+		else
+		{
+			status = twi_master_write_async(&TWBR, &transaction->packet);
+		}
+		
+		if (status == STATUS_OK)
+		{
+			return;
+		}
+		
+		_queueHead = transaction->next;
+		transaction->status = status;
+		transaction->state = I2C_ASYNC_DONE;
+		if (transaction->callback != NULL)
+		{
+			transaction->callback(transaction);
+		}
+	}
+	_queueTail = NULL;
+}
+
+
+/*!
+ * 
+ * @brief	TWI completion callback, it finishes the running transaction and
+ * 			starts the next one
+ * @param	status_code_t status: transfer result
+ * @return	void
+ * 
+ */
+void WaspI2C::asyncComplete(status_code_t status)
+{
+	I2CTransaction* transaction = I2C._queueHead;
+	
+	// Transfers of the blocking functions are not queued
+	if ((transaction == NULL) || (transaction->state != I2C_ASYNC_RUNNING))
+	{
+		return;
+	}
+	
+	I2C._queueHead = transaction->next;
+	transaction->status = status;
+	transaction->state = I2C_ASYNC_DONE;
+	
+	// Keep the bus busy before running the callback
+	I2C.startNext();
+	
+	if (transaction->callback != NULL)
+	{
+		transaction->callback(transaction);
+	}
+}
+
+
+/*!
+ * 
+ * @brief	This function resets the bus if the running transaction exceeds
+ * 			I2C_ASYNC_TIMEOUT. It is called by wait() and flush()
+ * @return	void
+ * 
+ */
+void WaspI2C::poll()
+{
+	uint8_t oldSREG = SREG;
+	cli();
+	I2CTransaction* transaction = _queueHead;
+	if ((transaction != NULL) && 
+		(transaction->state == I2C_ASYNC_RUNNING) &&
+		(millis() - transaction->start > I2C_ASYNC_TIMEOUT))
+	{
+		twi_master_abort(ERR_TIMEOUT);
+	}
+	SREG = oldSREG;
+}
+
+
+/*!
+ * 
+ * @brief	This function sleeps in idle mode until the next interrupt 
+ * 			(TWI or the millis() timer)
+ * @return	void
+ * 
+ */
+void WaspI2C::idle()
+{
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	sleep_cpu();
+	sleep_disable();
+}
+
+
+/*!
+ * 
+ * @brief	This function waits for a transaction, sleeping in idle mode
+ * @param	I2CTransaction* transaction: submitted transaction
+ * @return	enum status_code
+ * 
+ */
+uint8_t WaspI2C::wait(I2CTransaction* transaction)
+{
+	while ((transaction->state == I2C_ASYNC_PENDING) || 
+		   (transaction->state == I2C_ASYNC_RUNNING))
+	{
+		poll();
+		idle();
+	}
+	return transaction->status;
+}
+
+
+/*!
+ * 
+ * @brief	This function waits until all queued transactions are done
+ * @return	void
+ * 
+ */
+void WaspI2C::flush()
+{
+	while (_queueHead != NULL)
+	{
+		poll();
+		idle();
+	}
+}
+
+
 // Preinstantiate Objects //////////////////////////////////////////////////////
 
 WaspI2C I2C = WaspI2C();
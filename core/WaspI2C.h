@@ -79,6 +79,38 @@
 #define I2C_ADDRESS_GASES_SOCKET_2A_2B	0x2C
 #define I2C_ADDRESS_GASES_SOCKET_3_3B	0x2E
 
+// Asynchronous transaction states
+#define I2C_ASYNC_IDLE		0
+#define I2C_ASYNC_PENDING	1
+#define I2C_ASYNC_RUNNING	2
+#define I2C_ASYNC_DONE		3
+
+// Milliseconds a transaction may take before the bus is reset
+#define I2C_ASYNC_TIMEOUT	100
+
+struct I2CTransaction;
+
+//! Completion callback. It runs inside the TWI interrupt so it must be short
+//! and it must not call the blocking I2C functions
+typedef void (*I2CCallback)(I2CTransaction* transaction);
+
+//! Asynchronous read or write submitted with I2C.submit(). It belongs to the
+//! caller and it must stay valid (with its data buffer) until it is done
+struct I2CTransaction
+{
+	twi_package_t packet;
+	bool read;
+	volatile uint8_t state;
+	volatile uint8_t status;
+	I2CCallback callback;
+	void* context;			//!< free for the caller, i.e. for the callback
+	unsigned long start;
+	I2CTransaction* next;
+
+	//! 'true' once finished, 'status' holds then the result (0 if OK)
+	bool done() { return state == I2C_ASYNC_DONE; }
+};
+
 
 
 /******************************************************************************
@@ -91,6 +123,13 @@ private:
 
 	bool _power_3v3_on;
 	bool _slavePresent;
+
+	I2CTransaction* volatile _queueHead;
+	I2CTransaction* volatile _queueTail;
+
+	void startNext();
+	void idle();
+	static void asyncComplete(status_code_t status);
 	
 public:
 
@@ -119,6 +158,16 @@ public:
 
 	uint8_t scan(uint8_t devAddr);
 	uint8_t scanSlaves();
+
+	void prepareRead(I2CTransaction* transaction, uint8_t devAddr, uint8_t regAddr, uint8_t *data_received, uint16_t size, I2CCallback callback = NULL);
+	void prepareWrite(I2CTransaction* transaction, uint8_t devAddr, uint8_t regAddr, uint8_t *data, uint16_t length, I2CCallback callback = NULL);
+	void prepareRead(I2CTransaction* transaction, uint8_t devAddr, uint16_t regAddr, uint8_t *data_received, uint16_t size, I2CCallback callback = NULL);
+	void prepareWrite(I2CTransaction* transaction, uint8_t devAddr, uint16_t regAddr, uint8_t *data, uint16_t length, I2CCallback callback = NULL);
+	uint8_t submit(I2CTransaction* transaction);
+	void poll();
+	uint8_t wait(I2CTransaction* transaction);
+	void flush();
+	bool asyncBusy() { return _queueHead != NULL; }
 	
 };
 
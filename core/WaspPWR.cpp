@@ -244,7 +244,7 @@ void WaspPWR::switchesOFF(uint8_t option)
 	digitalWrite(SOCKET0_SS,LOW);
 	
 	// Switch off sensor board power supply
-	if ((option == ALL_OFF) || (option == SENS_OFF) || (option == SOCKET0_ON))
+	if ((option == ALL_OFF) || (option == SENS_OFF) || (option == SOCKET0_ON) || (option == SOCKET1_ON))
 	{	
 		// switch OFF sensor boards
 		PWR.setSensorPower(SENS_3V3, SENS_OFF);
@@ -255,7 +255,7 @@ void WaspPWR::switchesOFF(uint8_t option)
 	closeSerial(SOCKET0);
 	
 	// switch off SOCKET0 if needed
-	if ((option == ALL_OFF) || (option == SOCKET0_OFF) || (option == SENSOR_ON))
+	if ((option == ALL_OFF) || (option == SOCKET0_OFF) || (option == SENSOR_ON) || (option == SOCKET1_ON))
 	{	
 		// set SOCKET0 power supply off
 		PWR.powerSocket(SOCKET0, LOW);
@@ -266,8 +266,11 @@ void WaspPWR::switchesOFF(uint8_t option)
 	
 	// close UART1
 	closeSerial(SOCKET1);
-	// set SOCKET1 power supply off
-	PWR.powerSocket(SOCKET1, LOW);	
+	// set SOCKET1 power supply off unless the module on it must keep its state
+	if (option != SOCKET1_ON)
+	{
+		PWR.powerSocket(SOCKET1, LOW);
+	}
 	
 	// set Expansion board power supply off	unless a 
 	// Smart Cities board remains powered on 
@@ -321,7 +324,11 @@ void WaspPWR::switchesOFF(uint8_t option)
 		digitalWrite(DIGITAL1, LOW);
 		digitalWrite(DIGITAL5, LOW);
 		digitalWrite(DIGITAL3, LOW);
-		digitalWrite(DIGITAL6, LOW);
+		// DIGITAL6 is the SOCKET1 power supply too
+		if (option != SOCKET1_ON)
+		{
+			digitalWrite(DIGITAL6, LOW);
+		}
 		digitalWrite(ANA0, LOW);
 	}
 	
@@ -399,6 +406,8 @@ void WaspPWR::sleep(uint8_t	timer, uint8_t option)
     
     // Switch off RTC (Waspv12)
 	RTC.ON();
+	unsigned long epoch = RTC.getEpochTime();
+	unsigned long long counted = micros64();
 	RTC.OFF();
     
 	// switches off depending on the option selected       
@@ -419,24 +428,47 @@ void WaspPWR::sleep(uint8_t	timer, uint8_t option)
 
 	// *** set sleep mode ***
 	// check interruption pins and register are ok
+	uint8_t slept = 0;
 	if (!digitalRead(MUX_RX))
 	{
 		// set sleep mode
 		set_sleep_mode(SLEEP_MODE_PWR_DOWN);
 		
+		// the flag is only set by the watchdog ISR from now on
+		f_wdt = 0;
+		
 		if (timer != 0xFF)
 		{
 			// set watchdog timer to cause interruption for selected time
 			setWatchdog(WTD_ON, timer);		
 		}
 		sleep_mode();
+		slept = 1;
 	}
 	// wake up here
 	sleep_disable();
+	uint8_t woken_by_watchdog = slept && (timer != 0xFF) && (f_wdt == 1);
 		
 	// switch on main power supply
 	digitalWrite(POWER_3V3,HIGH);
 	
+	// timer 0 was stopped: add the time slept to micros64()
+	if (woken_by_watchdog)
+	{
+		// watchdog period: 2K cycles of its 128 kHz oscillator, doubled 
+		// 'timer' times
+		timebaseAddSleep(16000ULL << timer);
+	}
+	else
+	{
+		RTC.ON();
+		compensateSleep(epoch, counted);
+		if (!(intFlag & RTC_INT))
+		{
+			RTC.OFF();
+		}
+	}
+	
 	if (intFlag & RTC_INT)
 	{
 		RTC.ON();
@@ -532,6 +564,8 @@ void WaspPWR::deepSleep(const char* time2wake,
 		USB.println(F("[PWR] deepSleep RTC error"));
 		return (void)0;
 	}
+	unsigned long epoch = RTC.getEpochTime();
+	unsigned long long counted = micros64();
     RTC.OFF();
 	
 	// switch off main power supply when needed:
@@ -568,6 +602,9 @@ void WaspPWR::deepSleep(const char* time2wake,
 	RTC.disableAlarm1();
 	RTC.clearAlarmFlag();
 	
+	// timer 0 was stopped: add the time slept to micros64()
+	compensateSleep(epoch, counted);
+	
 	// re-activate what is needed
 	switchesON(option);
 	
@@ -575,6 +612,31 @@ void WaspPWR::deepSleep(const char* time2wake,
 }
 
 
+/* 
+ * compensateSleep()
+ *
+ * Timer 0 does not run in power-down, so micros64() only counted the time 
+ * awake since 'counted' was read. The time slept is the RTC time elapsed since
+ * 'epoch' (read together with 'counted') minus that, with the one second 
+ * resolution of the RTC. The RTC must be on.
+ * 
+ * Return: void
+ */
+void WaspPWR::compensateSleep(unsigned long epoch, unsigned long long counted)
+{
+	unsigned long long elapsed;
+	unsigned long long awake;
+	
+	elapsed = (unsigned long long)(RTC.getEpochTime() - epoch) * 1000000UL;
+	awake = micros64() - counted;
+	
+	if (elapsed > awake)
+	{
+		timebaseAddSleep(elapsed - awake);
+	}
+}
+
+
 
 /*
  * hibernate(time2wake, offset, mode) - enter a hibernate state
@@ -713,8 +775,6 @@ float WaspPWR::getBatteryVolts()
 	else
 	{
 		float result = 0;
-		int nSamples = 10;
-		int values[nSamples];		
 		
 		// change to REF 2.56V
 		analogReference(INTERNAL2V56);
@@ -736,38 +796,9 @@ float WaspPWR::getBatteryVolts()
 		digitalWrite(BAT_MONITOR_PW, HIGH);
 		delay(1);		
 		
-		// dummy readings
-		for(int i = 0; i<nSamples; i++)
-		{
-			analogRead(0);
-		}
-		
-		// get several readings and get the max repeated element in readings
-		uint8_t count = 0;
-		int	m;
-		for(int i = 0; i<nSamples; i++)
-		{
-			values[i] = analogRead(0);		
-
-			if (count == 0)
-			{
-				m = values[i];
-			}
-			if (i == 0)
-			{
-				m = values[0];
-			}
-			if (values[i] == m)
-			{
-				count++;
-			}
-			else
-			{
-				count--;
-			}
-		}		
-		//get result
-		result = m;
+		// 16 samples decimated to 12 bits; the CPU sleeps during the
+		// conversions and the first one after the channel change is dropped
+		result = analogReadOversampled(0, 2);
 		
 		// check if it is necessary to turn off the 5v power supply
 		if (!flag)
@@ -785,7 +816,8 @@ float WaspPWR::getBatteryVolts()
 		//~ result *= 3.3;
 		result *= 2.56;
 		result *= 2.0;
-		result /= 1023.0;
+		// 12-bit reading of 4 x 10-bit full scale: 0..4092 (not 4095)
+		result /= 4092.0;
 		
 		// trunc to three decimals
 		result *= 1000;
@@ -114,12 +114,17 @@
 /*! \def ALL_ON
     \brief Sleep Options. Do not switch off anything
  */
+/*! \def SOCKET1_ON
+    \brief Sleep Options. As ALL_OFF but SOCKET1 stays powered, so a module
+    on it (i.e. the 4G in PSM) keeps its state. Main 3V3 is kept on as well
+ */
 #define	ALL_ON			0
 #define	SENS_OFF		1		// redefined
 #define	SOCKET0_OFF		2
 #define	ALL_OFF			3		//SENS_OFF | SOCKET0_OFF
 #define SOCKET0_ON		5
 #define	SENSOR_ON		6
+#define	SOCKET1_ON		7
 
 
 /*! \def HIB_ADDR
@@ -172,6 +177,14 @@ class WaspPWR
 	\return the IPRA flag
 	 */
 	uint8_t getIPF();
+	
+    /*!
+    \brief	It adds the time slept, measured with the RTC, to micros64()
+	\param 	unsigned long epoch : RTC epoch time read before sleeping
+	\param 	unsigned long long counted : micros64() read with 'epoch'
+	\return void
+	 */
+	void compensateSleep(unsigned long epoch, unsigned long long counted);
 
   public:	
       	
@@ -1090,6 +1090,45 @@ int32_t WaspSD::getFileSize(const char* filepath)
 }
 
 
+/*
+ * crc32 (filepath, length, crc)
+ *
+ * reads the first 'length' bytes of the file through a small stack buffer and
+ * returns their CRC-32 in 'crc'. Returns '1' on success, '0' otherwise
+ */
+uint8_t WaspSD::crc32(const char* filepath, uint32_t length, uint32_t* crc)
+{
+	SdFile file;
+	uint8_t data[64];
+	int16_t nBytes;
+
+	*crc = 0;
+
+	if(!openFile( (char*)filepath, &file, O_RDONLY)) return 0;
+
+	if (file.fileSize() < length)
+	{
+		file.close();
+		return 0;
+	}
+
+	while (length > 0)
+	{
+		nBytes = file.read(data, (length < sizeof(data)) ? length : sizeof(data));
+		if (nBytes <= 0)
+		{
+			file.close();
+			return 0;
+		}
+		*crc = Utils.crc32(*crc, data, nBytes);
+		length -= nBytes;
+	}
+
+	file.close();
+	return 1;
+}
+
+
 /*
  * cat (filepath, offset, scope)
  *
@@ -1771,6 +1810,61 @@ uint8_t WaspSD::create(const char* filepath)
 }
 
 
+/*
+ * createContiguous ( filepath, size ) - create a file in consecutive clusters
+ *
+ * the clusters are allocated at once and the file size set to 'size', so the
+ * writes that follow only touch the data blocks
+ * Returns '1' on success, '0' otherwise
+ */
+uint8_t WaspSD::createContiguous(const char* filepath, uint32_t size)
+{
+	SdFile file;
+	int pathidx;
+	bool created;
+
+	setFileDate();
+
+	if (!isSD())
+	{
+		flag = CARD_NOT_PRESENT;
+		flag |= FILE_CREATION_ERROR;
+		snprintf(buffer, sizeof(buffer),"%s", CARD_NOT_PRESENT_em);
+		return 0;
+	}
+
+	flag &= ~(FILE_CREATION_ERROR);
+
+	SdFile parentdir = getParentDir(filepath, &pathidx);
+	filepath += pathidx;
+
+	if (!filepath[0] || !parentdir.isOpen())
+	{
+		flag |= FILE_CREATION_ERROR;
+		return 0;
+	}
+
+	if (parentdir.isRoot())
+	{
+		created = file.createContiguous(&root, filepath, size);
+	}
+	else
+	{
+		created = file.createContiguous(&parentdir, filepath, size);
+		parentdir.close();
+	}
+
+	if (!created)
+	{
+		flag |= FILE_CREATION_ERROR;
+		return 0;
+	}
+
+	file.close();
+	return 1;
+}
+
+
 /*
  * writeSD ( filepath, str, offset ) - write string to file
  *
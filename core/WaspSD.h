@@ -466,6 +466,15 @@ public:
 	*/
 	int32_t getFileSize(const char* filepath);
 
+	//! It gets the CRC-32 of the first bytes of a file (see Utils.crc32())
+	/*!
+	\param const char* filepath : path to the file
+	\param uint32_t length : bytes to check
+	\param uint32_t* crc : CRC-32 of the bytes
+	\return '1' on success, '0' if the file can not be opened or is shorter
+	*/
+	uint8_t crc32(const char* filepath, uint32_t length, uint32_t* crc);
+
 	//! It dumps into the buffer the amount of bytes in scope after offset
 	//! coming from filepath
 	/*!
@@ -530,6 +539,15 @@ public:
 	*/
 	uint8_t create(const char* filepath);
 
+	//! It creates a file of 'size' bytes in consecutive clusters, so writing
+	//! it does not update the FAT. Its contents are undefined until written
+	/*!
+	\param const char* filepath : path to the file to create
+	\param uint32_t size : size of the file
+	\return '1' on success, '0' otherwise (i.e. it exists or no room)
+	*/
+	uint8_t createContiguous(const char* filepath, uint32_t size);
+
 	//! It writes strings to a file
 	/*!
 	\param const char* filepath : the file to write to
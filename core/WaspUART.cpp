@@ -554,6 +554,173 @@ uint8_t  WaspUART::waitFor( char* ans1,
 
 
 
+/*
+ * 
+ * name: uartPut
+ * stdio put function writing to the uart stored as user data of the stream
+ * 
+ */
+static int uartPut(char c, FILE* stream)
+{
+	uint8_t uart = (uint8_t)(uintptr_t)fdev_get_udata(stream);
+	
+	printByte(c, uart);
+	#if DEBUG_UART > 0
+		USB.print(c);
+	#endif
+	return 0;
+}
+
+
+/*
+ * 
+ * name: printCommand_P
+ * @param	const char* format: PROGMEM format string
+ * @param	...: arguments as specified in format
+ * @return 	void
+ * 
+ */
+void WaspUART::printCommand_P(const char* format, ...)
+{
+	FILE stream;
+	va_list args;
+	
+	fdev_setup_stream(&stream, uartPut, NULL, _FDEV_SETUP_WRITE);
+	fdev_set_udata(&stream, (void*)(uintptr_t)_uart);
+	
+	// clear uart buffer before sending command
+	if (_flush_mode == true)
+	{
+		serialFlush(_uart); 		
+	}
+	
+	#if DEBUG_UART > 0
+		PRINT_UART(F("cmd:"));
+	#endif
+	
+	va_start(args, format);
+	vfprintf_P(&stream, format, args);
+	va_end(args);
+	
+	#if DEBUG_UART > 0
+		USB.println();
+	#endif
+	
+	delay( _def_delay );
+}
+
+
+/*
+ * 
+ * name: sendCommand_P
+ * @param	const char* command: PROGMEM command to be sent
+ * @param	const char* ans1..ans4: PROGMEM expected answers
+ * @param	uint32_t timeout: time to wait for response
+ * @return 	'0' if timeout error, 'n' if ans'n'
+ * 
+ */
+uint8_t WaspUART::sendCommand_P(const char* command, 
+								const char* ans1, 
+								const char* ans2, 
+								const char* ans3, 
+								const char* ans4, 
+								uint32_t timeout)
+{
+	printCommand_P(command);
+	return waitFor_P(ans1, ans2, ans3, ans4, timeout);
+}
+
+
+/*
+ * 
+ * name: endsWith_P
+ * @return 	true if the last bytes of 'buffer' are the PROGMEM 'pattern'
+ * 
+ */
+static bool endsWith_P(uint8_t* buffer, uint16_t length, const char* pattern)
+{
+	size_t size = strlen_P(pattern);
+	
+	return (length >= size) && 
+			(memcmp_P(&buffer[length - size], pattern, size) == 0);
+}
+
+
+uint8_t WaspUART::waitFor_P(const char* ans1, uint32_t timeout)
+{
+	return waitFor_P(ans1, NULL, NULL, NULL, timeout);
+}
+
+uint8_t WaspUART::waitFor_P(const char* ans1, const char* ans2, uint32_t timeout)
+{
+	return waitFor_P(ans1, ans2, NULL, NULL, timeout);
+}
+
+uint8_t WaspUART::waitFor_P(const char* ans1, 
+							const char* ans2, 
+							const char* ans3, 
+							uint32_t timeout)
+{
+	return waitFor_P(ans1, ans2, ans3, NULL, timeout);
+}
+
+
+/*
+ * 
+ * name: waitFor_P
+ * @brief	This function waits for one of the PROGMEM answers during a 
+ * 			certain period of time. The result is stored in '_buffer'.
+ * @return 	'0' if timeout error, 
+ * 			'n' if ans'n' is found
+ */
+uint8_t WaspUART::waitFor_P(const char* ans1, 
+							const char* ans2, 
+							const char* ans3, 
+							const char* ans4, 
+							uint32_t timeout)
+{
+	const char* answers[4] = {ans1, ans2, ans3, ans4};
+	
+	// clear _buffer
+	memset( _buffer, 0x00, _bufferSize );
+	_length = 0;
+	
+	// get actual instant
+	uint32_t previous = millis();
+	
+	// check available data for 'timeout' milliseconds
+	while( (millis() - previous) < timeout )
+	{
+		if( !serialAvailable(_uart) || (_length >= (_bufferSize-1)) )
+		{
+			// Condition to avoid an overflow (DO NOT REMOVE)
+			if( millis() < previous) previous = millis();
+			continue;
+		}
+		
+		_buffer[_length++] = serialRead(_uart);
+		
+		// a new match can only end at the byte just received
+		for (uint8_t n = 0; n < 4; n++)
+		{
+			if( (answers[n] != NULL) && endsWith_P(_buffer, _length, answers[n]) )
+			{
+				#if DEBUG_UART > 0
+					PRINT_UART(F("found:"));
+					USB.println( (const __FlashStringHelper*)answers[n] );	
+				#endif
+				return n + 1;
+			}
+		}
+	}
+	
+	// timeout
+	return 0; 
+}
+
+
+
+
 /*
  * 
  * name: readBuffer
@@ -208,6 +208,31 @@ public:
 	//! It sends a command without waiting answer (only send)
 	void sendCommand(uint8_t* command, uint16_t length);
 
+	//! It sends a command built from a format string stored in Flash
+	/*!
+	The command is formatted with vfprintf_P() straight into the uart, so
+	no RAM buffer is needed to hold it. Use waitFor_P() to get the answer.
+	\param const char* format : PROGMEM format string, i.e. from a table
+	\param ... : additional arguments as specified in format
+	\return void
+	 */
+	void printCommand_P(const char* format, ...);
+
+	//! It sends a command from Flash expecting specific answers from Flash
+	/*!
+	\param const char* command : PROGMEM string to send to the module
+	\param const char* ans1..ans4 : PROGMEM strings expected to be
+			answered by the module, NULL if not used
+	\param uint32_t timeout : time to wait for responses
+	\return '0' if timeout error, 'n' if ans'n'
+	 */
+	uint8_t sendCommand_P(	const char* command,
+							const char* ans1,
+							const char* ans2,
+							const char* ans3,
+							const char* ans4,
+							uint32_t timeout);
+
 	/*!
 	\brief	This function waits for one of the answers during a certain period 
 			of time. The result is stored in '_buffer'.
@@ -231,6 +256,16 @@ public:
 	uint8_t waitFor( char* ans1, char* ans2, char* ans3, uint32_t timeout);
 	uint8_t waitFor( char* ans1, char* ans2, char* ans3, char* ans4);
 	uint8_t waitFor( char* ans1, char* ans2, char* ans3, char* ans4, uint32_t timeout);
+
+	//! Same as waitFor() with the expected answers stored in Flash
+	/*!
+	Only the bytes ending at the last character received are compared, as
+	any earlier match would have been found when that character arrived.
+	 */
+	uint8_t waitFor_P(const char* ans1, uint32_t timeout);
+	uint8_t waitFor_P(const char* ans1, const char* ans2, uint32_t timeout);
+	uint8_t waitFor_P(const char* ans1, const char* ans2, const char* ans3, uint32_t timeout);
+	uint8_t waitFor_P(const char* ans1, const char* ans2, const char* ans3, const char* ans4, uint32_t timeout);
 	
 	//! Read the contents of the rx buffer
 	uint16_t readBuffer(uint16_t requestBytes);
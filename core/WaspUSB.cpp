@@ -610,6 +610,9 @@ void WaspUSB::printHexln(uint8_t* pointer, uint16_t length)
  */
 void WaspUSB::secureBegin()
 {
+	// the queued bytes must leave with the current frame format
+	serialDrain(_uart);
+	
 	// store previous baudrate
 	_reg_ubrr0h = UBRR0H;	// USART0 Baud Rate Register High Byte
 	_reg_ubrr0l = UBRR0L;	// USART0 Baud Rate Register Low Byte
@@ -639,15 +642,16 @@ void WaspUSB::secureBegin()
  */
 void WaspUSB::secureEnd()
 {	
+	// the queued bytes must leave before switching the mux
+	serialDrain(_uart);
+	
 	// switch back the mux to SOCKET0 if needed
 	if (WaspRegister & REG_SOCKET0)
 	{
-		delay(3);
 		Utils.setMuxSocket0();
 	}
 	else
 	{
-		delay(3);
 		if (_boot_version >= 'G')
 		{
 			Utils.muxOFF0();
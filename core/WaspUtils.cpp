@@ -1328,6 +1328,35 @@ void WaspUtils::float2String (float fl, char str[], int N)
 
 
 
+/*
+ * crc32() - It updates a CRC-32 with a block of data
+ * 
+ * Reflected polynomial 0xEDB88320, processed a nibble at a time so the table
+ * only takes 64 bytes of Flash
+ * 
+ */
+static const uint32_t crc32_table[16] PROGMEM =
+{
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+	0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+	0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t WaspUtils::crc32(uint32_t crc, const uint8_t* data, uint16_t length)
+{
+	crc = ~crc;
+	while (length--)
+	{
+		crc ^= *data++;
+		crc = (crc >> 4) ^ pgm_read_dword(&crc32_table[crc & 0x0F]);
+		crc = (crc >> 4) ^ pgm_read_dword(&crc32_table[crc & 0x0F]);
+	}
+	return ~crc;
+}
+
+
+
 /*
  * loadOTA() - It writes into the EEPROM the name of the OTA file
  * 
@@ -1376,6 +1405,215 @@ void WaspUtils::loadOTA(const char* filename, uint8_t version)
 	delay(2000);
 }
 
+/*
+ * flashCrc32() - It gets the CRC-32 of the first 'length' bytes of the Flash
+ * 
+ */
+static uint32_t flashCrc32(uint32_t length)
+{
+	uint8_t data[64];
+	uint32_t address = 0;
+	uint32_t crc = 0;
+	uint8_t n;
+	
+	while (length > 0)
+	{
+		n = (length < sizeof(data)) ? length : sizeof(data);
+		for (uint8_t i = 0; i < n; i++)
+		{
+			data[i] = pgm_read_byte_far(address++);
+		}
+		crc = Utils.crc32(crc, data, n);
+		length -= n;
+	}
+	return crc;
+}
+
+/*
+ * applyOTAPatch() - It rebuilds a firmware image from a delta OTA patch
+ * 
+ * The patch, made by DeltaOTA.py, is an otaPatchHeader_t followed by
+ * commands which copy ranges of the running image, read from the Flash, or
+ * add new bytes. The image is written into a contiguous file named after the
+ * PID of the header, after the first sector of the OTA format, and checked
+ * against the CRC-32 of the header
+ * 
+ */
+uint8_t WaspUtils::applyOTAPatch(const char* patchfile, char* image)
+{
+	otaPatchHeader_t header;
+	SdFile patch;
+	SdFile file;
+	uint8_t data[64];
+	uint8_t command;
+	uint32_t offset = 0;
+	uint16_t length;
+	uint16_t n;
+	uint32_t written = 0;
+	uint32_t crc = 0;
+	uint8_t error = 0;
+	
+	image[0] = '\0';
+	
+	SD.ON();
+	SD.goRoot();
+	
+	if (!SD.openFile(patchfile, &patch, O_READ))
+	{
+		return 2;
+	}
+	
+	// a complete image does not start with the patch header
+	if ((patch.read(&header, sizeof(header)) != (int)sizeof(header))
+		|| (memcmp(header.magic, "WDLT", 4) != 0))
+	{
+		patch.close();
+		return 1;
+	}
+	
+	if (header.version != OTA_PATCH_VERSION)
+	{
+		patch.close();
+		return 5;
+	}
+	
+	// the patch only applies to the image it was made against
+	if ((header.baseSize > (uint32_t)FLASHEND + 1)
+		|| (flashCrc32(header.baseSize) != header.baseCrc))
+	{
+		patch.close();
+		return 3;
+	}
+	
+	memcpy(image, header.name, 7);
+	image[7] = '\0';
+	
+	// the image would replace the patch before it is read
+	if (strcmp(patchfile, image) == 0)
+	{
+		patch.close();
+		image[0] = '\0';
+		return 7;
+	}
+	
+	if (SD.isFile(image) == 1)
+	{
+		SD.del(image);
+	}
+	
+	if (!SD.createContiguous(image, OTA_FILE_SECTOR + header.newSize)
+		|| !SD.openFile(image, &file, O_RDWR))
+	{
+		patch.close();
+		return 4;
+	}
+	
+	// first sector: START_SECTOR (32B) + PID (7B) + asterisks
+	strcpy_P((char*)data, PSTR("FIRMWARE_FILE_FOR_WASPMOTE######"));
+	memcpy(&data[32], image, 7);
+	memset(&data[39], '*', sizeof(data) - 39);
+	if (file.write(data, sizeof(data)) != (int)sizeof(data))
+	{
+		error = 5;
+	}
+	memset(data, '*', sizeof(data));
+	for (n = sizeof(data); (n < OTA_FILE_SECTOR) && (error == 0); n += sizeof(data))
+	{
+		if (file.write(data, sizeof(data)) != (int)sizeof(data))
+		{
+			error = 5;
+		}
+	}
+	
+	while (error == 0)
+	{
+		if (patch.read(&command, 1) != 1)
+		{
+			error = 5;
+			break;
+		}
+		
+		if (command == OTA_PATCH_END)
+		{
+			break;
+		}
+		else if (command == OTA_PATCH_COPY)
+		{
+			if ((patch.read(&offset, 4) != 4)
+				|| (patch.read(&length, 2) != 2)
+				|| (offset + length > header.baseSize))
+			{
+				error = 5;
+				break;
+			}
+		}
+		else if (command == OTA_PATCH_DATA)
+		{
+			if (patch.read(&length, 2) != 2)
+			{
+				error = 5;
+				break;
+			}
+		}
+		else
+		{
+			error = 5;
+			break;
+		}
+		
+		if (written + length > header.newSize)
+		{
+			error = 5;
+			break;
+		}
+		
+		while (length > 0)
+		{
+			n = (length < sizeof(data)) ? length : sizeof(data);
+			
+			if (command == OTA_PATCH_COPY)
+			{
+				for (uint16_t i = 0; i < n; i++)
+				{
+					data[i] = pgm_read_byte_far(offset++);
+				}
+			}
+			else if (patch.read(data, n) != (int)n)
+			{
+				error = 5;
+				break;
+			}
+			
+			if (file.write(data, n) != (int)n)
+			{
+				error = 5;
+				break;
+			}
+			crc = crc32(crc, data, n);
+			written += n;
+			length -= n;
+		}
+	}
+	
+	patch.close();
+	file.close();
+	
+	if ((error == 0) && (written != header.newSize))
+	{
+		error = 5;
+	}
+	else if ((error == 0) && (crc != header.newCrc))
+	{
+		error = 6;
+	}
+	
+	if (error != 0)
+	{
+		SD.del(image);
+	}
+	return error;
+}
+
 /*
  * readEEPROM() - It reads the EEPROM from position 2 to 34 and shows it by USB
  * 
@@ -67,6 +67,9 @@
 /*! \def EEPROM_SERIALID_START
     \brief Starting address for the backup of Serial ID of Waspmote (4B)
  */
+/*! \def EEPROM_4G_SESSION
+    \brief EEPROM address of the 4G module PSM session flag (Wasp4G::resume())
+ */
 /*! \def EEPROM_START
     \brief First EEPROM's writable address. There is a 1kB reserved area from 
     address 0 to address 1023.
@@ -80,9 +83,53 @@
 #define EEPROM_PROG_VERSION_BACKUP 	226
 #define EEPROM_SERIALID_START 		227
 //#define GMX_POWERING_MODE_ADDR  236	// only For PCS conf
+#define EEPROM_4G_SESSION			240
 #define EEPROM_START 				1024
 
 
+/*! \def OTA_PATCH_VERSION
+    \brief Version of the delta OTA patch format (see DeltaOTA.py)
+ */
+/*! \def OTA_PATCH_END
+    \brief Patch command: end of the patch
+ */
+/*! \def OTA_PATCH_COPY
+    \brief Patch command: copy <length> bytes of the running image from
+    <offset>. Followed by offset (uint32_t) and length (uint16_t)
+ */
+/*! \def OTA_PATCH_DATA
+    \brief Patch command: <length> new bytes. Followed by length (uint16_t)
+    and the bytes
+ */
+#define OTA_PATCH_VERSION			1
+#define OTA_PATCH_END				0x00
+#define OTA_PATCH_COPY				0x01
+#define OTA_PATCH_DATA				0x02
+
+/*! \def OTA_FILE_SECTOR
+    \brief First sector of an OTA file: start string (32 bytes), PID padded
+    with '*' (32 bytes) and '*' up to 512 bytes. The binary follows
+ */
+#define OTA_FILE_SECTOR				512
+
+/*! \struct otaPatchHeader_t
+    \brief Header of a delta OTA patch, little endian as the AVR. The new
+    image is rebuilt from the 'baseSize' first bytes of the Flash, which must
+    have the CRC-32 'baseCrc'
+ */
+struct otaPatchHeader_t
+{
+	char magic[4];			// "WDLT"
+	uint8_t version;		// OTA_PATCH_VERSION
+	uint8_t reserved[3];
+	char name[8];			// program ID (PID) of the new image
+	uint32_t baseSize;
+	uint32_t baseCrc;
+	uint32_t newSize;
+	uint32_t newCrc;
+};
+
+
 
 
 
@@ -533,6 +580,34 @@ class WaspUtils
   */
   void loadOTA(const char* filename, uint8_t version);
   
+  //! It updates a CRC-32 (IEEE 802.3, the one of zlib and of the 'crc32'
+  //! command) with a block of data
+  /*!
+  \param uint32_t crc : CRC of the previous blocks, '0' for the first one
+  \param const uint8_t* data : block of data
+  \param uint16_t length : length of the block
+  \return the CRC including 'data'
+  */
+  uint32_t crc32(uint32_t crc, const uint8_t* data, uint16_t length);
+  
+  //! It rebuilds a firmware image on the SD card from the running one and a
+  //! delta OTA patch, the name of the image being the PID in the patch
+  /*! The image file has the OTA format loaded by the bootloader: a first
+  sector with the start string and the PID, then the binary
+  
+  \param const char* patchfile : patch file in the SD card
+  \param char* image : the image name (7 characters and '\0') is copied here
+  \return '0' if the image is rebuilt, then call loadOTA(image, version)
+		   '1' if 'patchfile' is not a patch, but a complete image
+		   '2' if error reading the patch
+		   '3' if the running image is not the base of the patch
+		   '4' if error creating the image in the SD card
+		   '5' if the patch is malformed or error writing the image
+		   '6' if the CRC of the image does not match (it is deleted)
+		   '7' if the patch file is named after the PID of the new image
+  */
+  uint8_t applyOTAPatch(const char* patchfile, char* image);
+  
   //! It reads the EEPROM from position 2 to 34 and shows it by USB
   /*!
   \return void
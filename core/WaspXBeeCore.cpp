@@ -2401,36 +2401,19 @@ uint8_t WaspXBeeCore::wake()
 
 
 /*
- * Function: Send a packet from one XBee to another XBee in API mode
+ * Function: Gets the maximum payload of a frame
  *
  * Parameters:
- * 	'packet' : A struct of packetXBee type
- *
- * Returns: Integer that determines if there has been any error
- *	error=2 --> The command has not been executed
- *	error=1 --> There has been an error while executing the command
- *	error=0 --> The command has been executed with no errors
- *
- * --> DIGI's XBee Packet inner structure:
- *
- * StartDelimiter(1B) + Length(2B) +  Frame Data(variable) + Checksum(1B)
- *  ______________     ___________     __________________     __________
- * |              |   |     |     |   |                  |   |          |
- * |     0x7E     | + | MSB | LSB | + |    Frame Data    | + |  1 Byte  |
- * |______________|   |_____|_____|   |__________________|   |__________|
+ * 	'mode' : UNICAST or BROADCAST
+ * 	'address_type' : _16B or _64B (only XBee-802.15.4)
  *
+ * Returns: the maximum number of data bytes in a frame, which depends on the
+ * protocol, encryption mode, sending mode and addressing mode
  */
-uint8_t WaspXBeeCore::sendXBee(struct packetXBee* packet)
+uint16_t WaspXBeeCore::getMaxPayload(uint8_t mode, uint8_t address_type)
 {
-    Utils.setMuxSocket0();
     uint16_t maxPayload=0;
-    int8_t error=2;
-
-	// set general counter to zero
-    it=0;
 
-	// set maximum payload depending on the
-	// protocol, encryption mode, addressing mode
 	switch (protocol)
 	{
 		case XBEE_802_15_4:
@@ -2440,13 +2423,13 @@ uint8_t WaspXBeeCore::sendXBee(struct packetXBee* packet)
 						}
 						else
 						{
-							if(packet->mode==BROADCAST)
+							if(mode==BROADCAST)
 							{
 								maxPayload=95;
 							}
 							else
 							{
-								if(packet->address_type==_16B)
+								if(address_type==_16B)
 								{
 									maxPayload=98;
 								}
@@ -2460,7 +2443,7 @@ uint8_t WaspXBeeCore::sendXBee(struct packetXBee* packet)
 
 		case ZIGBEE:	if(encryptMode==0)
 						{
-							if(packet->mode==BROADCAST)
+							if(mode==BROADCAST)
 							{
 								maxPayload=92;
 							}
@@ -2471,7 +2454,7 @@ uint8_t WaspXBeeCore::sendXBee(struct packetXBee* packet)
 						}
 						else
 						{
-							if(packet->mode==BROADCAST)
+							if(mode==BROADCAST)
 							{
 								if(apsEncryption) maxPayload=70;
 								else maxPayload=74;
@@ -2504,6 +2487,43 @@ uint8_t WaspXBeeCore::sendXBee(struct packetXBee* packet)
 
 	}
 
+	return maxPayload;
+}
+
+
+/*
+ * Function: Send a packet from one XBee to another XBee in API mode
+ *
+ * Parameters:
+ * 	'packet' : A struct of packetXBee type
+ *
+ * Returns: Integer that determines if there has been any error
+ *	error=2 --> The command has not been executed
+ *	error=1 --> There has been an error while executing the command
+ *	error=0 --> The command has been executed with no errors
+ *
+ * --> DIGI's XBee Packet inner structure:
+ *
+ * StartDelimiter(1B) + Length(2B) +  Frame Data(variable) + Checksum(1B)
+ *  ______________     ___________     __________________     __________
+ * |              |   |     |     |   |                  |   |          |
+ * |     0x7E     | + | MSB | LSB | + |    Frame Data    | + |  1 Byte  |
+ * |______________|   |_____|_____|   |__________________|   |__________|
+ *
+ */
+uint8_t WaspXBeeCore::sendXBee(struct packetXBee* packet)
+{
+    Utils.setMuxSocket0();
+    uint16_t maxPayload=0;
+    int8_t error=2;
+
+	// set general counter to zero
+    it=0;
+
+	// set maximum payload depending on the
+	// protocol, encryption mode, addressing mode
+	maxPayload=getMaxPayload(packet->mode, packet->address_type);
+
     // Check if fragmentation is necessary due to packet length
     // is greater than maximum payload
     if(packet->data_length > maxPayload)
@@ -3732,17 +3752,16 @@ uint8_t WaspXBeeCore::gen_checksum(const char* data)
 uint8_t WaspXBeeCore::gen_send(const char* data)
 {
     int8_t error_int=2;
-    uint8_t TX[100];
-	int length=0;
+	uint16_t length=0;
 
-	// generate frame with possible escaped characters
-	gen_escaped_frame(TX, command, &length);
+	// get 'Frame Data' length in 'Length' field
+	length=command[1]*256+command[2];
 
 	#if DEBUG_XBEE > 1
 	PRINT_XBEE(F("TX:"));
-	for(int i = 0; i < length; i++)
+	for(uint16_t i = 0; i < length+4; i++)
 	{
-		USB.printHex(TX[i]);
+		USB.printHex(command[i]);
 	}
 	USB.println();
 	#endif
@@ -3755,10 +3774,10 @@ uint8_t WaspXBeeCore::gen_send(const char* data)
 		Utils.setMuxSocket1();
 	}
 
-	for (int i = 0; i < length; i++)
-	{
-		printByte(TX[i], uart);
-	}
+	// escape and send the frame as it is read from 'command'
+	frameBegin(length);
+	frameWrite(&command[3], length);
+	frameEnd();
 
     error_int = parse_message(command);
 
@@ -3872,26 +3891,22 @@ void WaspXBeeCore::gen_frame_ap2(	struct packetXBee* _packet,
 int8_t WaspXBeeCore::parse_message(uint8_t* frame)
 {
     uint8_t memory[MAX_PARSE];
+    xbeeDecoder_t decoder;
     uint16_t i=0;
-    uint8_t num_mes=0;
-    uint8_t num_esc=0;
-    uint16_t num_data=0;
-    uint16_t length_mes=0;
-    uint16_t length_prev=0;
+    uint16_t end=0;
     int8_t error=2;
     unsigned long interval=50;
     unsigned long intervalMAX=40000;
     uint8_t good_frame=0;
     uint8_t maxFrame=30;
 
-	// If a frame was truncated before, we set the first byte as 0x7E
-	// and we add a new packet to 'num_mes' counter
+    decoderInit(&decoder);
+
+	// If a frame was truncated before, its start delimiter was already read
     if( frameNext )
     {
         frameNext=0;
-        memory[0]=0x7E;
-        i=1;
-        num_mes=1;
+        decodeFrameByte(&decoder, memory, MAX_PARSE, XBEE_START_DELIMITER);
     }
 
     // If a RX we reduce the interval
@@ -3950,29 +3965,22 @@ int8_t WaspXBeeCore::parse_message(uint8_t* frame)
     // 'timeout2' limits the maximum time to read all incoming data
     // 'MAX_PARSE' determines the maximum number of bytes to be received
     ////////////////////////////////////////////////////////////////////////////
-    while( !timeout1 && !timeout2 	&&	i < MAX_PARSE	&& 	!frameNext 	)
+    while( !timeout1 && !timeout2 	&&	decoder.length < MAX_PARSE	&& 	!frameNext 	)
     {
 		// check if there are available data
 		if(serialAvailable(uart))
 		{
-			// read Byte from correspondent UART
-			memory[i]=serialRead(uart);
-			i++;
-
-			// check if a new frame Start Delimiter is read
-			if(memory[i-1]==0x7E)
+			// read Byte from correspondent UART, un-escaping it
+			if( decodeFrameByte(&decoder, memory, MAX_PARSE, serialRead(uart)) == XBEE_DECODE_START )
 			{
 				// if there is no memory available for a whole new packet then
 				// we escape and select frameNext=1 in order to get it the
 				// next time we read from XBee
-				if( (MAX_PARSE-i) < maxFrame )
+				if( (MAX_PARSE-decoder.length) < maxFrame )
 				{
 					frameNext=1;
-				}
-				else
-				{
-					// increment the number of received messages
-					num_mes++;
+					decoder.length=decoder.start;
+					decoder.inFrame=0;
 				}
 			}
 			previous=millis();
@@ -4000,72 +4008,28 @@ int8_t WaspXBeeCore::parse_message(uint8_t* frame)
 		}
     }
 
-	// Store number of received bytes in "num_data"
-    num_data=i;
-    i=1;
-
 	#if DEBUG_XBEE > 1
 	PRINT_XBEE(F("RX:"));
-    for(uint16_t i = 0; i < num_data ; i++)
+    for(uint16_t i = 0; i < decoder.length ; i++)
 	{
 		USB.printHex(memory[i]);
 	}
 	USB.println();
 	#endif
 
-	// If some corrupted frame has appeared we jump it
-    if( memory[0]!=0x7E )
-    {
-		// jump until a new frame start delimiter is found
-		while( memory[i] != 0x7E &&  i < num_data )
-        {
-			i++;
-		}
-	}
-	else
-	{
-		// reset index to starting byte
-		i=0;
-	}
-
-	// initialize the starting pointer of a valid frame (0x7E)
-	length_prev = i;
-
-	// increment index to the byte that follows up the start delimiter
-	i++;
-
 	// if no frame has been received properly then return error
-	if( i > num_data)
+	if( decoder.frames == 0 )
 	{
 		return 1;
 	}
 
 	////////////////////////////////////////////////////////////////////////////
-	// Parse the received messages from the XBee module
-	// while there are stored messages to be parsed
+	// Parse the received messages from the XBee module: they are stored
+	// un-escaped one after the other, so each length field gives the next
 	////////////////////////////////////////////////////////////////////////////
-    while( num_mes>0 )
+    while( decoder.frames>0 )
     {
-		// get length of the packet until another start delimiter
-		// is found or the end of read bytes is reached
-        while( memory[i]!=0x7E && i<num_data )
-		{
-			i++;
-		}
-        length_mes=i-length_prev;
-
-		// If any byte has been escaped, it must be converted before parsing it
-		// So first count number of escaped bytes and then make conversion
-        for( it=0; it < length_mes ; it++ )
-        {
-            if( memory[it+length_prev]==0x7D ) num_esc++;
-        }
-
-        // if there are escaped bytes, make conversion
-        if( num_esc )
-        {
-			des_esc(memory,length_mes,i-length_mes);
-		}
+		end = i + 4 + ((uint16_t)memory[i+1] << 8) + memory[i+2];
 
 		/**********************************************************************
 		 *  Call parsing function depending on the Frame Type
@@ -4075,36 +4039,39 @@ int8_t WaspXBeeCore::parse_message(uint8_t* frame)
 		 * |______|_____|_____|____________|_______________|
 		 * 	  0	     1     2        3          variable
 		 **********************************************************************/
-        switch( memory[(i-length_mes)+3] )
+        switch( memory[i+3] )
         {
             case 0x88 :	// AT Command Response
-						error=atCommandResponse(memory,frame,length_mes-num_esc+length_prev,i-length_mes);
+						error=atCommandResponse(memory,frame,end,i);
 						error_AT=error;
 						break;
 
             case 0x8A :	// Modem Status
-						error=modemStatusResponse(memory,length_mes-num_esc+length_prev,i-length_mes);
+						error=modemStatusResponse(memory,end,i);
 						break;
 
             case 0x80 :	// XBee802 - RX (Receive) Packet: 64-bit Address
             case 0x81 :	// XBee802 - RX (Receive) Packet: 16-bit Address
             case 0x90 :	// XBee Receive Packet (AO=0)
             case 0x91 :	// XBee Explicit Rx Indicator (AO=1)
-						error = rxData(	memory,	length_mes-num_esc+length_prev,	i-length_mes);
+						error = rxData(	memory,	end, i);
 						error_RX = error;
 						break;
 
+            case 0x89 :	// XBee802 - TX (Transmit) Status
+            case 0x8B :	// Transmit Status
+						// of a frame sent by the queue, if any
+						queueStatus(memory, i);
+						break;
+
             default   :	break;
         }
 
 		// decrement number of pending packets to be treated
-        num_mes--;
+        decoder.frames--;
 
-        // update previous index in input buffer in order to carry on with the
-        // following message stored in 'memory'
-        length_prev=i;
-        i++;
-        num_esc=0;
+        // carry on with the following message stored in 'memory'
+        i=end;
 
         // if the message has been parsed successfully,
         // then increment the good_frame counter
@@ -4287,211 +4254,132 @@ uint8_t WaspXBeeCore::txStatusResponse()
 {
 	// create reception buffer
 	uint8_t ByteIN[MAX_PARSE];
+	xbeeDecoder_t decoder;
     unsigned long previous=millis();
-
-     // set number of bytes that TX Status frame (0x89) has
-    uint16_t numberBytes=7;
+    uint16_t start=0;
+    uint16_t frame_end=0;
     uint8_t end=0;
-    uint16_t counter3=0;
-    uint8_t undesired=0;
-    uint8_t status=0;
-    uint16_t num_TX=0;
-    uint8_t num_esc=0;
     uint16_t interval=5000;
-    uint8_t num_mes=0;
-    uint16_t i=1;
-    uint16_t length_mes=0;
-    uint16_t length_prev=0;
+    uint16_t i=0;
     uint8_t maxFrame=110;
 
     error_TX=2;
 
-	// If a frame was truncated before, we set the first byte as 0x7E
-	// and we add a new packet to 'num_mes' counter
+    decoderInit(&decoder);
+
+	// If a frame was truncated before, its start delimiter was already read
     if( frameNext )
     {
-        ByteIN[0]=0x7E;
-        counter3=1;
-        num_mes=1;
         frameNext=0;
+        decodeFrameByte(&decoder, ByteIN, MAX_PARSE, XBEE_START_DELIMITER);
     }
 
-	// Read data from XBee while data is available
+	// Read data from XBee while the following conditions are true:
+	// - TX status is not received
+	// - The maximum number of bytes are not received
+	// - There is enough memory to store a whole new packet when a start
+	//	 delimeter (0x7E) is received
+	// - Timeout is not exceeded
     while( end==0 && !frameNext )
     {
 		// check available data
-		if(serialAvailable(uart)>0)
-        {
-			// read byte from correspondent uart
-           	ByteIN[counter3]=serialRead(uart);
-           	counter3++;
-           	previous=millis();
-
-           	// check if a new frame is received
-           	if(ByteIN[counter3-1]==0x7E)
+		if( serialAvailable(uart)>0 )
+       	{
+			// read byte from correspondent uart, un-escaping it. The frames
+			// received before the TX status (modem status, RX packets) are
+			// kept and parsed below
+			start=decoder.start;
+			switch( decodeFrameByte(&decoder, ByteIN, MAX_PARSE, serialRead(uart)) )
 			{
-				// if there is no memory available for a whole new packet
-				// then we escape and select frameNext=1 in order to get it
-				// the next time we read from XBee
-           		if( (MAX_PARSE-counter3) < maxFrame )
-           		{
-					frameNext=1;
-				}
-                else num_mes++;
-            }
-
-            // If some corrupted frame has appeared, it is discarded,
-            // counter3 is set to zero again
-            if( (counter3==1) && (ByteIN[counter3-1]!=0x7E) )
-            {
-				counter3=0;
-			}
-
-			// if counter3 reaches the maximum data to parse, then finish
-            if( counter3>=MAX_PARSE )
-            {
-				end=1;
-			}
-
-			// Discard any non-TX status frame which are determined by a frame
-			// type which may be 0x89(TX Status) or 0x8A(Modem Status)
-            if( (counter3 == (4 + (uint16_t)status*6 + undesired))
-				&& (undesired != 1)  )
-            {
-                if( (ByteIN[counter3-1]!= 0x89) && (ByteIN[counter3-1]!=0x8A) )
-				{
-					// increment undesired counter
-	                undesired=1;
+				case XBEE_DECODE_START:
+						// if there is no memory available for a whole new
+						// packet then we escape and select frameNext=1 in
+						// order to get it the next time we read from XBee
+						if( (MAX_PARSE-decoder.length) < maxFrame )
+						{
+							frameNext=1;
+							decoder.length=decoder.start;
+							decoder.inFrame=0;
+						}
+						break;
 
-	                // sum 3 new bytes corresponding to
-	                // start delimiter (1Byte) + length (2Bytes)
-                    numberBytes+=3;
-               	}
-            }
+				case XBEE_DECODE_FRAME:
+						// the TX status has been found. The TX status of a
+						// frame sent by the queue is recorded and dropped
+						if( ByteIN[start+3] == 0x89 )
+						{
+							if( queueStatus(ByteIN, start) )
+							{
+								decoder.length=start;
+								decoder.start=start;
+								decoder.frames--;
+							}
+							else
+							{
+								end=1;
+							}
+						}
+						break;
 
-            // if undesired counter is active, increment 'numberBytes'
-            if( undesired == 1 )
-            {
-				numberBytes++;
+				default:
+						break;
 			}
+            previous=millis();
 
-            // If a escape character (0x7D) is found increment 'numberBytes'
-	        if( (ByteIN[counter3-1]==0x7D) && (!undesired) )
-        	{
-        	    numberBytes++;
-        	}
-
-        	/* If a modem status frame (0x8A)
-             *  ____________________________________________________
-             * |      |     |     |            |         |          |
-             * | 0x7E | MSB | LSB | Frame Type | cmdData | checksum |
-             * |______|_____|_____|____________|_________|__________|
-             *    0      1     2        3           4         5
-             */
-        	if( (ByteIN[counter3-1] == 0x8A) && (counter3 == (4+(uint16_t)status*6)) )
-        	{
-				// increment in 6Bytes 'numberBytes'
-        	    numberBytes+=6;
-
-        	    // increment 'status' in order to add a new 'modem status frame'
-        	    status++;
-        	}
-
-        	// If a new frame is read after reading any undesired frame,
-        	// decrement 'numberBytes' and set undesired
-        	if( (ByteIN[counter3-1] == 0x7E) && (undesired == 1) )
-        	{
-        	   	numberBytes--;
-        	    undesired=numberBytes-7;
-        	}
-
-        	// if 'counter3' is the same as 'numberBytes' we finish
-        	// This means that TX status has been found
-        	if(counter3 == numberBytes)
-        	{
+			// if the buffer is full, then finish
+           	if( decoder.length>=MAX_PARSE )
+           	{
 				end=1;
-        	}
-        }
+			}
+       	}
 
-        // avoid millis overflow problem
-        if( millis() < previous ) previous=millis();
+       	// avoid millis overflow problem
+		if( millis() < previous ) previous=millis();
 
-        // check if time is out
+		// check if time is out
         if( (millis()-previous) > interval )
-        {
-            end=1;
-            serialFlush(uart);
+       	{
+        	end=1;
+        	serialFlush(uart);
         }
     }
 
-    // Store number of read bytes
-    num_TX=counter3;
-    counter3=0;
-
-	#if DEBUG_XBEE > 0
+    #if DEBUG_XBEE > 0
 	PRINT_XBEE(F("RX:"));
-    for(uint16_t i = 0; i < num_TX ; i++)
+    for(uint16_t i = 0; i < decoder.length ; i++)
 	{
 		USB.printHex(ByteIN[i]);
 	}
 	USB.println();
 	#endif
 
-    // If some corrupted frame has appeared we jump it
-    if( ByteIN[0]!=0x7E )
-    {
-		// jump until a new frame start delimiter is found
-		while( ByteIN[i]!=0x7E && i<num_TX )
-        {
-			i++;
-		}
-	}
-
-    // Parse the received messages from the XBee
-    while( num_mes>0 )
+    // Parse the received messages from the XBee: they are stored un-escaped
+    // one after the other, so each length field gives the next
+    while( decoder.frames>0 )
     {
-		// get length of the packet until another start delimiter
-		// is found or the end of read bytes is reached
-        while( ByteIN[i]!=0x7E && i<num_TX )
-		{
-			i++;
-		}
-        length_mes=i-length_prev;
-
-		// If any byte has been escaped, it must be converted before parsing it
-		// So first count number of escaped bytes and then make conversion
-		for( it=0; it < length_mes ; it++)
-        {
-            if( ByteIN[it+length_prev]==0x7D ) num_esc++;
-        }
-
-        // if there are escaped bytes, make conversion
-        if( num_esc )
-        {
-			des_esc(ByteIN,length_mes,i-length_mes);
-		}
+		frame_end = i + 4 + ((uint16_t)ByteIN[i+1] << 8) + ByteIN[i+2];
 
 		/* Call parsing function depending on the Frame Type
 		 *  _______________________________________________
-		 * |      |     |     |    		   |			   |
+		 * |      |     |     |            |               |
 		 * | 0x7E | MSB | LSB | Frame Type |    ......     |
 		 * |______|_____|_____|____________|_______________|
-		 * 	  0	     1     2        3          variable
+		 *    0      1     2        3          variable
 		 */
-        switch( ByteIN[(i-length_mes)+3] )
+        switch( ByteIN[i+3] )
         {
             case 0x8A :	//Modem Status
-						modemStatusResponse(ByteIN,length_mes-num_esc+length_prev,i-length_mes);
+						modemStatusResponse(ByteIN, frame_end, i);
 						break;
 
             case 0x80 :	// XBee_802 - RX (Receive) Packet: 64-bit Address
             case 0x81 :	// XBee_802 - RX (Receive) Packet: 16-bit Address
-						error_RX=rxData(ByteIN,length_mes-num_esc+length_prev,i-length_mes);
+						error_RX=rxData(ByteIN, frame_end, i);
 						break;
 
             case 0x89 :	// TX (Transmit) Status
-						delivery_status=ByteIN[i-length_mes+5];
-						if( delivery_status == 0 )
+						delivery_status=ByteIN[i+5];
+						if( delivery_status==0 )
 						{
 							error_TX=0;
 						}
@@ -4505,14 +4393,10 @@ uint8_t WaspXBeeCore::txStatusResponse()
         }
 
 		// decrement number of pending packets to be treated
-        num_mes--;
-
-        // update previous index in input buffer in order to carry on with the
-        // following message stored in 'memory'
-        length_prev=i;
-        i++;
-        num_esc=0;
+        decoder.frames--;
 
+        // carry on with the following message stored in 'ByteIN'
+        i=frame_end;
     }
 
     return error_TX;
@@ -4535,35 +4419,24 @@ uint8_t WaspXBeeCore::txZBStatusResponse()
 {
 	// create reception buffer
 	uint8_t ByteIN[MAX_PARSE];
+	xbeeDecoder_t decoder;
     unsigned long previous=millis();
-
-    // set number of bytes that TX Status frame (0x8B) has
-    uint16_t numberBytes=11;
+    uint16_t start=0;
+    uint16_t frame_end=0;
     uint8_t end=0;
-    uint16_t counter3=0;
-    uint8_t undesired=0;
-    uint8_t status=0;
-    uint16_t num_TX=0;
-    uint8_t num_esc=0;
     uint16_t interval=5000;
-    uint8_t num_mes=0;
-    uint16_t i=1;
-    uint16_t length_mes=0;
-    uint16_t length_prev=0;
+    uint16_t i=0;
     uint8_t maxFrame=110;
 
     error_TX=2;
 
-    memset(ByteIN, 0x00, sizeof(ByteIN));
+    decoderInit(&decoder);
 
-	// If a frame was truncated before, we set the first byte as 0x7E
-	// and we add a new packet to 'num_mes' counter
+	// If a frame was truncated before, its start delimiter was already read
     if( frameNext )
     {
-        ByteIN[0]=0x7E;
-        counter3=1;
-        num_mes=1;
         frameNext=0;
+        decodeFrameByte(&decoder, ByteIN, MAX_PARSE, XBEE_START_DELIMITER);
     }
 
 	// Read data from XBee while the following conditions are true:
@@ -4577,94 +4450,52 @@ uint8_t WaspXBeeCore::txZBStatusResponse()
 		// check available data
 		if( serialAvailable(uart)>0 )
        	{
-			// read byte from correspondent uart
-       		ByteIN[counter3] = serialRead(uart);
-            counter3++;
-            previous=millis();
-
-            // check if a new frame is received
-            if(ByteIN[counter3-1]==0x7E)
+			// read byte from correspondent uart, un-escaping it. The frames
+			// received before the TX status (modem status, RX packets) are
+			// kept and parsed below
+			start=decoder.start;
+			switch( decodeFrameByte(&decoder, ByteIN, MAX_PARSE, serialRead(uart)) )
 			{
-				// if there is no memory available for a whole new packet
-				// then we escape and select frameNext=1 in order to get it
-				// the next time we read from XBee
-           		if( (MAX_PARSE-counter3) < maxFrame )
-           		{
-					frameNext=1;
-				}
-                else num_mes++;
-            }
+				case XBEE_DECODE_START:
+						// if there is no memory available for a whole new
+						// packet then we escape and select frameNext=1 in
+						// order to get it the next time we read from XBee
+						if( (MAX_PARSE-decoder.length) < maxFrame )
+						{
+							frameNext=1;
+							decoder.length=decoder.start;
+							decoder.inFrame=0;
+						}
+						break;
 
-            // If some corrupted frame has appeared, it is discarded,
-            // counter3 is set to zero again
-            if( (counter3==1) && (ByteIN[counter3-1]!=0x7E) )
-            {
-				counter3=0;
+				case XBEE_DECODE_FRAME:
+						// the TX status has been found. The TX status of a
+						// frame sent by the queue is recorded and dropped
+						if( ByteIN[start+3] == 0x8B )
+						{
+							if( queueStatus(ByteIN, start) )
+							{
+								decoder.length=start;
+								decoder.start=start;
+								decoder.frames--;
+							}
+							else
+							{
+								end=1;
+							}
+						}
+						break;
+
+				default:
+						break;
 			}
+            previous=millis();
 
-			// if counter3 reaches the maximum data to parse, then finish
-           	if( counter3>=MAX_PARSE )
+			// if the buffer is full, then finish
+           	if( decoder.length>=MAX_PARSE )
            	{
 				end=1;
 			}
-
-			// Discard any non-TX status frame which are determined by a frame
-			// type which may be 0x8B(TX Status) or 0x8A(Modem Status)
-           	if( (counter3==4+(uint16_t)status*6+undesired) && (undesired!=1) )
-            {
-            	if( (ByteIN[counter3-1]!= 0x8B) && (ByteIN[counter3-1]!=0x8A) )
-				{
-					// increment undesired counter
-                	undesired=1;
-
-                	// sum 3 new bytes corresponding to
-	                // start delimiter (1Byte) + length (2Bytes)
-                	numberBytes+=3;
-                }
-            }
-
-            // if undesired counter is active, increment 'numberBytes'
-            if( undesired==1 )
-            {
-				numberBytes++;
-			}
-
-            // If a escape character (0x7D) is found increment 'numberBytes'
-            if( (ByteIN[counter3-1]==0x7D) && (!undesired) )
-            {
-            	numberBytes++;
-            }
-
-            /* If a modem status frame (0x8A)
-             *  ____________________________________________________
-             * |      |     |     |            |         |          |
-             * | 0x7E | MSB | LSB | Frame Type | cmdData | checksum |
-             * |______|_____|_____|____________|_________|__________|
-             *    0      1     2        3          4          5
-             */
-            if( (ByteIN[counter3-1]==0x8A) && (counter3==(4+(uint16_t)status*6)) )
-            {
-				// increment in 6Bytes 'numberBytes'
-            	numberBytes+=6;
-
-            	// increment 'status' in order to add a new 'modem status frame'
-            	status++;
-            }
-
-            // If a new frame is read after reading any undesired frame,
-        	// decrement 'numberBytes' and set undesired
-            if( (ByteIN[counter3-1]==0x7E) && (undesired==1) )
-            {
-            	numberBytes--;
-				undesired=numberBytes-7;
-            }
-
-            // if 'counter3' is the same as 'numberBytes' we finish
-        	// This means that TX status has been found
-            if(counter3==numberBytes)
-            {
-            	end=1;
-           	}
        	}
 
        	// avoid millis overflow problem
@@ -4678,53 +4509,20 @@ uint8_t WaspXBeeCore::txZBStatusResponse()
         }
     }
 
-    // Store number of read bytes
-    num_TX=counter3;
-    counter3=0;
-
     #if DEBUG_XBEE > 0
 	PRINT_XBEE(F("RX:"));
-    for(uint16_t i = 0; i < num_TX ; i++)
+    for(uint16_t i = 0; i < decoder.length ; i++)
 	{
 		USB.printHex(ByteIN[i]);
 	}
 	USB.println();
 	#endif
 
-    // If some corrupted frame has appeared we jump it
-    if( ByteIN[0]!=0x7E )
+    // Parse the received messages from the XBee: they are stored un-escaped
+    // one after the other, so each length field gives the next
+    while( decoder.frames>0 )
     {
-		// jump until a new frame start delimiter is found
-		while( ByteIN[i]!=0x7E && i<num_TX )
-        {
-			i++;
-		}
-	}
-
-    // Parse the received messages from the XBee
-    while( num_mes>0 )
-    {
-		// get length of the packet until another start delimiter
-		// is found or the end of read bytes is reached
-        while( ByteIN[i]!=0x7E && i<num_TX )
-        {
-			i++;
-		}
-        length_mes=i-length_prev;
-
-		// If any byte has been escaped, it must be converted before parsing it
-		// So first count number of escaped bytes and then make conversion
-        for( it=0;it<length_mes;it++)
-        {
-            if( ByteIN[it+length_prev]==0x7D ) num_esc++;
-        }
-
-        // if there are escaped bytes, make conversion
-        if( num_esc )
-        {
-			des_esc(ByteIN,length_mes,i-length_mes);
-		}
-
+		frame_end = i + 4 + ((uint16_t)ByteIN[i+1] << 8) + ByteIN[i+2];
 
 		/* Call parsing function depending on the Frame Type
 		 *  _______________________________________________
@@ -4733,27 +4531,23 @@ uint8_t WaspXBeeCore::txZBStatusResponse()
 		 * |______|_____|_____|____________|_______________|
 		 *    0      1     2        3          variable
 		 */
-        switch( ByteIN[(i-length_mes)+3] )
+        switch( ByteIN[i+3] )
         {
             case 0x8A :	//Modem Status
-						modemStatusResponse( ByteIN,
-											 length_mes-num_esc+length_prev,
-											 i-length_mes);
+						modemStatusResponse(ByteIN, frame_end, i);
 						break;
 
             case 0x90 :	// Receive Packet (AO=0)
             case 0x91 :	// Explicit Rx Indicator (AO=1)
-						error_RX=rxData( ByteIN,
-										 length_mes-num_esc+length_prev,
-										 i-length_mes);
+						error_RX=rxData(ByteIN, frame_end, i);
 						break;
 
             case 0x8B :	// Transmit Status
-						true_naD[0]=ByteIN[i-length_mes+5];
-						true_naD[1]=ByteIN[i-length_mes+6];
-						retries_sending=ByteIN[i-length_mes+7];
-						discovery_status=ByteIN[i-length_mes+9];
-						delivery_status=ByteIN[i-length_mes+8];
+						true_naD[0]=ByteIN[i+5];
+						true_naD[1]=ByteIN[i+6];
+						retries_sending=ByteIN[i+7];
+						discovery_status=ByteIN[i+9];
+						delivery_status=ByteIN[i+8];
 						if( delivery_status==0 )
 						{
 							error_TX=0;
@@ -4768,13 +4562,10 @@ uint8_t WaspXBeeCore::txZBStatusResponse()
         }
 
 		// decrement number of pending packets to be treated
-        num_mes--;
+        decoder.frames--;
 
-        // update previous index in input buffer in order to carry on with the
-        // following message stored in 'memory'
-        length_prev=i;
-        i++;
-        num_esc=0;
+        // carry on with the following message stored in 'ByteIN'
+        i=frame_end;
     }
 
     return error_TX;
@@ -4810,8 +4601,6 @@ uint8_t WaspXBeeCore::txZBStatusResponse()
  */
 int8_t WaspXBeeCore::rxData(uint8_t* data_in, uint16_t end, uint16_t start)
 {
-    if(freeMemory()<150) return -1;
-    uint8_t byteIN[120];
     int8_t error=2;
 
 	// Check the checksum
@@ -4822,14 +4611,9 @@ int8_t WaspXBeeCore::rxData(uint8_t* data_in, uint16_t end, uint16_t start)
         return 1;
     }
 
-	// Copy 'cmdData' to byteIN and calculate
-	// 'cmdData' length storing it in 'data_length' attribute
-	data_length=0;
-    for( uint16_t j = 4+start ; j < end-1 ; j++ )
-    {
-        byteIN[j-4-start] = data_in[j];
-        data_length++;
-    }
+	// 'cmdData' is parsed where it is: store its length
+	// in 'data_length' attribute
+	data_length = end - start - 5;
 
 	// Set correspondent mode depending on the frame type
     switch( data_in[start+3] )
@@ -4852,10 +4636,9 @@ int8_t WaspXBeeCore::rxData(uint8_t* data_in, uint16_t end, uint16_t start)
     }
 
 	////////////////////////////////////////////////////////////////////////////
-	// call parsing function for the packet which
-	// has been stored in byteIN.
+	// call parsing function for the 'cmdData' of the packet
 	////////////////////////////////////////////////////////////////////////////
-    error=readXBee(byteIN);
+    error=readXBee(&data_in[start+4]);
 
     return error;
 }
@@ -5120,8 +4903,11 @@ uint8_t WaspXBeeCore::new_firmware_received()
 
 	if( startSequence && !firm_info.already_init )
 	{
-		if(freeMemory()<450) return 1;
-		char asteriscos[449];
+		// reassembly state, freed when the OTA ends
+		otaRelease();
+		ota_rx = (otaReassembly_t*) calloc(1, sizeof(otaReassembly_t));
+		if( ota_rx == NULL ) return 1;
+		ota_rx->last = 0xFFFF;
 
 		// Set OTA Flag and set last time a OTA packet was received
 		programming_ON=1;
@@ -5264,21 +5050,19 @@ uint8_t WaspXBeeCore::new_firmware_received()
 			error_sd=true;
 		}
 
-		// Create the first sector
-		for (int j=0 ; j<448 ; j++)
-		{
-			asteriscos[j]='*';
-		}
-		asteriscos[448] = '\0';
+		// Create the first sector: the asterisks are gathered in the
+		// sector buffer, not used yet
+		memset(ota_rx->buffer, '*', 448);
 
 		if( !error_sd )
 		{
-			// create firmware file: 2 trials
-			if( !firm_file.open(&SD.root, firm_info.name_file, O_WRITE | O_CREAT | O_EXCL | O_SYNC | O_APPEND) )
+			// create firmware file for the largest image, in consecutive
+			// clusters so writing it does not update the FAT: 2 trials
+			if( !firm_file.createContiguous(&SD.root, firm_info.name_file, OTA_FILE_MAX) )
 			{
 				// in the case it failed in first place, try it again
 				firm_file.remove(&SD.root,firm_info.name_file);
-				if(!firm_file.open(&SD.root, firm_info.name_file, O_WRITE | O_CREAT | O_EXCL | O_SYNC | O_APPEND))
+				if(!firm_file.createContiguous(&SD.root, firm_info.name_file, OTA_FILE_MAX))
 				{
 					error_sd=true;
 				}
@@ -5305,7 +5089,7 @@ uint8_t WaspXBeeCore::new_firmware_received()
 				}
 
 				// Write asterisks into firmware file
-				if( (uint16_t)firm_file.write(asteriscos,strlen(asteriscos)) != strlen(asteriscos))
+				if( (uint16_t)firm_file.write(ota_rx->buffer,448) != 448)
 				{
 					error_sd=true;
 				}
@@ -5314,6 +5098,7 @@ uint8_t WaspXBeeCore::new_firmware_received()
 
 		if( error_sd )
 		{
+			otaRelease();
 			programming_ON=0;
 			setMulticastConf();
 			return 1;
@@ -5340,8 +5125,9 @@ uint8_t WaspXBeeCore::new_firmware_received()
 */
 void WaspXBeeCore::new_firmware_packets()
 {
-	uint8_t data_bin[92];
-	uint16_t sd_index=0;
+	uint8_t length;
+	uint16_t sequence;
+	uint32_t offset;
 	bool true_mac = true;
 	bool error_sd = false;
 	new_firm_packet_t* packet;
@@ -5351,8 +5137,11 @@ void WaspXBeeCore::new_firmware_packets()
 
 	it=0;
 
+	// packets are written where they belong, so none is kept for later
+	firm_info.paq_disordered=0;
+
 	// process the packet only when the programming mode is ON
-	if( programming_ON )
+	if( programming_ON && (ota_rx != NULL) )
 	{
 		// check if HIGH source mac address is correct
 		for(int j=0 ; j<4 ; j++)
@@ -5379,69 +5168,87 @@ void WaspXBeeCore::new_firmware_packets()
 			// get packet counter from received packet
 			firm_info.data_count_packet = packet->counter;
 
-			// successful cases to validate the packet:
-			// -> It is the first packet received
-			// -> This is the packet that follows the last one
-			// -> The packet counter (1Byte) overflows and restarts from zero
-			if(	((firm_info.data_count_packet == 0) && (firm_info.packets_received==0))
-				||	((firm_info.data_count_packet - firm_info.data_count_packet_ant) == 1 )
-				||	((firm_info.data_count_packet == 0)&&(firm_info.data_count_packet_ant == 255) ) )
-            {
-               	// Copy binary data and calculate length of this field
-				for( sd_index=0 ; sd_index<(packet_finished[pos-1]->data_length)-sizeof(header_t)-1 ; sd_index++ )
-				{
-                   	data_bin[sd_index] = packet_finished[pos-1]->data[sd_index+sizeof(header_t)+1];
-               	}
+			// length of the binary data
+			length = packet_finished[pos-1]->data_length - sizeof(header_t) - 1;
 
-				// Write binary data string into firmware file
-				if( (uint16_t)firm_file.write(data_bin,sd_index) != sd_index )
-				{
-					error_sd = true;
-				}
+			// the counter (1Byte) overflows and restarts from zero: take the
+			// sequence number closest to the highest one received
+			sequence = (ota_rx->highest & 0xFF00) | packet->counter;
+			if( (sequence + 128) < ota_rx->highest )
+			{
+				sequence += 256;
+			}
+			else if( (sequence > (ota_rx->highest + 128)) && (sequence >= 256) )
+			{
+				sequence -= 256;
+			}
 
-				// set init flag to zero
-				firm_info.already_init = 0;
+			// packet 0 gives the size of all the packets but the last one
+			if( (sequence == 0) && (ota_rx->chunk == 0) )
+			{
+				ota_rx->chunk = length;
+			}
 
-				// Set new OTA previous packet arrival time
-				firm_info.time_arrived=millis();
+			if( (ota_rx->chunk == 0) || (length == 0) )
+			{
+				// the place of the data is unknown until packet 0 arrives:
+				// it is dropped and the count will not match at the end
+			}
+			else if( (sequence >= OTA_MAX_PACKETS)
+				|| (length > ota_rx->chunk)
+				|| ((length < ota_rx->chunk) && (ota_rx->last != 0xFFFF) && (ota_rx->last != sequence)) )
+			{
+				// not a valid image
+				error_sd = true;
+			}
+			else if( !(ota_rx->received[sequence >> 3] & (1 << (sequence & 0x07))) )
+			{
+				// write the packet in its place; retransmissions are skipped
+				offset = OTA_SECTOR_SIZE + (uint32_t)sequence * ota_rx->chunk;
 
-				if(error_sd)
+				if( otaWrite(offset, packet->data, length) )
 				{
-					// skip programming mode:
-					programming_ON=0;
-					firm_file.remove(&SD.root,firm_info.name_file);
-					firm_info.packets_received=0;
-					firm_info.paq_disordered=0;
-					setMulticastConf();
+					error_sd = true;
 				}
 				else
 				{
-					// validate packet:
+					ota_rx->received[sequence >> 3] |= (1 << (sequence & 0x07));
 					firm_info.packets_received++;
-					firm_info.data_count_packet_ant = firm_info.data_count_packet;
-					firm_info.paq_disordered=0;
-					sd_index=0;
+
+					if( length < ota_rx->chunk )
+					{
+						ota_rx->last = sequence;
+					}
+					if( sequence > ota_rx->highest )
+					{
+						ota_rx->highest = sequence;
+					}
+					if( (offset + length) > ota_rx->size )
+					{
+						ota_rx->size = offset + length;
+					}
 				}
 			}
-			else if( !(firm_info.data_count_packet == firm_info.data_count_packet_ant) )
-			{
-				if( (firm_info.data_count_packet - firm_info.data_count_packet_ant) == 2 )
-				{
-					// re-order one packet lost
-					firm_info.paq_disordered=1;
-				}
-				else
-				{
-					// if more than one packet is lost, then stop OTA process
-					programming_ON=0;
-					firm_file.remove(&SD.root,firm_info.name_file);
-					firm_info.packets_received=0;
-					firm_info.paq_disordered=0;
-					setMulticastConf();
-
-					// flush uart
-					serialFlush(uart);
-				}
+
+			// set init flag to zero
+			firm_info.already_init = 0;
+
+			// Set new OTA previous packet arrival time
+			firm_info.time_arrived=millis();
+			firm_info.data_count_packet_ant = firm_info.data_count_packet;
+
+			if(error_sd)
+			{
+				// skip programming mode:
+				otaRelease();
+				programming_ON=0;
+				firm_file.close();
+				firm_file.remove(&SD.root,firm_info.name_file);
+				firm_info.packets_received=0;
+				setMulticastConf();
+
+				// flush uart
+				serialFlush(uart);
 			}
 		}
 		else
@@ -5461,6 +5268,86 @@ void WaspXBeeCore::new_firmware_packets()
 }
 
 
+/*
+ Function: It writes OTA data into the firmware file. Data following the one
+ gathered in the sector buffer is appended to it, so in-order packets reach
+ the SD card as whole sectors
+ Returns: 1 if error, 0 otherwise
+*/
+uint8_t WaspXBeeCore::otaWrite(uint32_t offset, uint8_t* data, uint8_t length)
+{
+	uint16_t sector;
+	uint16_t start;
+	uint16_t n;
+
+	while( length > 0 )
+	{
+		sector = offset / OTA_SECTOR_SIZE;
+		start = offset % OTA_SECTOR_SIZE;
+		n = OTA_SECTOR_SIZE - start;
+		if( n > length ) n = length;
+
+		// start gathering again if it does not follow the buffered data
+		if( (sector != ota_rx->sector) || (start != ota_rx->hi) )
+		{
+			if( otaFlushSector() ) return 1;
+			ota_rx->sector = sector;
+			ota_rx->lo = start;
+			ota_rx->hi = start;
+		}
+
+		memcpy(&ota_rx->buffer[start], data, n);
+		ota_rx->hi += n;
+
+		if( ota_rx->hi == OTA_SECTOR_SIZE )
+		{
+			if( otaFlushSector() ) return 1;
+		}
+
+		offset += n;
+		data += n;
+		length -= n;
+	}
+	return 0;
+}
+
+
+/*
+ Function: It writes the data gathered in the sector buffer
+ Returns: 1 if error, 0 otherwise
+*/
+uint8_t WaspXBeeCore::otaFlushSector()
+{
+	uint16_t n = ota_rx->hi - ota_rx->lo;
+
+	if( n > 0 )
+	{
+		if( !firm_file.seekSet((uint32_t)ota_rx->sector * OTA_SECTOR_SIZE + ota_rx->lo) )
+		{
+			return 1;
+		}
+		if( firm_file.write(&ota_rx->buffer[ota_rx->lo], n) != (int)n )
+		{
+			return 1;
+		}
+	}
+	ota_rx->lo = 0;
+	ota_rx->hi = 0;
+	return 0;
+}
+
+
+/*
+ Function: It frees the reassembly state of the new firmware
+ Returns: Nothing
+*/
+void WaspXBeeCore::otaRelease()
+{
+	free(ota_rx);
+	ota_rx = NULL;
+}
+
+
 /*
  * Function: It receives the last packet of a new firmware which carries the
  * number of packets that must have been received
@@ -5522,8 +5409,13 @@ void WaspXBeeCore::new_firmware_end()
 			// convert from string to integer
 			num_packets = atoi(num_packets_char);
 
-			// check the number of packets received
-			if( num_packets != firm_info.packets_received )
+			// check the number of packets received: with no duplicates
+			// counted, all of them arrived if the highest is the last one
+			if( (ota_rx == NULL)
+				|| (num_packets == 0)
+				|| (num_packets != firm_info.packets_received)
+				|| (ota_rx->highest != (num_packets - 1))
+				|| ((ota_rx->last != 0xFFFF) && (ota_rx->last != ota_rx->highest)) )
 			{
 				send_ok = false;
 			}
@@ -5532,6 +5424,15 @@ void WaspXBeeCore::new_firmware_end()
 				send_ok = true;
 			}
 
+			// write what is left and cut the file at the end of the image
+			if( send_ok )
+			{
+				if( otaFlushSector() || !firm_file.truncate(ota_rx->size) )
+				{
+					send_ok = false;
+				}
+			}
+
 			// if number of packets matches to the infor received
 			// then close and open the file to check it works
 			if( send_ok )
@@ -5557,6 +5458,9 @@ void WaspXBeeCore::new_firmware_end()
 		send_ok = false;
 	}
 
+	// the reassembly is over: free its memory before answering
+	otaRelease();
+
 	// if OTA worked then copy the information to BOOT.TXT
 	if( send_ok == true )
 	{
@@ -5635,6 +5539,7 @@ void WaspXBeeCore::new_firmware_end()
 	}
 	else
 	{
+		firm_file.close();
 		firm_file.remove(&SD.root,firm_info.name_file);
 		programming_ON=0;
 		firm_info.packets_received=0;
@@ -6761,7 +6666,9 @@ uint8_t WaspXBeeCore::checkOtapTimeout()
 		if( OTA_TIMEOUT < total_time )
 		{
 			// Reach Timeout
+			otaRelease();
 			programming_ON=0;
+			firm_file.close();
 			firm_file.remove(&SD.root,firm_info.name_file);
 			firm_info.packets_received=0;
 			firm_info.paq_disordered=0;
@@ -6881,6 +6788,180 @@ void WaspXBeeCore::gen_escaped_frame(	uint8_t* TX,
 }
 
 
+/*
+ * Function: It writes a byte of an API frame to the UART, escaping it if
+ * necessary
+ */
+static void writeEscaped(uint8_t data, uint8_t uart)
+{
+	if( data==0x11 ||
+		data==0x13 ||
+		data==XBEE_ESCAPE ||
+		data==XBEE_START_DELIMITER )
+	{
+		printByte(XBEE_ESCAPE, uart);
+		data ^= 0x20;
+	}
+	printByte(data, uart);
+}
+
+
+/*
+ * Function: It starts an API frame: start delimiter and length field, which
+ * is escaped like the rest of the frame
+ */
+void WaspXBeeCore::frameBegin(uint16_t length)
+{
+	printByte(XBEE_START_DELIMITER, uart);
+	writeEscaped(length >> 8, uart);
+	writeEscaped(length & 0xFF, uart);
+	tx_checksum = 0;
+}
+
+
+/*
+ * Function: It writes Frame Data bytes, escaping them and adding them to the
+ * checksum as they are sent
+ */
+void WaspXBeeCore::frameWrite(const uint8_t* data, uint16_t length)
+{
+	for( uint16_t i = 0; i < length; i++ )
+	{
+		tx_checksum += data[i];
+		writeEscaped(data[i], uart);
+	}
+}
+
+
+/*
+ * Function: It writes the checksum which closes the API frame
+ */
+void WaspXBeeCore::frameEnd()
+{
+	writeEscaped(0xFF - tx_checksum, uart);
+}
+
+
+/*
+ * Function: It sends an API frame made of a header and a payload, read from
+ * where they are: nothing is copied
+ */
+void WaspXBeeCore::sendFrame(	const uint8_t* header,
+								uint16_t header_length,
+								const uint8_t* payload,
+								uint16_t payload_length)
+{
+	frameBegin(header_length + payload_length);
+	frameWrite(header, header_length);
+	frameWrite(payload, payload_length);
+	frameEnd();
+}
+
+
+/*
+ * Function: It initializes an API frame decoder
+ */
+void WaspXBeeCore::decoderInit(xbeeDecoder_t* decoder)
+{
+	memset(decoder, 0x00, sizeof(xbeeDecoder_t));
+}
+
+
+/*
+ * Function: It decodes a byte read from the UART. The start delimiter is
+ * never escaped, so it always begins a new frame. The other bytes are
+ * un-escaped and stored, the length field gives the end of the frame and the
+ * checksum is summed on the way
+ *
+ * Returns: XBEE_DECODE_START if a frame starts, XBEE_DECODE_FRAME if one is
+ * complete with a good checksum, XBEE_DECODE_NONE otherwise
+ */
+uint8_t WaspXBeeCore::decodeFrameByte(	xbeeDecoder_t* decoder,
+										uint8_t* buffer,
+										uint16_t size,
+										uint8_t data)
+{
+	uint16_t index;
+
+	if( data == XBEE_START_DELIMITER )
+	{
+		// drop the frame being received, if any
+		decoder->length = decoder->start;
+		decoder->inFrame = 0;
+
+		if( decoder->length >= size )
+		{
+			return XBEE_DECODE_NONE;
+		}
+		buffer[decoder->length++] = data;
+		decoder->end = 0;
+		decoder->checksum = 0;
+		decoder->escape = 0;
+		decoder->inFrame = 1;
+		return XBEE_DECODE_START;
+	}
+
+	// bytes out of a frame are discarded
+	if( !decoder->inFrame )
+	{
+		return XBEE_DECODE_NONE;
+	}
+
+	if( data == XBEE_ESCAPE )
+	{
+		decoder->escape = 1;
+		return XBEE_DECODE_NONE;
+	}
+
+	if( decoder->escape )
+	{
+		data ^= 0x20;
+		decoder->escape = 0;
+	}
+
+	if( decoder->length >= size )
+	{
+		decoder->length = decoder->start;
+		decoder->inFrame = 0;
+		return XBEE_DECODE_NONE;
+	}
+	buffer[decoder->length++] = data;
+
+	// number of bytes of the frame, start delimiter included
+	index = decoder->length - decoder->start;
+
+	if( index == 3 )
+	{
+		// length field complete: Frame Data length plus 4 bytes
+		decoder->end = decoder->start + 4 + (((uint16_t)buffer[decoder->start+1] << 8) | buffer[decoder->start+2]);
+		if( decoder->end > size )
+		{
+			decoder->length = decoder->start;
+			decoder->inFrame = 0;
+		}
+	}
+	else if( index > 3 )
+	{
+		decoder->checksum += data;
+
+		if( decoder->length == decoder->end )
+		{
+			decoder->inFrame = 0;
+
+			if( decoder->checksum != 0xFF )
+			{
+				decoder->length = decoder->start;
+				return XBEE_DECODE_NONE;
+			}
+			decoder->start = decoder->length;
+			decoder->frames++;
+			return XBEE_DECODE_FRAME;
+		}
+	}
+	return XBEE_DECODE_NONE;
+}
+
+
 
 
 /*
@@ -7372,3 +7453,440 @@ void WaspXBeeCore::setSendingRetries(uint8_t num)
         _send_retries = num;
     }
 }
+
+
+/*
+ * Function: Queues data to be sent to another XBee in API mode. It is
+ * aggregated with the data queued before for the same destination and sent in
+ * a frame when the frame is full, without waiting for its TX status.
+ * This function is only used for 64-bit addressing.
+ *
+ * Return:
+ * 	'0' OK
+ * 	'1' no memory for the queue
+ * 	'2' data longer than a frame
+ * 	'3' wrong MAC address
+ */
+uint8_t WaspXBeeCore::queue( uint8_t* macAddress, uint8_t* pointer, uint16_t length )
+{
+	uint8_t mode = UNICAST;
+	uint16_t maxPayload;
+	uint8_t* resized;
+
+	// the data aggregated goes to another destination: send it first
+	if( (tx_queue != NULL) && (tx_queue->length > 0) &&
+		(memcmp(tx_queue->mac, macAddress, 8) != 0) )
+	{
+		queueSend();
+	}
+
+	if( (tx_queue == NULL) || (tx_queue->length == 0) )
+	{
+		// broadcast address: 0x000000000000FFFF
+		if( (macAddress[0] | macAddress[1] | macAddress[2] |
+			 macAddress[3] | macAddress[4] | macAddress[5]) == 0x00 &&
+			macAddress[6] == 0xFF && macAddress[7] == 0xFF )
+		{
+			mode = BROADCAST;
+		}
+
+		maxPayload = getMaxPayload(mode, _64B);
+		if( maxPayload > MAX_DATA )
+		{
+			maxPayload = MAX_DATA;
+		}
+
+		// allocate the queue with the first data, with room for a RX frame
+		if( tx_queue == NULL )
+		{
+			tx_queue = (xbeeQueue_t*)calloc(1, sizeof(xbeeQueue_t));
+			if( tx_queue == NULL )
+			{
+				return 1;
+			}
+			tx_queue->frameSize = getMaxPayload(UNICAST, _64B);
+			if( tx_queue->frameSize > MAX_DATA )
+			{
+				tx_queue->frameSize = MAX_DATA;
+			}
+			tx_queue->frameSize += XBEE_QUEUE_RX_OVERHEAD;
+			tx_queue->frame = (uint8_t*)malloc(tx_queue->frameSize);
+			if( tx_queue->frame == NULL )
+			{
+				queueFree();
+				return 1;
+			}
+			decoderInit(&tx_queue->decoder);
+		}
+
+		// room for a frame payload to this destination. It is empty, so it
+		// can be moved
+		if( tx_queue->size < maxPayload )
+		{
+			resized = (uint8_t*)realloc(tx_queue->payload, maxPayload);
+			if( resized == NULL )
+			{
+				return 1;
+			}
+			tx_queue->payload = resized;
+			tx_queue->size = maxPayload;
+		}
+
+		memcpy(tx_queue->mac, macAddress, 8);
+		tx_queue->maxPayload = maxPayload;
+	}
+
+	if( length > tx_queue->maxPayload )
+	{
+		return 2;
+	}
+
+	// the data does not fit in the frame: send what was aggregated before
+	if( (tx_queue->length + length) > tx_queue->maxPayload )
+	{
+		queueSend();
+	}
+
+	memcpy(&tx_queue->payload[tx_queue->length], pointer, length);
+	tx_queue->length += length;
+
+	// a full frame is sent right away
+	if( tx_queue->length == tx_queue->maxPayload )
+	{
+		queueSend();
+	}
+
+	return 0;
+}
+
+
+uint8_t WaspXBeeCore::queue( char* macAddress, uint8_t* pointer, uint16_t length )
+{
+	uint8_t mac[8];
+
+	if( strlen(macAddress) != 16 )
+	{
+		return 3;
+	}
+	Utils.str2hex(macAddress, mac, sizeof(mac));
+
+	return queue( mac, pointer, length );
+}
+
+
+uint8_t WaspXBeeCore::queue( char* macAddress, char* data )
+{
+	return queue( macAddress, (uint8_t*)data, (uint16_t)strlen(data) );
+}
+
+
+/*
+ * Function: Sends the data aggregated in the send queue without waiting for
+ * its TX status
+ */
+void WaspXBeeCore::flushQueue()
+{
+	queueSend();
+}
+
+
+/*
+ * Function: Decodes the bytes received so far, without waiting for more, and
+ * matches the TX status frames with the frames sent by the queue. Any data
+ * or modem status received meanwhile is treated as usual. A frame cut here is
+ * completed by the next call. The frames whose TX status did not arrive in
+ * XBEE_QUEUE_TIMEOUT are given up
+ *
+ * Returns: number of frames still waiting for their TX status
+ */
+uint8_t WaspXBeeCore::pollQueue()
+{
+	if( tx_queue == NULL )
+	{
+		return 0;
+	}
+
+	// If a frame was truncated before, its start delimiter was already read
+	if( frameNext )
+	{
+		frameNext=0;
+		decodeFrameByte(&tx_queue->decoder, tx_queue->frame, tx_queue->frameSize, XBEE_START_DELIMITER);
+	}
+
+	// read the bytes available from correspondent uart, un-escaping them
+	while( serialAvailable(uart) > 0 )
+	{
+		if( decodeFrameByte(&tx_queue->decoder, tx_queue->frame, tx_queue->frameSize, serialRead(uart)) == XBEE_DECODE_FRAME )
+		{
+			queueFrame();
+		}
+	}
+
+	queueExpire();
+
+	return tx_queue->inFlight;
+}
+
+
+/*
+ * Function: Treats the frame decoded by pollQueue(), which is dropped
+ * afterwards so the next one is decoded from the start of the buffer
+ */
+void WaspXBeeCore::queueFrame()
+{
+	uint8_t* frame = tx_queue->frame;
+	uint16_t frame_end = tx_queue->decoder.length;
+
+	switch( frame[3] )
+	{
+		case 0x8A :	// Modem Status
+					modemStatusResponse(frame, frame_end, 0);
+					break;
+
+		case 0x80 :	// XBee802 - RX (Receive) Packet: 64-bit Address
+		case 0x81 :	// XBee802 - RX (Receive) Packet: 16-bit Address
+		case 0x90 :	// XBee Receive Packet (AO=0)
+		case 0x91 :	// XBee Explicit Rx Indicator (AO=1)
+					error_RX=rxData(frame, frame_end, 0);
+					break;
+
+		case 0x89 :	// XBee802 - TX (Transmit) Status
+		case 0x8B :	// Transmit Status
+					queueStatus(frame, 0);
+					break;
+
+		default   :	break;
+	}
+
+	decoderInit(&tx_queue->decoder);
+}
+
+
+/*
+ * Function: Frees the send queue and its buffers
+ */
+void WaspXBeeCore::queueFree()
+{
+	free(tx_queue->payload);
+	free(tx_queue->frame);
+	free(tx_queue);
+	tx_queue = NULL;
+}
+
+
+/*
+ * Function: Sends the data queued and waits for the TX status of every frame
+ * sent by the queue, which is freed afterwards
+ *
+ * Returns: number of frames not delivered since the last call, '0' if all of
+ * them were delivered
+ */
+uint8_t WaspXBeeCore::waitQueue()
+{
+	uint8_t failed;
+
+	if( tx_queue == NULL )
+	{
+		return 0;
+	}
+
+	queueSend();
+
+	while( pollQueue() > 0 );
+
+	failed = tx_queue->failed;
+	if( failed == 0 )
+	{
+		error_TX=0;
+	}
+	else
+	{
+		error_TX=1;
+	}
+
+	queueFree();
+
+	return failed;
+}
+
+
+/*
+ * Function: Sends the data aggregated in the send queue with the next frame ID
+ * of the queue. If XBEE_QUEUE_WINDOW frames are already waiting for their TX
+ * status, it waits for one of them first
+ *
+ * --> Transmit Request (0x10):
+ *  _________________________________________________________________
+ * |      |          |         |        |        |         |         |
+ * | 0x10 | frame ID | 64b MAC | 0xFFFE | radius | options | RF Data |
+ * |______|__________|_________|________|________|_________|_________|
+ *
+ * --> XBee-802.15.4 TX Request 64-bit address (0x00):
+ *  _______________________________________________
+ * |      |          |         |         |         |
+ * | 0x00 | frame ID | 64b MAC | options | RF Data |
+ * |______|__________|_________|_________|_________|
+ *
+ * Returns: '1' if there is nothing to send, '0' otherwise
+ */
+uint8_t WaspXBeeCore::queueSend()
+{
+	uint8_t header[14];
+	uint8_t header_length;
+	uint8_t slot;
+
+	if( (tx_queue == NULL) || (tx_queue->length == 0) )
+	{
+		return 1;
+	}
+
+	// wait for a free entry in the window
+	while( tx_queue->inFlight >= XBEE_QUEUE_WINDOW )
+	{
+		pollQueue();
+	}
+	slot = queueSlot(0);
+
+	// the queue uses the frame IDs from XBEE_QUEUE_FRAME_ID to 0xFF
+	tx_queue->frameID++;
+	if( tx_queue->frameID < XBEE_QUEUE_FRAME_ID )
+	{
+		tx_queue->frameID = XBEE_QUEUE_FRAME_ID;
+	}
+
+	header[1] = tx_queue->frameID;
+	memcpy(&header[2], tx_queue->mac, 8);
+
+	if( protocol == XBEE_802_15_4 )
+	{
+		header[0] = 0x00;
+		header[10] = 0x00;
+		header_length = 11;
+	}
+	else
+	{
+		header[0] = 0x10;
+		header[10] = 0xFF;
+		header[11] = 0xFE;
+		header[12] = 0x00;
+		header[13] = 0x00;
+		header_length = 14;
+	}
+
+	// switch MUX to the socket used
+	if( uart==SOCKET0 )
+	{
+		Utils.setMuxSocket0();
+	}
+	else
+	{
+		Utils.setMuxSocket1();
+	}
+
+	sendFrame(header, header_length, tx_queue->payload, tx_queue->length);
+
+	tx_queue->window[slot].frameID = tx_queue->frameID;
+	tx_queue->window[slot].sent = millis();
+	tx_queue->inFlight++;
+	tx_queue->length = 0;
+
+	return 0;
+}
+
+
+/*
+ * Function: Gets the window entry of a frame sent by the queue, or a free
+ * entry if 'frameID' is 0
+ *
+ * Returns: the index in the window, XBEE_QUEUE_WINDOW if not found
+ */
+uint8_t WaspXBeeCore::queueSlot(uint8_t frameID)
+{
+	uint8_t slot;
+
+	for( slot = 0; slot < XBEE_QUEUE_WINDOW; slot++ )
+	{
+		if( tx_queue->window[slot].frameID == frameID )
+		{
+			break;
+		}
+	}
+	return slot;
+}
+
+
+/*
+ * Function: Records a TX status if its frame ID is one of the frames sent by
+ * the queue. The delivery status is byte 5 of a TX Status (0x89) and byte 8
+ * of a Transmit Status (0x8B):
+ *  ____________________________________________________________________
+ * |      |     |     |      |          |          |         |          |
+ * | 0x7E | MSB | LSB | 0x8B | frame ID | naD (2B) | retries | delivery |
+ * |______|_____|_____|______|__________|__________|_________|__________|
+ *    0      1     2     3        4        5-6         7          8
+ *
+ * Returns: '1' if the TX status belongs to the queue, '0' otherwise
+ */
+uint8_t WaspXBeeCore::queueStatus(uint8_t* data_in, uint16_t start)
+{
+	uint8_t slot;
+	uint8_t status;
+
+	if( (tx_queue == NULL) || (data_in[start+4] == 0) )
+	{
+		return 0;
+	}
+
+	slot = queueSlot(data_in[start+4]);
+	if( slot == XBEE_QUEUE_WINDOW )
+	{
+		return 0;
+	}
+
+	if( data_in[start+3] == 0x8B )
+	{
+		status = data_in[start+8];
+	}
+	else
+	{
+		status = data_in[start+5];
+	}
+
+	if( status != 0 )
+	{
+		tx_queue->failed++;
+	}
+
+	tx_queue->window[slot].frameID = 0;
+	tx_queue->inFlight--;
+	return 1;
+}
+
+
+/*
+ * Function: Gives up the frames of the queue whose TX status did not arrive
+ * in XBEE_QUEUE_TIMEOUT, counting them as failed
+ */
+void WaspXBeeCore::queueExpire()
+{
+	for( uint8_t slot = 0; slot < XBEE_QUEUE_WINDOW; slot++ )
+	{
+		if( tx_queue->window[slot].frameID == 0 )
+		{
+			continue;
+		}
+
+		// avoid millis overflow problem
+		if( millis() < tx_queue->window[slot].sent )
+		{
+			tx_queue->window[slot].sent = millis();
+		}
+
+		if( (millis() - tx_queue->window[slot].sent) > XBEE_QUEUE_TIMEOUT )
+		{
+			tx_queue->window[slot].frameID = 0;
+			tx_queue->inFlight--;
+			tx_queue->failed++;
+		}
+	}
+}
@@ -77,6 +77,20 @@
 //Different Max Sizes Used in Libraries
 #define MAX_DATA			300
 #define	MAX_PARSE			300
+
+//API frame codec: start delimiter, escape character and decoder results
+#define	XBEE_START_DELIMITER	0x7E
+#define	XBEE_ESCAPE				0x7D
+#define	XBEE_DECODE_NONE		0	// byte stored or discarded
+#define	XBEE_DECODE_START		1	// a new frame starts
+#define	XBEE_DECODE_FRAME		2	// a frame is complete, its checksum good
+
+//Send queue: frames in flight, first frame ID used and TX status timeout
+#define	XBEE_QUEUE_WINDOW		4
+#define	XBEE_QUEUE_FRAME_ID		0x80
+#define	XBEE_QUEUE_TIMEOUT		5000
+//Send queue: bytes of the largest RX frame (0x91) but its RF data
+#define	XBEE_QUEUE_RX_OVERHEAD	22
 #define	MAX_BROTHERS		5
 #define MAX_FINISH_PACKETS	5
 
@@ -200,6 +214,13 @@
 #define	MAX_OTA_RETRIES		3
 #define	OTA_TIMEOUT			10000 //milliseconds
 
+// OTA firmware file: first sector (START_SECTOR + PID + asterisks) and data.
+// It is allocated for the largest image and truncated once complete
+#define	OTA_SECTOR_SIZE		512
+#define	OTA_FILE_MAX		(OTA_SECTOR_SIZE + (uint32_t)FLASHEND + 1)
+// sequence numbers tracked: Flash size over the smallest usual chunk (86B)
+#define	OTA_MAX_PACKETS		1536
+
 // OTA frame types
 #define DELETE_FRAME 			0x78
 #define CHECK_NEW_PROG_FRAME 	0x79
@@ -502,6 +523,125 @@ public:
 
 
 
+//! Structure : otaReassembly_t
+/*! Reassembly of the OTA firmware packets into the SD file. Packet 'n' goes
+ * at OTA_SECTOR_SIZE + n * chunk, whatever the order it arrives in, and the
+ * data is gathered in 'buffer' so whole sectors are written
+ */
+struct otaReassembly_t
+{
+	//! sector of the file being gathered in 'buffer'
+	uint8_t buffer[OTA_SECTOR_SIZE];
+	uint16_t sector;
+
+	//! bytes [lo, hi) of 'buffer' hold data not written yet
+	uint16_t lo;
+	uint16_t hi;
+
+	//! bitmap of the sequence numbers written
+	uint8_t received[OTA_MAX_PACKETS / 8];
+
+	//! highest sequence number received
+	uint16_t highest;
+
+	//! sequence number of the packet shorter than 'chunk', 0xFFFF if none
+	uint16_t last;
+
+	//! data bytes per packet, taken from packet 0
+	uint8_t chunk;
+
+	//! end of the data in the file
+	uint32_t size;
+};
+
+
+//! Structure : xbeeDecoder_t
+/*! State of the API frame decoder (decodeFrameByte). The bytes read from the
+ * UART are un-escaped and checksummed as they arrive and the complete frames
+ * are stored one after the other from the start of the buffer, so they are
+ * walked through their length field. A frame cut by a start delimiter, too
+ * long for the buffer or with a wrong checksum is dropped
+ */
+struct xbeeDecoder_t
+{
+	//! bytes stored in the buffer
+	uint16_t length;
+
+	//! index of the frame being received
+	uint16_t start;
+
+	//! end of that frame, once its length field is read
+	uint16_t end;
+
+	//! complete frames in the buffer
+	uint8_t frames;
+
+	//! sum of the Frame Data and checksum bytes
+	uint8_t checksum;
+
+	//! the next byte is escaped
+	uint8_t escape;
+
+	//! a frame is being received
+	uint8_t inFrame;
+};
+
+
+//! Structure : xbeeQueueFrame_t
+/*! Frame of the send queue waiting for its TX status
+ */
+struct xbeeQueueFrame_t
+{
+	//! frame ID, 0 if the entry is free
+	uint8_t frameID;
+
+	//! time when the frame was sent
+	unsigned long sent;
+};
+
+
+//! Structure : xbeeQueue_t
+/*! Send queue (queue()): the data queued for a destination is aggregated in
+ * 'payload' until a frame is full, and up to XBEE_QUEUE_WINDOW frames are
+ * sent without waiting for their TX status, which is matched by frame ID.
+ * 'payload' is allocated apart, as big as the frame payload of the protocol
+ * (getMaxPayload()). The frames received meanwhile are decoded byte by byte
+ * into 'frame', which holds one RX frame of the protocol
+ */
+struct xbeeQueue_t
+{
+	//! 64-bit destination of the data aggregated
+	uint8_t mac[8];
+
+	//! bytes aggregated in 'payload', not sent yet
+	uint16_t length;
+
+	//! payload of a frame to 'mac'
+	uint16_t maxPayload;
+
+	//! bytes allocated for 'payload'
+	uint16_t size;
+
+	//! frames sent waiting for their TX status
+	xbeeQueueFrame_t window[XBEE_QUEUE_WINDOW];
+	uint8_t inFlight;
+
+	//! frame ID of the last frame sent
+	uint8_t frameID;
+
+	//! frames whose delivery failed or whose TX status never arrived
+	uint8_t failed;
+
+	//! data aggregated
+	uint8_t* payload;
+
+	//! frame being received by pollQueue(), 'frameSize' bytes allocated
+	xbeeDecoder_t decoder;
+	uint8_t* frame;
+	uint16_t frameSize;
+};
+
+
 //! Structure : header_t
 /*! Special frame header for OTA packets
  */
@@ -700,6 +840,59 @@ private:
 	*/
 	SdFile boot_file;
 
+	//! Variable : reassembly of the new firmware, allocated while receiving it
+	/*!
+	*/
+	otaReassembly_t* ota_rx;
+
+	//! It writes OTA data into the firmware file through the sector buffer
+	/*!
+	\return 1 if error, 0 otherwise
+	 */
+	uint8_t otaWrite(uint32_t offset, uint8_t* data, uint8_t length);
+
+	//! It writes the data gathered in the sector buffer
+	/*!
+	\return 1 if error, 0 otherwise
+	 */
+	uint8_t otaFlushSector();
+
+	//! It frees the reassembly state
+	void otaRelease();
+
+	//! Variable : send queue, allocated while there is data queued
+	/*!
+	*/
+	xbeeQueue_t* tx_queue;
+
+	//! It sends the data aggregated in the send queue as a Transmit Request,
+	//! waiting for a free entry in the window if necessary
+	/*!
+	\return 1 if there is nothing to send, 0 otherwise
+	 */
+	uint8_t queueSend();
+
+	//! It gets the window entry of a frame sent by the queue
+	/*!
+	\return the index in 'window', XBEE_QUEUE_WINDOW if not found
+	 */
+	uint8_t queueSlot(uint8_t frameID);
+
+	//! It records a TX status (0x89 or 0x8B) of a frame sent by the queue
+	/*!
+	\return 1 if the TX status belongs to the queue, 0 otherwise
+	 */
+	uint8_t queueStatus(uint8_t* data_in, uint16_t start);
+
+	//! It gives up the frames whose TX status did not arrive in time
+	void queueExpire();
+
+	//! It treats a frame received by pollQueue()
+	void queueFrame();
+
+	//! It frees the send queue
+	void queueFree();
+
 public:
 
 	//! Class constructor
@@ -712,6 +905,12 @@ public:
 		// set the default maximum number of retries to '3'
 		_send_retries = 3;
 
+		// no OTA in progress
+		ota_rx = NULL;
+
+		// nothing queued
+		tx_queue = NULL;
+
 		// update WaspRegister for SPI interferences in Waspv15
 		WaspRegister |= REG_XBEE_SOCKET0;
 	}
@@ -1082,6 +1281,47 @@ public:
 	//! It sets the maximum number of application-level retries to be done
 	void setSendingRetries(uint8_t num);
 
+	//! It queues data to be sent to another XBee, aggregated with the data
+	//! queued before for the same destination
+	/*! The data queued is sent in a frame when the next data does not fit in
+	 *	it, when the destination changes or with flushQueue(), so the records
+	 * 	must delimit themselves (i.e. Waspmote frames). Up to XBEE_QUEUE_WINDOW
+	 * 	frames are sent without waiting for their TX status: waitQueue()
+	 * 	waits for them. There are no application-level retries: the frames
+	 * 	failed are counted. Only 64-bit addressing.
+	 * 	Data is never fragmented across frames: data longer than the payload
+	 * 	of one frame (getMaxPayload(), i.e. 84 bytes on ZigBee unicast) is
+	 * 	rejected with '2' and must be split by the caller.
+    \param char* macAddress : destination MAC address
+    \param uint8_t* pointer : pointer to buffer of data to be queued
+    \param uint16_t length  : length of the buffer
+    \return '0' on success, '1' no memory for the queue, '2' data longer than
+		a frame, '3' wrong MAC address
+     */
+	uint8_t queue( char* macAddress, uint8_t* pointer, uint16_t length );
+	uint8_t queue( char* macAddress, char* data );
+	uint8_t queue( uint8_t* macAddress, uint8_t* pointer, uint16_t length );
+
+	//! It sends the data aggregated in the send queue without waiting for
+	//! its TX status
+	void flushQueue();
+
+	//! It matches the TX status received with the frames sent by the queue,
+	//! without waiting. Data received meanwhile is treated as usual
+	/*!
+    \return number of frames still waiting for their TX status
+     */
+	uint8_t pollQueue();
+
+	//! It sends the data queued and waits for the TX status of every frame.
+	//! The queue is freed
+	/*! Call it before other XBee functions: they could take the TX status
+	 * 	of the frames in flight
+    \return number of frames not delivered since the last call, '0' if all
+		of them were delivered
+     */
+	uint8_t waitQueue();
+
 	//! It treats the data from XBee UART
   	/*!
     \return '0' on success, '1' otherwise
@@ -1721,6 +1961,53 @@ protected:
 							uint8_t* data,
 							int* final_length);
 
+	//! It starts an API frame, written straight to the UART
+  	/*! The start delimiter and the length are sent. The Frame Data follows
+  	with frameWrite() and frameEnd() sends the checksum, so a frame is sent
+  	from its parts with no intermediate array.
+    \param uint16_t length : length of the Frame Data
+	\return void
+	*/
+    void frameBegin(uint16_t length);
+
+	//! It sends Frame Data bytes, escaping them and adding them to the checksum
+    void frameWrite(const uint8_t* data, uint16_t length);
+
+	//! It sends the checksum which closes the frame
+    void frameEnd();
+
+	//! It sends an API frame made of a header (Frame Type to the RF Data)
+	//! and a payload (the RF Data)
+    void sendFrame(	const uint8_t* header,
+					uint16_t header_length,
+					const uint8_t* payload,
+					uint16_t payload_length);
+
+	//! It initializes an API frame decoder
+    void decoderInit(xbeeDecoder_t* decoder);
+
+	//! It decodes a byte read from the UART into 'buffer'
+  	/*!
+    \param xbeeDecoder_t* decoder : decoder state
+    \param uint8_t* buffer : where frames are stored, un-escaped
+    \param uint16_t size : size of 'buffer'
+    \param uint8_t data : byte read
+	\return XBEE_DECODE_NONE, XBEE_DECODE_START or XBEE_DECODE_FRAME
+	*/
+    uint8_t decodeFrameByte(xbeeDecoder_t* decoder,
+							uint8_t* buffer,
+							uint16_t size,
+							uint8_t data);
+
+	//! It gets the payload of a frame, which depends on the protocol, the
+	//! encryption, the sending mode and the addressing
+  	/*!
+    \param uint8_t mode : UNICAST or BROADCAST
+    \param uint8_t address_type : _16B or _64B (XBee-802.15.4)
+	\return maximum number of data bytes in a frame
+	*/
+    uint16_t getMaxPayload(uint8_t mode, uint8_t address_type);
+
 	//! It parses the AT command answer received by the XBee module
   	/*!
       \param uint8_t* data_in : the string that contains the eschaped API frame AT command
@@ -1929,6 +2216,11 @@ protected:
 	 */
 	uint8_t frameNext;
 
+	//! Variable : checksum of the API frame being sent
+  	/*!
+	 */
+	uint8_t tx_checksum;
+
 	//! Variable : specifies if APS encryption is enabled or disabled
   	/*!
 	 */
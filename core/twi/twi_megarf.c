@@ -74,6 +74,9 @@ static struct {
 static volatile bool twi_master_busy = false;
 static volatile bool twi_mode = MASTER;
 
+/** Called from the interrupt when a master transfer ends */
+static twi_master_callback_t twi_master_callback = NULL;
+
 /**
  * \ingroup group_megarf_drivers_twi
  * \defgroup group_megarf_drivers_twim twi master Driver
@@ -119,15 +122,31 @@ static volatile bool twi_mode = MASTER;
  */
 
 /**
- * \brief Reset TWI bus
+ * \internal
  *
- * \param none.
+ * \brief End of a master transfer, the completion callback is notified
+ *
+ * \param status - transfer result.
+ */
+static void twi_master_complete(status_code_t status)
+{
+	master_transfer.state  = TWI_IDLE;
+	master_transfer.status = status;
+	twi_master_busy        = false;
+	if (twi_master_callback != NULL) {
+		twi_master_callback(status);
+	}
+}
+
+/**
+ * \internal
+ *
+ * \brief TWI Master bus reset, the transfer ends with the given status
  */
-static void twi_master_bus_reset(void)
+static void twi_master_bus_reset(status_code_t status)
 {
-	master_transfer.state = TWI_IDLE;
-	twi_master_busy      = false;
 	twi_reset();
+	twi_master_complete(status);
 }
 
 /**
@@ -141,12 +160,9 @@ static void twi_master_read_last_byte(uint8_t data)
 	if (TWI_READ_DATA == master_transfer.state) {
 		master_transfer.pkg->buffer[master_transfer.data_count++] = data;
 		twi_send_stop();
-		master_transfer.state = TWI_IDLE;
-		master_transfer.status = STATUS_OK;
-		twi_master_busy  = false;
+		twi_master_complete(STATUS_OK);
 	} else { /* abnormal */
-		twi_master_bus_reset();
-		master_transfer.status = ERR_PROTOCOL;
+		twi_master_bus_reset(ERR_PROTOCOL);
 	}
 }
 
@@ -165,8 +181,7 @@ static void twi_master_read_done(uint8_t data)
 			twi_send_ack(false); /* send NACK */
 		}
 	} else { /* abnormal */
-		twi_master_bus_reset();
-		master_transfer.status = ERR_PROTOCOL;
+		twi_master_bus_reset(ERR_PROTOCOL);
 	}
 }
 
@@ -185,8 +200,7 @@ static void twi_master_addr_ack(void)
 			twi_send_ack(true); /* send ack */
 		}
 	} else { /* abnormal */
-		twi_master_bus_reset();
-		master_transfer.status = ERR_PROTOCOL;
+		twi_master_bus_reset(ERR_PROTOCOL);
 	}
 }
 
@@ -223,9 +237,7 @@ static void twi_master_data_write(void)
 		twi_write_byte(master_transfer.pkg->buffer[master_transfer.data_count++]);
 	} else {
 		twi_send_stop();
-		master_transfer.state = TWI_IDLE;
-		master_transfer.status = STATUS_OK;
-		twi_master_busy = false;
+		twi_master_complete(STATUS_OK);
 	}
 }
 
@@ -245,8 +257,7 @@ static void twi_master_write_done(void)
 	} else if (TWI_READ_DATA == master_transfer.state) {
 		twi_send_start();
 	} else { /* abnormal */
-		twi_master_bus_reset();
-		master_transfer.status = ERR_PROTOCOL;
+		twi_master_bus_reset(ERR_PROTOCOL);
 	}
 }
 
@@ -270,20 +281,21 @@ static void twi_master_start(void)
 		chip_add = TWI_READ_ENABLE(master_transfer.pkg->chip);
 		twi_write_byte(chip_add);
 	} else { /* abnormal */
-		twi_master_bus_reset();
-		master_transfer.status = ERR_PROTOCOL;
+		twi_master_bus_reset(ERR_PROTOCOL);
 	}
 }
 
 /**
- * \brief Perform a TWI master write transfer.
+ * \brief Start a TWI master write transfer without waiting for it.
  *
- * This function is a TWI Master write transaction.
+ * The end of the transfer is notified to the callback set with
+ * twi_master_set_callback(), or it can be polled with twi_master_is_busy().
  *
  * \param package -  Package information and data
- *                  (see \ref twi_package_t)
+ *                  (see \ref twi_package_t). It must stay valid until the
+ *                  transfer ends.
  */
-status_code_t twi_master_write(volatile void *twi,const twi_package_t *package)
+status_code_t twi_master_write_async(volatile void *twi,const twi_package_t *package)
 {
 	/* Do a sanity check on the arguments. */
 	if (package == NULL) {
@@ -298,6 +310,7 @@ status_code_t twi_master_write(volatile void *twi,const twi_package_t *package)
 	master_transfer.pkg         = (twi_package_t *)package;
 	master_transfer.addr_count  = 0;
 	master_transfer.data_count  = 0;
+	master_transfer.status      = OPERATION_IN_PROGRESS;
 	twi_master_busy      = true;
 
 	if (TWI_SLAVE_NO_INTERNAL_ADDRESS == master_transfer.pkg->addr_length) {
@@ -308,23 +321,17 @@ status_code_t twi_master_write(volatile void *twi,const twi_package_t *package)
 
 	twi_send_start();
 
-	// init timeout counter
-	twi_tout(1);
-
-	/* Wait for the transaction to complete */
-	while(twi_master_busy){
-		if (twi_tout(0)) break;
-	}
-	
-	return twi_master_get_status();
+	return STATUS_OK;
 }
 
 /**
- * \brief Reads the series of bytes from the TWI bus
+ * \brief Start a TWI master read transfer without waiting for it.
+ *
  * \param package -  Package information and data
- *                  (see \ref twi_package_t)
+ *                  (see \ref twi_package_t). It must stay valid until the
+ *                  transfer ends.
  */
-status_code_t twi_master_read(volatile void *twi,const twi_package_t *package)
+status_code_t twi_master_read_async(volatile void *twi,const twi_package_t *package)
 {
 	/* Do a sanity check on the arguments. */
 	if ((package == NULL) || package->length == 0) {
@@ -340,6 +347,7 @@ status_code_t twi_master_read(volatile void *twi,const twi_package_t *package)
 	master_transfer.pkg         = (twi_package_t *)package;
 	master_transfer.addr_count  = 0;
 	master_transfer.data_count  = 0;
+	master_transfer.status      = OPERATION_IN_PROGRESS;
 	twi_master_busy      = true;
 
 	if (TWI_SLAVE_NO_INTERNAL_ADDRESS == master_transfer.pkg->addr_length) {
@@ -349,8 +357,49 @@ status_code_t twi_master_read(volatile void *twi,const twi_package_t *package)
 	}
 
 	twi_send_start();
-    
-    // init timeout counter
+
+	return STATUS_OK;
+}
+
+/**
+ * \brief Perform a TWI master write transfer.
+ *
+ * This function is a TWI Master write transaction.
+ *
+ * \param package -  Package information and data
+ *                  (see \ref twi_package_t)
+ */
+status_code_t twi_master_write(volatile void *twi,const twi_package_t *package)
+{
+	status_code_t status = twi_master_write_async(twi, package);
+	if (status != STATUS_OK) {
+		return status;
+	}
+
+	// init timeout counter
+	twi_tout(1);
+
+	/* Wait for the transaction to complete */
+	while(twi_master_busy){
+		if (twi_tout(0)) break;
+	}
+	
+	return twi_master_get_status();
+}
+
+/**
+ * \brief Reads the series of bytes from the TWI bus
+ * \param package -  Package information and data
+ *                  (see \ref twi_package_t)
+ */
+status_code_t twi_master_read(volatile void *twi,const twi_package_t *package)
+{
+	status_code_t status = twi_master_read_async(twi, package);
+	if (status != STATUS_OK) {
+		return status;
+	}
+
+	// init timeout counter
 	twi_tout(1);
     
 	/* Wait for the transaction to complete */
@@ -372,6 +421,37 @@ status_code_t twi_master_get_status(void)
 	return master_transfer.status;
 }
 
+/**
+ * \brief Whether a master transfer is in progress.
+ */
+bool twi_master_is_busy(void)
+{
+	return twi_master_busy;
+}
+
+/**
+ * \brief Set the function called from the TWI interrupt when a master
+ * transfer ends (NULL to disable it).
+ *
+ * \param callback - it receives the status of the transfer.
+ */
+void twi_master_set_callback(twi_master_callback_t callback)
+{
+	twi_master_callback = callback;
+}
+
+/**
+ * \brief Abort the master transfer in progress, i.e. after a timeout.
+ *
+ * \param status - status reported for the aborted transfer.
+ */
+void twi_master_abort(status_code_t status)
+{
+	if (twi_master_busy) {
+		twi_master_bus_reset(status);
+	}
+}
+
 /**
  * \brief Inits TWI module as master
  *
@@ -631,8 +711,7 @@ static void twi_interrupt_handler(void)
 	                                        *has been received.*/
 	case TWS_MR_SLA_NACK:  /*SLA+R has been transmitted; NOT ACK has
 	                                       *been received.*/
-		twi_master_bus_reset();
-		master_transfer.status = ERR_IO_ERROR;
+		twi_master_bus_reset(ERR_IO_ERROR);
 		break;
 
 	case TWS_MR_SLA_ACK:  /*SLA+R has been transmitted; ACK has been
@@ -656,9 +735,7 @@ static void twi_interrupt_handler(void)
 	    /* If arbitration lost indicate to application to decide either
 		 * switch to Slave mode or wait until the bus is free and transmit
 		 * a new START condition */
-	    master_transfer.state = TWI_IDLE; 
-		master_transfer.status = ERR_BUSY;
-		twi_master_busy = false;
+		twi_master_complete(ERR_BUSY);
 		break;
 
 	case TWS_ST_SLA_ACK:        /* Own SLA+R has been received; ACK has been
@@ -733,9 +810,7 @@ static void twi_interrupt_handler(void)
 	default:
 	    if(twi_mode == MASTER)
 		{
-			master_transfer.state = TWI_IDLE;
-			master_transfer.status = ERR_PROTOCOL;
-			twi_master_busy = false;
+			twi_master_complete(ERR_PROTOCOL);
 		}
 		else
 		{
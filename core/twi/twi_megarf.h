@@ -346,6 +346,11 @@ static inline void twi_send_start(void)
 	TWCR = ((1 << TWSTA) | (1 << TWINT) | (1 << TWEN) | (1 << TWIE));
 }
 
+/**
+ * \brief Function called from the TWI interrupt when a master transfer ends
+ */
+typedef void (*twi_master_callback_t)(status_code_t status);
+
 /**
  * \brief Perform a TWI master write transfer.
  *
@@ -356,6 +361,35 @@ static inline void twi_send_start(void)
  */
 status_code_t twi_master_write(volatile void *twi,const twi_package_t *package);
 
+/**
+ * \brief Start a TWI master write transfer without waiting for it.
+ * \param package -  Package information and data
+ *                  (see \ref twi_package_t)
+ */
+status_code_t twi_master_write_async(volatile void *twi,const twi_package_t *package);
+
+/**
+ * \brief Start a TWI master read transfer without waiting for it.
+ * \param package -  Package information and data
+ *                  (see \ref twi_package_t)
+ */
+status_code_t twi_master_read_async(volatile void *twi,const twi_package_t *package);
+
+/**
+ * \brief Whether a master transfer is in progress.
+ */
+bool twi_master_is_busy(void);
+
+/**
+ * \brief Set the function called when a master transfer ends.
+ */
+void twi_master_set_callback(twi_master_callback_t callback);
+
+/**
+ * \brief Abort the master transfer in progress.
+ */
+void twi_master_abort(status_code_t status);
+
 /**
  * \brief Reads the series of bytes from the TWI bus
  * \param package -  Package information and data
@@ -114,12 +114,20 @@ void off_watchdog(void)
 // Must be volatile or gcc will optimize away some uses of it.
 volatile unsigned long timer0_overflow_count;
 volatile unsigned long timer0_millis = 0;
+// wraps of timer0_overflow_count (every 55 days), so micros64() never wraps
+volatile uint8_t timer0_overflow_high = 0;
+
+// microseconds slept with timer 0 stopped, added by WaspPWR when waking up
+unsigned long long timebase_sleep_us = 0;
 
 
 ISR(TIMER0_OVF_vect)
 {
 	
-	timer0_overflow_count++;
+	if (++timer0_overflow_count == 0)
+	{
+		timer0_overflow_high++;
+	}
 }
 
 // The number of times timer 1 has overflowed since the program started.
@@ -156,6 +164,56 @@ unsigned long millis()
 	return (unsigned long)m;
 }
 
+/* micros64() - monotonic microseconds since start up. Unlike millis() it
+ * includes the time slept in power down mode (see timebaseAddSleep()), so it
+ * can measure intervals spanning PWR.sleep() and PWR.deepSleep(). While awake
+ * the resolution is one timer 0 tick (64 cycles, 4.34 us)
+ */
+unsigned long long micros64()
+{
+	unsigned long overflows;
+	uint8_t high;
+	uint8_t ticks;
+	uint8_t oldSREG = SREG;
+
+	cli();
+	overflows = timer0_overflow_count;
+	high = timer0_overflow_high;
+	ticks = TCNT0;
+
+	// the counter has just wrapped but the interrupt is still pending
+	if ((TIFR0 & _BV(TOV0)) && (ticks < 255))
+	{
+		if (++overflows == 0)
+		{
+			high++;
+		}
+	}
+	SREG = oldSREG;
+
+	// one overflow is 256 * 64 cycles = 10000/9 us at 14.7456 MHz, and one
+	// tick 625/144 us. Only 32-bit divisions: 2^32 overflows are
+	// 4772185884444.4 us
+	unsigned long long us = (unsigned long long)(overflows / 9) * 10000UL;
+	us += ((overflows % 9) * 10000UL) / 9;
+	us += ((unsigned long)ticks * 625UL) / 144;
+	us += (unsigned long long)high * 4772185884444ULL;
+
+	return us + timebase_sleep_us;
+}
+
+/* timebaseAddSleep() - adds to micros64() the time slept with timer 0
+ * stopped. It is called by WaspPWR after waking up
+ */
+void timebaseAddSleep(unsigned long long us)
+{
+	uint8_t oldSREG = SREG;
+
+	cli();
+	timebase_sleep_us += us;
+	SREG = oldSREG;
+}
+
 unsigned long millisTim2()
 {
 	// timer 1 increments every 64 cycles, and overflows when it reaches
@@ -182,6 +240,32 @@ void delay(unsigned long ms)
 	}
 }
 
+/* delayIdle() - waits like delay() but sleeping in idle mode until the next
+ * interrupt (the timer 0 overflow, every 1.1 ms, at most) instead of spinning.
+ * Idle mode keeps the timers, UARTs, SPI, TWI and ADC running, so received
+ * bytes and transfers in progress are not affected. Power-save mode would
+ * stop them (timer 2 is not clocked asynchronously), so it is not used.
+ * With interrupts disabled nothing would wake the CPU up: it spins as delay()
+ */
+void delayIdle(unsigned long ms)
+{
+	unsigned long start = millis();
+
+	if (bit_is_clear(SREG, SREG_I))
+	{
+		delay(ms);
+		return;
+	}
+
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	while (millis() - start < ms)
+	{
+		sleep_enable();
+		sleep_cpu();
+		sleep_disable();
+	}
+}
+
 /* Delay for the given number of microseconds.  Assumes a 16 MHz clock. 
  * Disables interrupts, which will disrupt the millis() function if used
  * too frequently. */
@@ -84,6 +84,9 @@ void digitalWrite(uint8_t, uint8_t);
 int digitalRead(uint8_t);
 void analogReference(uint8_t mode);
 int analogRead(uint8_t);
+uint16_t analogReadOversampled(uint8_t pin, uint8_t extra_bits);
+void analogScan(const uint8_t* pins, uint8_t count, uint16_t* results, uint8_t extra_bits);
+void analogNoiseReduction(uint8_t enable);
 void analogWrite(uint8_t, int);
 
 void beginSerial(long, uint8_t);
@@ -91,7 +94,10 @@ void closeSerial(uint8_t);
 void serialWrite(unsigned char, uint8_t);
 int serialAvailable(uint8_t);
 int serialRead(uint8_t);
+int serialPeek(uint8_t);
 void serialFlush(uint8_t);
+void serialDrain(uint8_t);
+int serialAvailableForWrite(uint8_t);
 void printMode(int, uint8_t);
 void printByte(unsigned char c, uint8_t);
 void printNewline(uint8_t);
@@ -105,7 +111,10 @@ void puthex(char ch, uint8_t portNum);
 
 unsigned long millis(void);
 unsigned long millisTim2(void);
+unsigned long long micros64(void);
+void timebaseAddSleep(unsigned long long us);
 void delay(unsigned long);
+void delayIdle(unsigned long);
 void delayMicroseconds(unsigned int us);
 //void wait(unsigned long);
 void wait(uint8_t);
@@ -137,6 +146,7 @@ void clearIntFlag();
 
 void wakeUpNowDefault(void);
 
+extern volatile uint8_t f_wdt;
 void setup_watchdog(uint8_t);
 void off_watchdog(void);
 
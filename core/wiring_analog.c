@@ -23,10 +23,31 @@
 
 #include "wiring_private.h"
 #include "pins_waspmote.h"
+#include <avr/sleep.h>
 
 
 uint8_t analog_reference = DEFAULT;
 
+// sleep mode used while a conversion is in progress: SLEEP_MODE_IDLE keeps
+// the UARTs and timers running; SLEEP_MODE_ADC (noise reduction) also halts
+// clkIO, so bytes arriving on the UARTs are lost and millis() stops
+static uint8_t analog_sleep_mode = SLEEP_MODE_IDLE;
+
+// state of the conversions chained by the ADC interrupt
+static volatile struct
+{
+	const uint8_t* pins;
+	uint16_t* results;
+	uint8_t count;
+	uint8_t index;
+	uint8_t shift;
+	uint8_t discard;
+	uint16_t samples;
+	uint16_t remaining;
+	uint32_t sum;
+	uint8_t busy;
+} analog_scan;
+
 
 /*! 
  * @brief	This function sets the analog_reference for ADC conversion
@@ -121,6 +142,182 @@ int analogRead(uint8_t pin)
 	return (high << 8) | low;
 }
 
+/*! 
+ * @brief	This function selects the sleep mode entered while waiting for
+ * 			the conversions of analogReadOversampled() and analogScan()
+ * @param 	uint8_t enable:
+ * 	@arg	0: idle sleep (default), the UARTs and timers keep running
+ * 	@arg	1: ADC Noise Reduction sleep, which halts the I/O clock during
+ * 			the conversion. Do not use it while data may be received on
+ * 			any UART, and note millis() does not advance while converting
+ * @return	void
+ * 
+ */
+void analogNoiseReduction(uint8_t enable)
+{
+	analog_sleep_mode = enable ? SLEEP_MODE_ADC : SLEEP_MODE_IDLE;
+}
+
+
+/*! 
+ * @brief	ADC conversion complete: it accumulates the sample and, when the
+ * 			current channel has all its samples, stores the decimated result
+ * 			and selects the next channel of the scan list. The next
+ * 			conversion is started by analogScan() when it goes back to sleep
+ */
+static void analogConversionComplete(void)
+{
+	// ADCL is read first, as in analogRead()
+	uint16_t value = ADCL;
+	value |= (uint16_t)ADCH << 8;
+
+	if (analog_scan.discard)
+	{
+		// first conversion after a channel change, the sample and hold
+		// capacitor may still hold the previous channel
+		analog_scan.discard = 0;
+		return;
+	}
+
+	analog_scan.sum += value;
+	if (--analog_scan.remaining > 0)
+	{
+		return;
+	}
+
+	analog_scan.results[analog_scan.index] = (uint16_t)(analog_scan.sum >> analog_scan.shift);
+
+	if (++analog_scan.index >= analog_scan.count)
+	{
+		cbi(ADCSRA, ADIE);
+		analog_scan.busy = 0;
+		return;
+	}
+
+	ADMUX = (ADMUX & 0xf0) | (analogInPinToBit(analog_scan.pins[analog_scan.index]) & 0x0f);
+	analog_scan.sum = 0;
+	analog_scan.remaining = analog_scan.samples;
+	analog_scan.discard = 1;
+}
+
+ISR(ADC_vect)
+{
+	analogConversionComplete();
+}
+
+
+/*! 
+ * @brief	This function converts a list of analog pins, oversampling each
+ * 			of them. The CPU sleeps while the ADC converts instead of
+ * 			polling ADSC, and every conversion complete interrupt chains the
+ * 			next one. 4^extra_bits samples are added per pin and the sum is
+ * 			shifted right extra_bits times (decimation), so the result has
+ * 			10 + extra_bits bits when the signal carries enough noise to
+ * 			dither the conversions, or a 10-bit average scaled up otherwise
+ * @param 	const uint8_t* pins: analog pins to convert, in order
+ * @param 	uint8_t count: number of pins in 'pins'
+ * @param 	uint16_t* results: one result per pin, from 0 to
+ * 			(1024 << extra_bits) - 1
+ * @param 	uint8_t extra_bits: extra resolution bits, from 0 to 6
+ * @return	void
+ * 
+ */
+void analogScan(const uint8_t* pins, uint8_t count, uint16_t* results, uint8_t extra_bits)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	if (extra_bits > 6)
+	{
+		extra_bits = 6;
+	}
+
+	// enables the ADC
+	sbi(ADCSRA, ADEN);
+
+	analog_scan.pins = pins;
+	analog_scan.results = results;
+	analog_scan.count = count;
+	analog_scan.index = 0;
+	analog_scan.shift = extra_bits;
+	analog_scan.samples = (uint16_t)1 << (2 * extra_bits);
+	analog_scan.remaining = analog_scan.samples;
+	analog_scan.sum = 0;
+	analog_scan.discard = 1;
+	analog_scan.busy = 1;
+
+	ADMUX = (ADMUX & 0xf0) | (analogInPinToBit(pins[0]) & 0x0f);
+
+	// the conversion of a previous analogRead() is over, so no stale
+	// interrupt flag is pending (ADIF is cleared writing a one)
+	sbi(ADCSRA, ADIF);
+
+	// with global interrupts disabled nothing would wake the CPU, so the
+	// conversions are polled
+	if (bit_is_clear(SREG, SREG_I))
+	{
+		while (analog_scan.busy)
+		{
+			sbi(ADCSRA, ADSC);
+			while (bit_is_clear(ADCSRA, ADIF));
+			sbi(ADCSRA, ADIF);
+			analogConversionComplete();
+		}
+		return;
+	}
+
+	sbi(ADCSRA, ADIE);
+	set_sleep_mode(analog_sleep_mode);
+
+	while (true)
+	{
+		cli();
+		if (!analog_scan.busy)
+		{
+			sei();
+			break;
+		}
+
+		// in ADC Noise Reduction mode the conversion starts when entering
+		// sleep; in idle mode it is started here. Other interrupts (timers,
+		// UARTs) also wake the CPU, then it goes back to sleep until the
+		// ADC interrupt arrives
+		if ((analog_sleep_mode != SLEEP_MODE_ADC) && bit_is_clear(ADCSRA, ADSC))
+		{
+			sbi(ADCSRA, ADSC);
+		}
+
+		// sei() takes effect after the next instruction, so the ADC
+		// interrupt cannot be missed between the check and the sleep
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+}
+
+
+/*! 
+ * @brief	This function reads an analog pin with oversampling and
+ * 			decimation (see analogScan)
+ * @param 	uint8_t pin: input analog pin to read from
+ * @param 	uint8_t extra_bits: extra resolution bits, from 0 to 6; it takes
+ * 			4^extra_bits conversions (plus one discarded after the channel
+ * 			change), about 100us each
+ * @return	analog value from 0 to (1024 << extra_bits) - 1
+ * 
+ */
+uint16_t analogReadOversampled(uint8_t pin, uint8_t extra_bits)
+{
+	uint16_t result = 0;
+
+	analogScan(&pin, 1, &result, extra_bits);
+	return result;
+}
+
+
 // Right now, PWM output only works on the pins with
 // hardware support.  These are defined in the appropriate
 // pins_*.c file.  For the rest of the pins, we default
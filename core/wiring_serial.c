@@ -40,10 +40,38 @@
 	int rx_buffer_head1 = 0;
 	int rx_buffer_tail1 = 0;
 
+// Transmission on UART0 (USB and SOCKET0) is queued and sent from the data
+// register empty interrupt, so the caller does not wait for every byte at
+// 115200 bps. tx_buffer_head0 is where the next byte is queued and
+// tx_buffer_tail0 the next byte to send. UART1 is still written directly.
+#define TX_BUFFER_SIZE_0 128
+
+	unsigned char tx_buffer0[TX_BUFFER_SIZE_0];
+	volatile uint8_t tx_buffer_head0 = 0;
+	volatile uint8_t tx_buffer_tail0 = 0;
+	// a byte has been written since the last serialDrain()
+	volatile uint8_t tx_written0 = 0;
+
+// it moves the next queued byte to the data register, which must be empty
+static void serialSendNext0(void)
+{
+	UDR0 = tx_buffer0[tx_buffer_tail0];
+	tx_buffer_tail0 = (tx_buffer_tail0 + 1) % TX_BUFFER_SIZE_0;
+
+	// clear TXC0 (writing a one), leaving the other flags untouched
+	UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+
+	if (tx_buffer_head0 == tx_buffer_tail0) {
+		cbi(UCSR0B, UDRIE0);
+	}
+}
+
 // connects the internal peripheral in the processor and configures it
 void beginSerial(long baud, uint8_t portNum)
 {
 	if (portNum == 0) {
+		// the queued bytes go out with the previous baud rate
+		serialDrain(0);
 		setIPF_(IPUSART0);
 		UBRR0H = ((F_CPU / 16 + baud / 2) / baud - 1) >> 8;
 		UBRR0L = ((F_CPU / 16 + baud / 2) / baud - 1);
@@ -75,6 +103,7 @@ void beginSerial(long baud, uint8_t portNum)
 void closeSerial(uint8_t portNum)
 {
 	if (portNum == 0) {
+		serialDrain(0);
 		// turn off the internal peripheral, but also the interface
 		// resetIPF is just turning off the clock, what is not helping
 		// to save power, you gotta get rid of all the pull-ups in the sytem
@@ -94,10 +123,20 @@ void closeSerial(uint8_t portNum)
 void serialWrite(unsigned char c, uint8_t portNum)
 {
 	if (portNum == 0) {
-		while (!(UCSR0A & (1 << UDRE0)))
-			;
+		uint8_t i = (tx_buffer_head0 + 1) % TX_BUFFER_SIZE_0;
+
+		// the queue is full: wait for the interrupt to make room, or send
+		// the bytes from here if the interrupts are disabled
+		while (i == tx_buffer_tail0) {
+			if (bit_is_clear(SREG, SREG_I) && (UCSR0A & (1 << UDRE0))) {
+				serialSendNext0();
+			}
+		}
 
-		UDR0 = c;
+		tx_buffer0[tx_buffer_head0] = c;
+		tx_buffer_head0 = i;
+		tx_written0 = 1;
+		sbi(UCSR0B, UDRIE0);
 	} else {
 		while (!(UCSR1A & (1 << UDRE1)))
 			;
@@ -138,6 +177,56 @@ int serialRead(uint8_t portNum)
 	}
 }
 
+int serialPeek(uint8_t portNum)
+{
+	if (portNum == 0) {
+		if (rx_buffer_head0 == rx_buffer_tail0) {
+			return -1;
+		} else {
+			return rx_buffer0[rx_buffer_tail0];
+		}
+	}
+	else {
+		if (rx_buffer_head1 == rx_buffer_tail1) {
+			return -1;
+		} else {
+			return rx_buffer1[rx_buffer_tail1];
+		}
+	}
+}
+
+// it waits until the bytes queued on UART0 have been completely sent,
+// i.e. before switching the multiplexer, the baud rate or sleeping
+void serialDrain(uint8_t portNum)
+{
+	if (portNum != 0) {
+		return;
+	}
+
+	while (tx_buffer_head0 != tx_buffer_tail0) {
+		if (bit_is_clear(SREG, SREG_I) && (UCSR0A & (1 << UDRE0))) {
+			serialSendNext0();
+		}
+	}
+
+	// the last byte leaves the shift register; nothing to wait for if the
+	// transmitter was disabled meanwhile
+	if (tx_written0) {
+		while (bit_is_set(UCSR0B, TXEN0) && !(UCSR0A & (1 << TXC0)))
+			;
+		tx_written0 = 0;
+	}
+}
+
+// it returns the free room in the UART0 transmission queue
+int serialAvailableForWrite(uint8_t portNum)
+{
+	if (portNum != 0) {
+		return 0;
+	}
+	return (TX_BUFFER_SIZE_0 - 1) - ((TX_BUFFER_SIZE_0 + tx_buffer_head0 - tx_buffer_tail0) % TX_BUFFER_SIZE_0);
+}
+
 void serialFlush(uint8_t portNum)
 {
 	// don't reverse this or there may be problems if the RX interrupt
@@ -171,6 +260,15 @@ ISR(USART0_RX_vect)
 		}
 }
 
+ISR(USART0_UDRE_vect)
+{
+	if (tx_buffer_head0 == tx_buffer_tail0) {
+		cbi(UCSR0B, UDRIE0);
+	} else {
+		serialSendNext0();
+	}
+}
+
 ISR(USART1_RX_vect)
 {
 		unsigned char c = UDR1;
@@ -0,0 +1,116 @@
+/*! \file EepromConfig.cpp
+    \brief Versioned, CRC protected configuration block stored in EEPROM
+ */
+
+#include "EepromConfig.h"
+#include <util/crc16.h>
+
+#ifndef __WPROGRAM_H__
+	#include <WaspClasses.h>
+#endif
+
+
+EepromConfig::EepromConfig(int address, uint8_t version, uint16_t size)
+{
+	_address = address;
+	_version = version;
+	_size = size;
+}
+
+
+/*
+ * update: it writes 'data' skipping the bytes which already hold the same
+ * value, to save time and EEPROM wear
+ */
+void EepromConfig::update(int address, const uint8_t* data, uint16_t length)
+{
+	for (uint16_t i = 0; i < length; i++)
+	{
+		if (Utils.readEEPROM(address + i) != data[i])
+		{
+			Utils.writeEEPROM(address + i, data[i]);
+		}
+	}
+}
+
+
+uint16_t EepromConfig::crc(const void* data, uint16_t length)
+{
+	const uint8_t* pointer = (const uint8_t*)data;
+	uint16_t value = 0xFFFF;
+
+	for (uint16_t i = 0; i < length; i++)
+	{
+		value = _crc_ccitt_update(value, pointer[i]);
+	}
+	return value;
+}
+
+
+bool EepromConfig::load(void* data)
+{
+	uint8_t header[EEPROM_CONFIG_HEADER_SIZE];
+	uint16_t crc_value = 0xFFFF;
+
+	Utils.readBlockEEPROM(_address, header, sizeof(header));
+
+	if ((header[0] != EEPROM_CONFIG_MAGIC) ||
+		(header[1] != _version) ||
+		(*(uint16_t*)&header[2] != _size))
+	{
+		return false;
+	}
+
+	// check the payload before touching 'data'
+	for (uint16_t i = 0; i < _size; i++)
+	{
+		crc_value = _crc_ccitt_update(crc_value,
+			Utils.readEEPROM(_address + EEPROM_CONFIG_HEADER_SIZE + i));
+	}
+	if (crc_value != *(uint16_t*)&header[4])
+	{
+		return false;
+	}
+
+	Utils.readBlockEEPROM(_address + EEPROM_CONFIG_HEADER_SIZE, data, _size);
+	return true;
+}
+
+
+bool EepromConfig::save(const void* data)
+{
+	uint8_t header[EEPROM_CONFIG_HEADER_SIZE];
+	uint16_t crc_value = crc(data, _size);
+
+	header[0] = EEPROM_CONFIG_MAGIC;
+	header[1] = _version;
+	*(uint16_t*)&header[2] = _size;
+	*(uint16_t*)&header[4] = crc_value;
+
+	// invalidate first: a reset in the middle of the payload write must not
+	// leave a header which still matches
+	erase();
+	update(_address + EEPROM_CONFIG_HEADER_SIZE, (const uint8_t*)data, _size);
+	update(_address + 1, &header[1], sizeof(header) - 1);
+	update(_address, &header[0], 1);
+
+	// read back
+	for (uint16_t i = 0; i < _size; i++)
+	{
+		if (Utils.readEEPROM(_address + EEPROM_CONFIG_HEADER_SIZE + i) !=
+			((const uint8_t*)data)[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void EepromConfig::erase()
+{
+	if (Utils.readEEPROM(_address) != 0xFF)
+	{
+		Utils.writeEEPROM(_address, 0xFF);
+	}
+}
@@ -0,0 +1,79 @@
+/*! \file EepromConfig.h
+    \brief Versioned, CRC protected configuration block stored in EEPROM
+
+    The block is a header followed by the raw bytes of a configuration
+    structure defined by the application:
+
+        [magic][layout version][size (2 bytes)][crc16 (2 bytes)][payload]
+
+    A block is only loaded when magic, layout version and size match the
+    ones expected by the firmware and the CRC of the payload is correct, so
+    a firmware with a different structure layout or a write interrupted by
+    a reset never applies garbage.
+ */
+
+#ifndef EepromConfig_h
+#define EepromConfig_h
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <inttypes.h>
+
+/******************************************************************************
+ * Definitions & Declarations
+ ******************************************************************************/
+
+//! First byte of every configuration block
+#define EEPROM_CONFIG_MAGIC		0xC7
+
+//! Size of the header stored before the payload
+#define EEPROM_CONFIG_HEADER_SIZE	6
+
+/******************************************************************************
+ * Class
+ ******************************************************************************/
+
+class EepromConfig
+{
+private:
+
+	int _address;
+	uint8_t _version;
+	uint16_t _size;
+
+	void update(int address, const uint8_t* data, uint16_t length);
+
+public:
+
+	/*!
+	\param int address: EEPROM address of the block (>= EEPROM_START)
+	\param uint8_t version: layout version of the configuration structure
+	\param uint16_t size: size of the configuration structure
+	 */
+	EepromConfig(int address, uint8_t version, uint16_t size);
+
+	//! It reads the stored block into 'data'
+	/*!
+	\param void* data: destination, '_size' bytes long
+	\return 'true' if a valid block was read; 'false' otherwise ('data' is
+			left untouched)
+	 */
+	bool load(void* data);
+
+	//! It stores 'data'. Only the bytes which changed are written
+	/*!
+	\param const void* data: source, '_size' bytes long
+	\return 'true' if the block was verified after writing; 'false' otherwise
+	 */
+	bool save(const void* data);
+
+	//! It invalidates the stored block so defaults are used on next boot
+	void erase();
+
+	//! CRC16 (CCITT) of a buffer
+	static uint16_t crc(const void* data, uint16_t length);
+};
+
+#endif
@@ -0,0 +1,537 @@
+/*! \file HttpKeepAlive.cpp
+    \brief HTTP/1.1 keep-alive client over the Wasp4G TCP and SSL sockets
+ */
+
+#ifndef __WPROGRAM_H__
+#include <WaspClasses.h>
+#endif
+
+#include "HttpKeepAlive.h"
+#include <string.h>
+#include <stdlib.h>
+
+
+HttpKeepAlive::HttpKeepAlive(uint8_t socketId, bool secure)
+{
+	_socketId = socketId;
+	_secure = secure;
+	_host = NULL;
+	_port = 0;
+	_connected = false;
+	_inFlight = 0;
+	_index = 0;
+	_available = 0;
+	_closeAfter = false;
+	_peerClosed = false;
+	_bodyMode = HTTP_BODY_NONE;
+	_bodyRemaining = 0;
+	_peeked = -1;
+	_bodyError = false;
+}
+
+
+uint8_t HttpKeepAlive::open()
+{
+	uint8_t answer;
+
+	if (_secure)
+	{
+		answer = _4G.openSocketSSL(_socketId, (char*)_host, _port);
+	}
+	else
+	{
+		answer = _4G.openSocketClient(_socketId, Wasp4G::TCP, (char*)_host, _port,
+									  0, HTTP_KEEP_ALIVE_TCP_MINUTES);
+	}
+
+	_connected = (answer == 0);
+	_inFlight = 0;
+	_index = 0;
+	_available = 0;
+	_closeAfter = false;
+	_peerClosed = false;
+	_bodyMode = HTTP_BODY_NONE;
+	_peeked = -1;
+	return answer;
+}
+
+
+uint8_t HttpKeepAlive::connect(const char* host, uint16_t port)
+{
+	if (_connected)
+	{
+		if ((port == _port) && (strcmp(host, _host) == 0))
+		{
+			return 0;
+		}
+		close();
+	}
+
+	_host = host;
+	_port = port;
+	return open();
+}
+
+
+void HttpKeepAlive::close()
+{
+	if (_connected)
+	{
+		if (_secure)
+		{
+			_4G.closeSocketSSL(_socketId);
+		}
+		else
+		{
+			_4G.closeSocketClient(_socketId);
+		}
+	}
+
+	_connected = false;
+	_inFlight = 0;
+	_index = 0;
+	_available = 0;
+	_closeAfter = false;
+	_peerClosed = false;
+	_bodyMode = HTTP_BODY_NONE;
+	_bodyRemaining = 0;
+	_peeked = -1;
+	_bodyError = false;
+}
+
+
+/*
+ * send: send()/sendSSL() check the socket status first, so an error here
+ * also covers a connection closed by the server while idle
+ */
+uint8_t HttpKeepAlive::send(uint8_t* data, uint16_t length)
+{
+	if (_secure)
+	{
+		return _4G.sendSSL(_socketId, data, length);
+	}
+	return _4G.send(_socketId, data, length);
+}
+
+
+uint8_t HttpKeepAlive::post(const char* resource, const char* contentType, uint8_t* body, uint16_t length)
+{
+	char header[HTTP_KEEP_ALIVE_HEADER_SIZE];
+	int header_length;
+
+	if (!_connected)
+	{
+		return 1;
+	}
+
+	// the responses already received would be overwritten by the module
+	// answers to the send commands
+	if ((_inFlight >= HTTP_KEEP_ALIVE_PIPELINE_DEPTH) || (_available > 0) ||
+		(_bodyMode != HTTP_BODY_NONE))
+	{
+		return 2;
+	}
+
+	header_length = snprintf_P(header, sizeof(header),
+		PSTR("POST %s HTTP/1.1\r\n"
+			 "Host: %s\r\n"
+			 "Content-Type: %s\r\n"
+			 "Content-Length: %u\r\n"
+			 "Connection: keep-alive\r\n\r\n"),
+		resource, _host, contentType, (unsigned int)length);
+
+	if ((header_length < 0) || (header_length >= (int)sizeof(header)))
+	{
+		return 3;
+	}
+
+	// with nothing in flight nothing is lost by reopening the connection, so
+	// an idle connection dropped by the server is retried once
+	for (uint8_t retry = 0; retry < 2; retry++)
+	{
+		if ((send((uint8_t*)header, header_length) == 0) &&
+			((length == 0) || (send(body, length) == 0)))
+		{
+			_inFlight++;
+			return 0;
+		}
+
+		if ((_inFlight > 0) || (retry > 0))
+		{
+			break;
+		}
+
+		close();
+		if (open() != 0)
+		{
+			return 4;
+		}
+	}
+
+	close();
+	return 4;
+}
+
+
+/*
+ * readByte: it returns the next response byte, receiving a new block from
+ * the module when the previous one has been consumed; -1 if timeout or if
+ * the server closed the connection (_peerClosed)
+ */
+int HttpKeepAlive::readByte()
+{
+	uint8_t answer;
+	unsigned long previous = millis();
+
+	while (_available == 0)
+	{
+		if (_peerClosed)
+		{
+			return -1;
+		}
+
+		_4G._length = 0;
+
+		if (_secure)
+		{
+			// it waits for the data itself and reports "DISCONNECTED"
+			answer = _4G.receiveSSL(_socketId, HTTP_KEEP_ALIVE_TIMEOUT);
+			if (answer == 3)
+			{
+				_peerClosed = true;
+				return -1;
+			}
+		}
+		else
+		{
+			answer = _4G.receive(_socketId);
+			if (answer == 1)
+			{
+				// nothing pending: the bytes left in the module were read
+				// before, so a closed socket is the end of the data
+				if ((_4G.getSocketStatus(_socketId) == 0) &&
+					(_4G.socketStatus[_socketId].state == Wasp4G::STATUS_CLOSED))
+				{
+					_peerClosed = true;
+					return -1;
+				}
+				if ((millis() - previous) >= HTTP_KEEP_ALIVE_TIMEOUT)
+				{
+					return -1;
+				}
+				delayIdle(500);
+				continue;
+			}
+		}
+
+		if ((answer != 0) || (_4G._length == 0))
+		{
+			return -1;
+		}
+
+		_index = 0;
+		_available = _4G._length;
+	}
+
+	_available--;
+	return _4G._buffer[_index++];
+}
+
+
+/*
+ * readLine: it reads up to "\n" and stores the line without "\r\n",
+ * truncated to 'size'
+ */
+uint8_t HttpKeepAlive::readLine(char* line, uint8_t size)
+{
+	uint8_t length = 0;
+	int c;
+
+	while ((c = readByte()) >= 0)
+	{
+		if (c == '\n')
+		{
+			if ((length > 0) && (line[length - 1] == '\r'))
+			{
+				length--;
+			}
+			line[length] = '\0';
+			return 0;
+		}
+		if (length + 1 < size)
+		{
+			line[length++] = (char)c;
+		}
+	}
+
+	line[length] = '\0';
+	return 1;
+}
+
+
+/*
+ * bodyByte: it returns the next byte of the body, decoding the chunks;
+ * -1 at the end of the body or on error (_bodyError)
+ */
+int HttpKeepAlive::bodyByte()
+{
+	char line[HTTP_KEEP_ALIVE_LINE_SIZE];
+	int c;
+
+	switch (_bodyMode)
+	{
+		case HTTP_BODY_CHUNKED:
+			if (_bodyRemaining == 0)
+			{
+				// "\r\n" ending the previous chunk, then "<hex size>\r\n"
+				if ((!_firstChunk && (readLine(line, sizeof(line)) != 0)) ||
+					(readLine(line, sizeof(line)) != 0))
+				{
+					_bodyError = true;
+					_bodyMode = HTTP_BODY_NONE;
+					return -1;
+				}
+				_firstChunk = false;
+				_bodyRemaining = strtoul(line, NULL, 16);
+
+				if (_bodyRemaining == 0)
+				{
+					// last chunk: trailers up to the empty line
+					do
+					{
+						if (readLine(line, sizeof(line)) != 0)
+						{
+							_bodyError = true;
+							break;
+						}
+					}
+					while (line[0] != '\0');
+					_bodyMode = HTTP_BODY_NONE;
+					return -1;
+				}
+			}
+			// the chunk data is read as a body with length
+
+		case HTTP_BODY_LENGTH:
+			if (_bodyRemaining == 0)
+			{
+				_bodyMode = HTTP_BODY_NONE;
+				return -1;
+			}
+			c = readByte();
+			if (c < 0)
+			{
+				_bodyError = true;
+				_bodyMode = HTTP_BODY_NONE;
+				return -1;
+			}
+			_bodyRemaining--;
+			return c;
+
+		case HTTP_BODY_CLOSE:
+			// the body ends when the server closes the connection
+			c = readByte();
+			if (c < 0)
+			{
+				_bodyError = !_peerClosed;
+				_bodyMode = HTTP_BODY_NONE;
+			}
+			return c;
+
+		default:
+			return -1;
+	}
+}
+
+
+uint8_t HttpKeepAlive::readHeaders(uint16_t* status)
+{
+	char line[HTTP_KEEP_ALIVE_LINE_SIZE];
+	uint32_t content_length;
+	bool has_length;
+	bool chunked;
+
+	if (_inFlight == 0)
+	{
+		return 1;
+	}
+
+	// 1xx interim responses (i.e. "100 Continue") precede the final one
+	do
+	{
+		content_length = 0;
+		has_length = false;
+		chunked = false;
+
+		//// 1. Status line: "HTTP/1.1 200 OK"
+		if (readLine(line, sizeof(line)) != 0)
+		{
+			close();
+			return 2;
+		}
+		if ((strncmp_P(line, PSTR("HTTP/1."), 7) != 0) || (strlen(line) < 12))
+		{
+			close();
+			return 3;
+		}
+		*status = (uint16_t)atoi(&line[9]);
+
+		//// 2. Headers, up to the empty line
+		while (true)
+		{
+			if (readLine(line, sizeof(line)) != 0)
+			{
+				close();
+				return 2;
+			}
+			if (line[0] == '\0')
+			{
+				break;
+			}
+
+			if (strncasecmp_P(line, PSTR("Content-Length:"), 15) == 0)
+			{
+				content_length = strtoul(&line[15], NULL, 10);
+				has_length = true;
+			}
+			else if (strncasecmp_P(line, PSTR("Transfer-Encoding:"), 18) == 0)
+			{
+				chunked = (strstr_P(&line[18], PSTR("chunked")) != NULL);
+			}
+			else if (strncasecmp_P(line, PSTR("Connection:"), 11) == 0)
+			{
+				_closeAfter = (strstr_P(&line[11], PSTR("close")) != NULL);
+			}
+		}
+	}
+	while ((*status >= 100) && (*status < 200));
+
+	//// 3. How the body ends
+	_bodyRemaining = 0;
+	_peeked = -1;
+	_bodyError = false;
+
+	if (chunked)
+	{
+		// "<hex size>\r\n<data>\r\n" ... "0\r\n<trailers>\r\n"
+		_bodyMode = HTTP_BODY_CHUNKED;
+		_firstChunk = true;
+	}
+	else if (has_length)
+	{
+		_bodyMode = HTTP_BODY_LENGTH;
+		_bodyRemaining = content_length;
+	}
+	else if ((*status != 204) && (*status != 304))
+	{
+		_bodyMode = HTTP_BODY_CLOSE;
+		_closeAfter = true;
+	}
+	else
+	{
+		_bodyMode = HTTP_BODY_NONE;
+	}
+
+	return 0;
+}
+
+
+uint8_t HttpKeepAlive::endResponse()
+{
+	// the rest of the body
+	_peeked = -1;
+	while (bodyByte() >= 0);
+
+	if (_bodyError)
+	{
+		close();
+		return 2;
+	}
+
+	_inFlight--;
+
+	// requests pipelined after this one will not be answered
+	if (_closeAfter)
+	{
+		close();
+	}
+
+	return 0;
+}
+
+
+uint8_t HttpKeepAlive::readResponse(uint16_t* status, char* body, uint16_t size)
+{
+	uint16_t stored = 0;
+	uint8_t error;
+	int c;
+
+	if (body != NULL && size > 0)
+	{
+		body[0] = '\0';
+	}
+
+	error = readHeaders(status);
+	if (error != 0)
+	{
+		return error;
+	}
+
+	while ((c = read()) >= 0)
+	{
+		if ((body != NULL) && (stored + 1 < size))
+		{
+			body[stored++] = (char)c;
+		}
+	}
+
+	if (body != NULL && size > 0)
+	{
+		body[stored] = '\0';
+	}
+
+	return endResponse();
+}
+
+
+int HttpKeepAlive::available()
+{
+	if (_bodyMode == HTTP_BODY_NONE)
+	{
+		return (_peeked >= 0) ? 1 : 0;
+	}
+	if ((_bodyMode == HTTP_BODY_LENGTH) && (_bodyRemaining < _available))
+	{
+		return _bodyRemaining + ((_peeked >= 0) ? 1 : 0);
+	}
+	return _available + ((_peeked >= 0) ? 1 : 0);
+}
+
+
+int HttpKeepAlive::read()
+{
+	int c = _peeked;
+
+	if (c >= 0)
+	{
+		_peeked = -1;
+		return c;
+	}
+	return bodyByte();
+}
+
+
+int HttpKeepAlive::peek()
+{
+	if (_peeked < 0)
+	{
+		_peeked = bodyByte();
+	}
+	return _peeked;
+}
+
+
+size_t HttpKeepAlive::write(uint8_t data)
+{
+	return 0;
+}
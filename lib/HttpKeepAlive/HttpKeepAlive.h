@@ -0,0 +1,183 @@
+/*! \file HttpKeepAlive.h
+    \brief HTTP/1.1 keep-alive client over the Wasp4G TCP and SSL sockets
+
+    Wasp4G::http() configures the HTTP profile and opens a new connection for
+    every request, so draining a backlog of measures pays one TCP (and TLS)
+    handshake per POST. HttpKeepAlive writes the requests itself on a socket
+    opened once with openSocketClient() or openSocketSSL() and keeps it open
+    between requests ("Connection: keep-alive").
+
+    Requests can be pipelined: up to HTTP_KEEP_ALIVE_PIPELINE_DEPTH POSTs are
+    sent before reading the first response, and then the responses are read
+    in order with readResponse(). Responses are received into the Wasp4G
+    '_buffer', which is overwritten by any other module command, so a new
+    request can only be sent once the bytes already received have been
+    consumed, i.e. send a batch, read the whole batch, send the next one.
+
+    The body of a response can also be read as a Stream (i.e. by
+    JsonStreamFilter) between readHeaders() and endResponse(). 1xx interim
+    responses are skipped; a body with neither Content-Length nor chunked
+    encoding ends when the server closes the connection.
+
+    The socket is only reopened when the module reports it closed (server
+    idle timeout, "Connection: close" or a failed send).
+ */
+
+#ifndef HttpKeepAlive_h
+#define HttpKeepAlive_h
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <inttypes.h>
+#include <Wasp4G.h>
+
+/******************************************************************************
+ * Definitions & Declarations
+ ******************************************************************************/
+
+//! Maximum number of requests sent and waiting for their responses
+#define HTTP_KEEP_ALIVE_PIPELINE_DEPTH	4
+
+//! Milliseconds to wait for every new piece of a response
+#define HTTP_KEEP_ALIVE_TIMEOUT			30000UL
+
+//! Socket keep-alive requested to the module, in minutes (1 to 240)
+#define HTTP_KEEP_ALIVE_TCP_MINUTES		1
+
+//! Room for the request line and headers of a POST
+#define HTTP_KEEP_ALIVE_HEADER_SIZE		200
+
+//! Room for a response header line; longer lines are truncated
+#define HTTP_KEEP_ALIVE_LINE_SIZE		64
+
+//! How the body of the response being read ends
+#define HTTP_BODY_NONE		0
+#define HTTP_BODY_LENGTH	1
+#define HTTP_BODY_CHUNKED	2
+#define HTTP_BODY_CLOSE		3
+
+/******************************************************************************
+ * Class
+ ******************************************************************************/
+
+class HttpKeepAlive : public Stream
+{
+private:
+
+	uint8_t _socketId;
+	bool _secure;
+
+	const char* _host;
+	uint16_t _port;
+	bool _connected;
+
+	//! Requests sent whose response has not been read yet
+	uint8_t _inFlight;
+
+	//! Read position in the module '_buffer' and bytes left in it
+	uint16_t _index;
+	uint16_t _available;
+
+	//! The server asked to close the connection after the current response
+	bool _closeAfter;
+
+	//! The module reported the socket closed by the server
+	bool _peerClosed;
+
+	//! Body of the response being read: HTTP_BODY_x, bytes left in it (or
+	//! in the current chunk), byte peeked (-1 if none) and error reading it
+	uint8_t _bodyMode;
+	uint32_t _bodyRemaining;
+	bool _firstChunk;
+	int _peeked;
+	bool _bodyError;
+
+	uint8_t open();
+	uint8_t send(uint8_t* data, uint16_t length);
+	int readByte();
+	uint8_t readLine(char* line, uint8_t size);
+	int bodyByte();
+
+public:
+
+	//! class constructor
+	/*!
+	\param uint8_t socketId: socket of the module to use (Wasp4G::CONNECTION_1..6)
+	\param bool secure: 'true' for TLS (openSocketSSL), 'false' for plain TCP
+	 */
+	HttpKeepAlive(uint8_t socketId, bool secure);
+
+	//! It opens the connection to the server, or reuses the one already open
+	//! to the same host and port
+	/*!
+	\param const char* host: server name or IP address, it must stay valid
+			while the connection is used
+	\param uint16_t port: server port
+	\return '0' if OK; 'x' the error returned by the Wasp4G open function
+	 */
+	uint8_t connect(const char* host, uint16_t port);
+
+	//! It sends a POST request without waiting for its response
+	/*!
+	\param const char* resource: path of the request, i.e. "/api/Measure"
+	\param const char* contentType: i.e. "application/json"
+	\param uint8_t* body: request body
+	\param uint16_t length: length of 'body'
+	\return '0' if OK;
+			'1' if not connected;
+			'2' if the pipeline is full or response bytes are pending;
+			'3' if the request headers do not fit;
+			'4' if error sending (the connection is closed)
+	 */
+	uint8_t post(const char* resource, const char* contentType, uint8_t* body, uint16_t length);
+
+	//! It reads the response of the oldest request in flight
+	/*!
+	\param uint16_t* status: HTTP status code
+	\param char* body: buffer for the response body ('\0' terminated), or
+			NULL to discard it
+	\param uint16_t size: size of 'body'; the body is truncated to fit
+	\return '0' if OK;
+			'1' if no request is in flight;
+			'2' if timeout or connection lost;
+			'3' if the status line is not valid
+	 */
+	uint8_t readResponse(uint16_t* status, char* body, uint16_t size);
+
+	//! It reads the status line and the headers of the response of the
+	//! oldest request in flight. Its body is then read with the Stream
+	//! functions, which return -1 at its end, and endResponse() must follow
+	/*!
+	\param uint16_t* status: HTTP status code of the final response
+	\return '0' if OK;
+			'1' if no request is in flight;
+			'2' if timeout or connection lost;
+			'3' if the status line is not valid
+	 */
+	uint8_t readHeaders(uint16_t* status);
+
+	//! It discards the body bytes not read and ends the response
+	/*!
+	\return '0' if OK; '2' if timeout or connection lost
+	 */
+	uint8_t endResponse();
+
+	//! Body bytes received which can be read without waiting (for a chunked
+	//! body it includes the chunk sizes)
+	virtual int available();
+	virtual int read();
+	virtual int peek();
+	virtual size_t write(uint8_t data);
+
+	//! It closes the connection. Requests in flight are lost
+	void close();
+
+	//! Number of requests waiting for their response
+	uint8_t inFlight() { return _inFlight; }
+
+	bool connected() { return _connected; }
+};
+
+#endif
@@ -0,0 +1,397 @@
+/*! \file JsonStreamFilter.cpp
+    \brief Selective deserialization of JSON documents read from a Stream
+ */
+
+#include "JsonStreamFilter.h"
+
+#ifndef __WPROGRAM_H__
+	#include <WaspClasses.h>
+#endif
+
+
+static inline bool canBeInNonQuotedString(int c)
+{
+	return ((c >= '0') && (c <= '9')) || ((c >= '_') && (c <= 'z')) ||
+		((c >= 'A') && (c <= 'Z')) || (c == '+') || (c == '-') || (c == '.');
+}
+
+static inline bool isQuote(int c)
+{
+	return (c == '\'') || (c == '\"');
+}
+
+
+JsonStreamFilter::JsonStreamFilter(const char* const* keys, uint8_t count)
+{
+	_keys = keys;
+	_count = count;
+}
+
+
+/*
+ * wanted: it checks if 'key' is one of the filter keys
+ */
+bool JsonStreamFilter::wanted(const char* key)
+{
+	for (uint8_t i = 0; i < _count; i++)
+	{
+		if (strcmp(key, _keys[i]) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/*
+ * peekChar: it waits for the next char (up to the stream timeout) without
+ * consuming it. It returns -1 on timeout
+ */
+int JsonStreamFilter::peekChar(Stream& input)
+{
+	unsigned long previous = millis();
+	int c;
+
+	do
+	{
+		c = input.peek();
+		if (c >= 0)
+		{
+			return c;
+		}
+	}
+	while ((millis() - previous) < input.getTimeout());
+
+	return -1;
+}
+
+
+/*
+ * readChar: it reads the next char (up to the stream timeout).
+ * It returns -1 on timeout
+ */
+int JsonStreamFilter::readChar(Stream& input)
+{
+	char c;
+
+	if (input.readBytes(&c, 1) == 0)
+	{
+		return -1;
+	}
+	return (uint8_t)c;
+}
+
+
+DeserializationError JsonStreamFilter::skipSpaces(Stream& input)
+{
+	for (;;)
+	{
+		int c = peekChar(input);
+
+		if (c < 0)
+		{
+			return DeserializationError::IncompleteInput;
+		}
+		if ((c != ' ') && (c != '\t') && (c != '\r') && (c != '\n'))
+		{
+			return DeserializationError::Ok;
+		}
+		readChar(input);
+	}
+}
+
+
+/*
+ * skipString: it consumes a quoted string, including both quotes
+ */
+DeserializationError JsonStreamFilter::skipString(Stream& input)
+{
+	int stopChar = readChar(input);
+
+	for (;;)
+	{
+		int c = readChar(input);
+
+		if (c < 0)
+		{
+			return DeserializationError::IncompleteInput;
+		}
+		if (c == stopChar)
+		{
+			return DeserializationError::Ok;
+		}
+		if ((c == '\\') && (readChar(input) < 0))
+		{
+			return DeserializationError::IncompleteInput;
+		}
+	}
+}
+
+
+/*
+ * skipValue: it consumes a value of any type without storing it. Scalars
+ * are consumed up to their last char, so the delimiter is left in the stream
+ */
+DeserializationError JsonStreamFilter::skipValue(Stream& input)
+{
+	int c = peekChar(input);
+	uint8_t depth = 0;
+
+	if (c < 0)
+	{
+		return DeserializationError::IncompleteInput;
+	}
+
+	if (isQuote(c))
+	{
+		return skipString(input);
+	}
+
+	if ((c != '{') && (c != '['))
+	{
+		// scalar
+		while (canBeInNonQuotedString(c))
+		{
+			readChar(input);
+			c = peekChar(input);
+		}
+		return DeserializationError::Ok;
+	}
+
+	// object or array: keep track of the nesting until it is closed
+	do
+	{
+		c = peekChar(input);
+		if (c < 0)
+		{
+			return DeserializationError::IncompleteInput;
+		}
+
+		if (isQuote(c))
+		{
+			DeserializationError err = skipString(input);
+			if (err) return err;
+			continue;
+		}
+
+		readChar(input);
+		if ((c == '{') || (c == '['))
+		{
+			depth++;
+		}
+		else if ((c == '}') || (c == ']'))
+		{
+			depth--;
+		}
+	}
+	while (depth > 0);
+
+	return DeserializationError::Ok;
+}
+
+
+/*
+ * readKey: it reads a member key, quoted or not. Keys which do not fit in
+ * 'key' are returned empty, so they never match a filter key
+ */
+DeserializationError JsonStreamFilter::readKey(Stream& input, char* key, size_t size)
+{
+	size_t n = 0;
+	int c = peekChar(input);
+
+	if (c < 0)
+	{
+		return DeserializationError::IncompleteInput;
+	}
+
+	if (isQuote(c))
+	{
+		int stopChar = readChar(input);
+
+		for (;;)
+		{
+			c = readChar(input);
+			if (c < 0)
+			{
+				return DeserializationError::IncompleteInput;
+			}
+			if (c == stopChar)
+			{
+				break;
+			}
+			if (c == '\\')
+			{
+				c = readChar(input);
+				if (c < 0)
+				{
+					return DeserializationError::IncompleteInput;
+				}
+			}
+			if (n < (size - 1))
+			{
+				key[n++] = (char)c;
+			}
+			else
+			{
+				// too long: it can't be one of the filter keys
+				key[0] = '\0';
+				n = size;
+			}
+		}
+	}
+	else if (canBeInNonQuotedString(c))
+	{
+		while (canBeInNonQuotedString(c))
+		{
+			readChar(input);
+			if (n < (size - 1))
+			{
+				key[n++] = (char)c;
+			}
+			else
+			{
+				// too long: it can't be one of the filter keys
+				key[0] = '\0';
+				n = size;
+			}
+			c = peekChar(input);
+		}
+	}
+	else
+	{
+		return DeserializationError::InvalidInput;
+	}
+
+	if (n < size)
+	{
+		key[n] = '\0';
+	}
+	return DeserializationError::Ok;
+}
+
+
+/*
+ * readScalar: it reads a number, true, false or null leaving the delimiter in
+ * the stream. deserializeJson() can't be used directly on the stream for
+ * scalars because it consumes the char which follows them
+ */
+DeserializationError JsonStreamFilter::readScalar(Stream& input, char* token, size_t size)
+{
+	size_t n = 0;
+	int c = peekChar(input);
+
+	while (canBeInNonQuotedString(c))
+	{
+		if (n >= (size - 1))
+		{
+			return DeserializationError::NoMemory;
+		}
+		token[n++] = (char)readChar(input);
+		c = peekChar(input);
+	}
+	token[n] = '\0';
+
+	if (n == 0)
+	{
+		return (c < 0) ? DeserializationError::IncompleteInput :
+			DeserializationError::InvalidInput;
+	}
+	return DeserializationError::Ok;
+}
+
+
+/*
+ * parse: it reads a JSON object from 'input' calling 'handler' for each of
+ * its top-level members whose key is in the filter
+ */
+DeserializationError JsonStreamFilter::parse(	Stream& input,
+												JsonDocument& doc,
+												JsonMemberHandler handler)
+{
+	char key[JSON_STREAM_FILTER_KEY_SIZE];
+	char token[JSON_STREAM_FILTER_TOKEN_SIZE];
+	DeserializationError err;
+	int c;
+
+	doc.clear();
+
+	// opening brace
+	err = skipSpaces(input);
+	if (err) return err;
+	if (readChar(input) != '{')
+	{
+		return DeserializationError::InvalidInput;
+	}
+
+	err = skipSpaces(input);
+	if (err) return err;
+	if (peekChar(input) == '}')
+	{
+		readChar(input);
+		return DeserializationError::Ok;
+	}
+
+	for (;;)
+	{
+		// "<key>":
+		err = readKey(input, key, sizeof(key));
+		if (err) return err;
+
+		err = skipSpaces(input);
+		if (err) return err;
+		if (readChar(input) != ':')
+		{
+			return DeserializationError::InvalidInput;
+		}
+
+		err = skipSpaces(input);
+		if (err) return err;
+
+		// <value>
+		if (wanted(key))
+		{
+			c = peekChar(input);
+			if ((c == '{') || (c == '[') || isQuote(c))
+			{
+				err = deserializeJson(doc, input);
+			}
+			else
+			{
+				err = readScalar(input, token, sizeof(token));
+				if (err) return err;
+				err = deserializeJson(doc, token);
+			}
+			if (err) return err;
+
+			if (handler(key, doc.as<JsonVariant>()) == false)
+			{
+				doc.clear();
+				return DeserializationError::Ok;
+			}
+			doc.clear();
+		}
+		else
+		{
+			err = skipValue(input);
+			if (err) return err;
+		}
+
+		// , or }
+		err = skipSpaces(input);
+		if (err) return err;
+
+		c = readChar(input);
+		if (c == '}')
+		{
+			return DeserializationError::Ok;
+		}
+		if (c != ',')
+		{
+			return DeserializationError::InvalidInput;
+		}
+
+		err = skipSpaces(input);
+		if (err) return err;
+	}
+}
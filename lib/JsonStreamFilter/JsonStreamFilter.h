@@ -0,0 +1,83 @@
+/*! \file JsonStreamFilter.h
+    \brief Selective deserialization of JSON documents read from a Stream
+
+    The document is never held in RAM as a whole. Its top-level members are
+    scanned as they arrive: members whose key is not wanted are skipped byte
+    by byte and every wanted member is deserialized alone into the given
+    JsonDocument, which only needs to be as big as the largest wanted value.
+ */
+
+#ifndef JsonStreamFilter_h
+#define JsonStreamFilter_h
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <inttypes.h>
+#include <Stream.h>
+#include <ArduinoJson.h>
+
+/******************************************************************************
+ * Definitions & Declarations
+ ******************************************************************************/
+
+//! Maximum length of the keys compared against the filter (longer never match)
+#define JSON_STREAM_FILTER_KEY_SIZE		32
+
+//! Maximum length of a scalar value (number, true, false, null)
+#define JSON_STREAM_FILTER_TOKEN_SIZE	32
+
+/*! Callback called for every wanted member found in the document
+ * \param key: member key
+ * \param value: member value, valid only until the callback returns
+ * \return 'true' to continue parsing; 'false' to stop
+ */
+typedef bool (*JsonMemberHandler)(const char* key, JsonVariant value);
+
+/******************************************************************************
+ * Class
+ ******************************************************************************/
+
+class JsonStreamFilter
+{
+private:
+
+	//! Wanted top-level keys
+	const char* const* _keys;
+	uint8_t _count;
+
+	bool wanted(const char* key);
+
+	int peekChar(Stream& input);
+	int readChar(Stream& input);
+
+	DeserializationError skipSpaces(Stream& input);
+	DeserializationError skipString(Stream& input);
+	DeserializationError skipValue(Stream& input);
+	DeserializationError readKey(Stream& input, char* key, size_t size);
+	DeserializationError readScalar(Stream& input, char* token, size_t size);
+
+public:
+
+	/*!
+	\param const char* const* keys: array with the wanted top-level keys
+	\param uint8_t count: number of keys in the array
+	 */
+	JsonStreamFilter(const char* const* keys, uint8_t count);
+
+	/*!
+	\brief	It reads a JSON object from 'input' and calls 'handler' for each
+			wanted member. Reading stops at the closing brace of the object.
+	\param	Stream& input: stream to read the document from
+	\param	JsonDocument& doc: storage for one wanted value at a time
+	\param	JsonMemberHandler handler: callback for the wanted members
+	\return	DeserializationError::Ok if the object was read or the handler
+			stopped the parsing; error code otherwise
+	 */
+	DeserializationError parse(	Stream& input,
+								JsonDocument& doc,
+								JsonMemberHandler handler);
+};
+
+#endif
@@ -0,0 +1,273 @@
+/*! \file SeriesEncoder.cpp
+    \brief Compact encoder for batches of timestamped multi-channel readings
+ */
+
+#include "SeriesEncoder.h"
+#include <string.h>
+#include <math.h>
+
+static const float pow10Table[SERIES_MAX_DECIMALS + 1] =
+	{1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f, 100000.0f, 1000000.0f};
+
+
+static inline uint8_t leadingZeros(uint32_t value)
+{
+	uint8_t n = 0;
+	while ((n < 32) && !(value & 0x80000000UL))
+	{
+		value <<= 1;
+		n++;
+	}
+	return n;
+}
+
+static inline uint8_t trailingZeros(uint32_t value)
+{
+	uint8_t n = 0;
+	while ((n < 32) && !(value & 0x01))
+	{
+		value >>= 1;
+		n++;
+	}
+	return n;
+}
+
+
+SeriesEncoder::SeriesEncoder(uint8_t* buffer, uint16_t size)
+{
+	_buffer = buffer;
+	_size = size;
+	_channels = 0;
+	clear();
+}
+
+
+uint8_t SeriesEncoder::addChannel(uint8_t type, uint8_t decimals)
+{
+	if ((_samples > 0) ||
+		(_channels >= SERIES_MAX_CHANNELS) ||
+		(decimals > SERIES_MAX_DECIMALS) ||
+		(SERIES_HEADER_SIZE + _channels + 1 > _size))
+	{
+		return 1;
+	}
+
+	_channel[_channels].type = type;
+	_channel[_channels].decimals = decimals;
+	_channels++;
+	clear();
+	return 0;
+}
+
+
+void SeriesEncoder::clear()
+{
+	_samples = 0;
+	_overflow = false;
+	_timestamp = 0;
+	_delta = 0;
+
+	// every block is decoded from scratch: no delta against the last one
+	for (uint8_t i = 0; i < _channels; i++)
+	{
+		_channel[i].previous = 0;
+		_channel[i].leading = 0xFF;
+		_channel[i].trailing = 0;
+	}
+
+	if (SERIES_HEADER_SIZE + _channels > _size)
+	{
+		_overflow = true;
+		_bit = (uint32_t)_size * 8;
+		return;
+	}
+
+	_buffer[0] = SERIES_FORMAT_VERSION;
+	_buffer[1] = _channels;
+	_buffer[2] = 0;
+	_buffer[3] = 0;
+	for (uint8_t i = 0; i < _channels; i++)
+	{
+		_buffer[SERIES_HEADER_SIZE + i] = (_channel[i].type << 4) | _channel[i].decimals;
+	}
+	_bit = (uint32_t)(SERIES_HEADER_SIZE + _channels) * 8;
+}
+
+
+uint16_t SeriesEncoder::length()
+{
+	return (uint16_t)((_bit + 7) / 8);
+}
+
+
+/*
+ * writeBits: it writes the 'bits' least significant bits of 'value', MSB first
+ */
+void SeriesEncoder::writeBits(uint32_t value, uint8_t bits)
+{
+	while (bits > 0)
+	{
+		uint16_t index = _bit >> 3;
+		uint8_t offset = _bit & 0x07;
+
+		if (index >= _size)
+		{
+			_overflow = true;
+			return;
+		}
+		if (offset == 0)
+		{
+			_buffer[index] = 0;
+		}
+
+		// as many bits as fit in the current byte
+		uint8_t room = 8 - offset;
+		uint8_t n = (bits < room) ? bits : room;
+		uint8_t chunk = (value >> (bits - n)) & ((1 << n) - 1);
+
+		_buffer[index] |= chunk << (room - n);
+		_bit += n;
+		bits -= n;
+	}
+}
+
+
+/*
+ * writeVarint: zigzag encoding followed by 7-bit groups, lowest first, with
+ * the MSB of each group set when more groups follow
+ */
+void SeriesEncoder::writeVarint(int32_t value)
+{
+	uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+
+	do
+	{
+		uint8_t group = zigzag & 0x7F;
+		zigzag >>= 7;
+		if (zigzag != 0)
+		{
+			group |= 0x80;
+		}
+		writeBits(group, 8);
+	}
+	while (zigzag != 0);
+}
+
+
+void SeriesEncoder::writeFloat(Channel* channel, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	if (_samples == 0)
+	{
+		writeBits(bits, 32);
+		channel->previous = bits;
+		channel->leading = 0xFF;
+		return;
+	}
+
+	uint32_t xored = bits ^ channel->previous;
+	channel->previous = bits;
+
+	if (xored == 0)
+	{
+		writeBits(0, 1);
+		return;
+	}
+
+	uint8_t leading = leadingZeros(xored);
+	uint8_t trailing = trailingZeros(xored);
+
+	if ((channel->leading != 0xFF) &&
+		(leading >= channel->leading) &&
+		(trailing >= channel->trailing))
+	{
+		// '10': meaningful bits fit in the previous window
+		uint8_t meaningful = 32 - channel->leading - channel->trailing;
+		writeBits(0x02, 2);
+		writeBits(xored >> channel->trailing, meaningful);
+	}
+	else
+	{
+		// '11': new window, 5 bits leading zeros and 5 bits length - 1
+		uint8_t meaningful = 32 - leading - trailing;
+		writeBits(0x03, 2);
+		writeBits(leading, 5);
+		writeBits(meaningful - 1, 5);
+		writeBits(xored >> trailing, meaningful);
+		channel->leading = leading;
+		channel->trailing = trailing;
+	}
+}
+
+
+void SeriesEncoder::writeScaled(Channel* channel, float value)
+{
+	int32_t scaled = (int32_t)lroundf(value * pow10Table[channel->decimals]);
+
+	writeVarint(scaled - (int32_t)channel->previous);
+	channel->previous = (uint32_t)scaled;
+}
+
+
+uint8_t SeriesEncoder::add(uint32_t timestamp, const float values[])
+{
+	// keep the state to roll back if the sample does not fit
+	uint32_t bit = _bit;
+	uint32_t timestamp_prev = _timestamp;
+	int32_t delta_prev = _delta;
+	Channel channel_prev[SERIES_MAX_CHANNELS];
+
+	if (_overflow)
+	{
+		return 1;
+	}
+	memcpy(channel_prev, _channel, sizeof(Channel) * _channels);
+
+	// 1. timestamp
+	if (_samples == 0)
+	{
+		writeBits(timestamp, 32);
+		_delta = 0;
+	}
+	else
+	{
+		int32_t delta = (int32_t)(timestamp - _timestamp);
+		writeVarint(delta - _delta);
+		_delta = delta;
+	}
+	_timestamp = timestamp;
+
+	// 2. values
+	for (uint8_t i = 0; i < _channels; i++)
+	{
+		if (_channel[i].type == SERIES_SCALED)
+		{
+			writeScaled(&_channel[i], values[i]);
+		}
+		else
+		{
+			writeFloat(&_channel[i], values[i]);
+		}
+	}
+
+	if (_overflow)
+	{
+		// drop the bits written after the last complete sample
+		_bit = bit;
+		if (_bit & 0x07)
+		{
+			_buffer[_bit >> 3] &= 0xFF << (8 - (_bit & 0x07));
+		}
+		_timestamp = timestamp_prev;
+		_delta = delta_prev;
+		memcpy(_channel, channel_prev, sizeof(Channel) * _channels);
+		return 1;
+	}
+
+	_samples++;
+	_buffer[2] = _samples & 0xFF;
+	_buffer[3] = _samples >> 8;
+	return 0;
+}
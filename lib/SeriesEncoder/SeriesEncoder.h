@@ -0,0 +1,126 @@
+/*! \file SeriesEncoder.h
+    \brief Compact encoder for batches of timestamped multi-channel readings
+
+    Consecutive readings of a sensor differ only slightly, so instead of
+    sending them as decimal text they are packed in a bit stream:
+
+    - Timestamps: first one raw (32 bits), then the delta-of-delta as a
+      zigzag varint. A fixed sampling period costs 8 bits per sample.
+    - SERIES_FLOAT channels: Gorilla XOR encoding of the IEEE754 value
+      ('0' if repeated, else the meaningful bits of the XOR with the
+      previous value).
+    - SERIES_SCALED channels: value * 10^decimals rounded to an integer,
+      then the delta with the previous one as a zigzag varint.
+
+    Layout:
+
+        [version][channels][samples (2 bytes, LE)][channel descriptor]...
+        [bit stream, MSB first]
+
+    Channel descriptor: (type << 4) | decimals
+
+    The encoder works in place over a caller supplied buffer, it does not
+    allocate memory. SeriesDecoder.py decodes the output.
+ */
+
+#ifndef SeriesEncoder_h
+#define SeriesEncoder_h
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <inttypes.h>
+
+/******************************************************************************
+ * Definitions & Declarations
+ ******************************************************************************/
+
+//! Format version written in the first byte
+#define SERIES_FORMAT_VERSION	1
+
+//! Maximum number of channels per sample
+#define SERIES_MAX_CHANNELS		8
+
+//! Maximum decimals for SERIES_SCALED channels
+#define SERIES_MAX_DECIMALS		6
+
+//! Channel types
+#define SERIES_FLOAT			0
+#define SERIES_SCALED			1
+
+//! Size of the fixed part of the header
+#define SERIES_HEADER_SIZE		4
+
+/******************************************************************************
+ * Class
+ ******************************************************************************/
+
+class SeriesEncoder
+{
+private:
+
+	//! Per channel encoding state
+	struct Channel
+	{
+		uint8_t type;
+		uint8_t decimals;
+		uint8_t leading;
+		uint8_t trailing;
+		uint32_t previous;
+	};
+
+	uint8_t* _buffer;
+	uint16_t _size;
+
+	//! Next bit to write in '_buffer'
+	uint32_t _bit;
+	bool _overflow;
+
+	uint8_t _channels;
+	uint16_t _samples;
+	Channel _channel[SERIES_MAX_CHANNELS];
+
+	uint32_t _timestamp;
+	int32_t _delta;
+
+	void writeBits(uint32_t value, uint8_t bits);
+	void writeVarint(int32_t value);
+	void writeFloat(Channel* channel, float value);
+	void writeScaled(Channel* channel, float value);
+
+public:
+
+	/*!
+	\param uint8_t* buffer: output buffer
+	\param uint16_t size: size of the output buffer
+	 */
+	SeriesEncoder(uint8_t* buffer, uint16_t size);
+
+	//! It declares a new channel. All channels must be added before add()
+	/*!
+	\param uint8_t type: SERIES_FLOAT or SERIES_SCALED
+	\param uint8_t decimals: decimals kept by SERIES_SCALED channels
+	\return '0' if OK; '1' if error
+	 */
+	uint8_t addChannel(uint8_t type, uint8_t decimals);
+
+	//! It discards all samples, keeping the channel definitions
+	void clear();
+
+	//! It appends one sample
+	/*!
+	\param uint32_t timestamp: i.e. epoch time in seconds
+	\param const float values[]: one value per channel, in declaration order
+	\return '0' if OK; '1' if the buffer is full (the sample is not added)
+	 */
+	uint8_t add(uint32_t timestamp, const float values[]);
+
+	//! Number of bytes of '_buffer' used so far
+	uint16_t length();
+
+	//! Number of samples encoded so far
+	uint16_t samples() { return _samples; }
+};
+
+#endif
@@ -0,0 +1,184 @@
+/*! \file StreamingStats.cpp
+    \brief Constant memory statistics over a stream of readings
+ */
+
+#include "StreamingStats.h"
+#include <math.h>
+
+
+/******************************************************************************
+ * RunningStats
+ ******************************************************************************/
+
+RunningStats::RunningStats()
+{
+	clear();
+}
+
+void RunningStats::clear()
+{
+	_count = 0;
+	_mean = 0;
+	_m2 = 0;
+	_min = 0;
+	_max = 0;
+}
+
+void RunningStats::add(float value)
+{
+	_count++;
+	if (_count == 1)
+	{
+		_min = value;
+		_max = value;
+	}
+	else
+	{
+		if (value < _min) _min = value;
+		if (value > _max) _max = value;
+	}
+
+	float delta = value - _mean;
+	_mean += delta / _count;
+	_m2 += delta * (value - _mean);
+}
+
+float RunningStats::variance() const
+{
+	if (_count < 2)
+	{
+		return 0;
+	}
+	return _m2 / (_count - 1);
+}
+
+float RunningStats::stddev() const
+{
+	return sqrt(variance());
+}
+
+
+/******************************************************************************
+ * P2Quantile
+ ******************************************************************************/
+
+P2Quantile::P2Quantile(float p)
+{
+	_p = p;
+	clear();
+}
+
+void P2Quantile::clear()
+{
+	_count = 0;
+}
+
+void P2Quantile::add(float value)
+{
+	uint8_t i;
+
+	// Initialization: the first readings are kept sorted
+	if (_count < P2_MARKERS)
+	{
+		i = _count;
+		while ((i > 0) && (_q[i - 1] > value))
+		{
+			_q[i] = _q[i - 1];
+			i--;
+		}
+		_q[i] = value;
+		_count++;
+
+		if (_count == P2_MARKERS)
+		{
+			for (i = 0; i < P2_MARKERS; i++)
+			{
+				_n[i] = i;
+			}
+			_desired[0] = 0;
+			_desired[1] = 2 * _p;
+			_desired[2] = 4 * _p;
+			_desired[3] = 2 + 2 * _p;
+			_desired[4] = 4;
+		}
+		return;
+	}
+
+	// Find the cell of the reading, extending the extremes if needed
+	uint8_t k;
+	if (value < _q[0])
+	{
+		_q[0] = value;
+		k = 0;
+	}
+	else if (value >= _q[P2_MARKERS - 1])
+	{
+		_q[P2_MARKERS - 1] = value;
+		k = P2_MARKERS - 2;
+	}
+	else
+	{
+		k = 0;
+		while (value >= _q[k + 1])
+		{
+			k++;
+		}
+	}
+
+	for (i = k + 1; i < P2_MARKERS; i++)
+	{
+		_n[i]++;
+	}
+	_desired[1] += _p / 2;
+	_desired[2] += _p;
+	_desired[3] += (1 + _p) / 2;
+	_desired[4] += 1;
+	_count++;
+
+	// Adjust the heights of the middle markers
+	for (i = 1; i < P2_MARKERS - 1; i++)
+	{
+		float d = _desired[i] - _n[i];
+		if (((d >= 1) && (_n[i + 1] - _n[i] > 1)) ||
+			((d <= -1) && (_n[i - 1] - _n[i] < -1)))
+		{
+			int8_t sign = (d > 0) ? 1 : -1;
+			float q = parabolic(i, sign);
+			if ((_q[i - 1] < q) && (q < _q[i + 1]))
+			{
+				_q[i] = q;
+			}
+			else
+			{
+				_q[i] = linear(i, sign);
+			}
+			_n[i] += sign;
+		}
+	}
+}
+
+float P2Quantile::parabolic(uint8_t i, int8_t d)
+{
+	return _q[i] + (float)d / (_n[i + 1] - _n[i - 1]) *
+		((_n[i] - _n[i - 1] + d) * (_q[i + 1] - _q[i]) / (_n[i + 1] - _n[i]) +
+		 (_n[i + 1] - _n[i] - d) * (_q[i] - _q[i - 1]) / (_n[i] - _n[i - 1]));
+}
+
+float P2Quantile::linear(uint8_t i, int8_t d)
+{
+	return _q[i] + d * (_q[i + d] - _q[i]) / (_n[i + d] - _n[i]);
+}
+
+float P2Quantile::value() const
+{
+	if (_count == 0)
+	{
+		return 0;
+	}
+	if (_count < P2_MARKERS)
+	{
+		// Readings are still sorted in '_q'
+		return _q[(uint8_t)(_p * (_count - 1) + 0.5f)];
+	}
+	return _q[2];
+}
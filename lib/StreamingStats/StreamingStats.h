@@ -0,0 +1,111 @@
+/*! \file StreamingStats.h
+    \brief Constant memory statistics over a stream of readings
+
+    RunningStats keeps count, mean, minimum, maximum and variance using
+    Welford's algorithm, which is numerically stable with single precision
+    floats.
+
+    P2Quantile estimates one quantile (i.e. the median) with the P² algorithm
+    of Jain and Chlamtac: five markers are adjusted on every reading, so the
+    memory used does not depend on the number of readings.
+ */
+
+#ifndef StreamingStats_h
+#define StreamingStats_h
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <inttypes.h>
+
+/******************************************************************************
+ * Definitions & Declarations
+ ******************************************************************************/
+
+//! Number of markers of the P² algorithm
+#define P2_MARKERS	5
+
+/******************************************************************************
+ * Class
+ ******************************************************************************/
+
+class RunningStats
+{
+private:
+
+	uint32_t _count;
+	float _mean;
+	float _m2;
+	float _min;
+	float _max;
+
+public:
+
+	RunningStats();
+
+	//! It discards all readings
+	void clear();
+
+	//! It adds a reading
+	/*!
+	\param float value: new reading
+	 */
+	void add(float value);
+
+	uint32_t count() const { return _count; }
+	float mean() const { return _mean; }
+	float minimum() const { return _min; }
+	float maximum() const { return _max; }
+
+	//! Sample variance, '0' with less than two readings
+	float variance() const;
+
+	//! Sample standard deviation, '0' with less than two readings
+	float stddev() const;
+};
+
+
+class P2Quantile
+{
+private:
+
+	float _p;
+	uint32_t _count;
+
+	//! Marker heights
+	float _q[P2_MARKERS];
+
+	//! Actual and desired marker positions
+	int32_t _n[P2_MARKERS];
+	float _desired[P2_MARKERS];
+
+	float parabolic(uint8_t i, int8_t d);
+	float linear(uint8_t i, int8_t d);
+
+public:
+
+	/*!
+	\param float p: quantile to estimate, between 0 and 1 (0.5 for the median)
+	 */
+	P2Quantile(float p);
+
+	//! It discards all readings
+	void clear();
+
+	//! It adds a reading
+	/*!
+	\param float value: new reading
+	 */
+	void add(float value);
+
+	//! Current estimate, exact while there are less than five readings
+	/*!
+	\return the estimated quantile; '0' if there are no readings
+	 */
+	float value() const;
+
+	uint32_t count() const { return _count; }
+};
+
+#endif
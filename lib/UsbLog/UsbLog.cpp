@@ -0,0 +1,206 @@
+/*! \file UsbLog.cpp
+    \brief Non-blocking USB log channel with levels and binary frames
+ */
+
+#ifndef __WPROGRAM_H__
+#include <WaspClasses.h>
+#endif
+
+#include "UsbLog.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <util/crc16.h>
+
+//! UART where the USB is connected
+#define USB_LOG_UART	0
+
+//! Level letters, indexed by level
+static const char usbLogLevels[] PROGMEM = "-EWID";
+
+
+/*
+ * usbLogPut: stdio output of log_P(), it writes to the queue
+ */
+static int usbLogPut(char c, FILE* stream)
+{
+	UsbLog.write((uint8_t)c);
+	return 0;
+}
+
+
+/*
+ * usbLogMuxPower: power pin of the UART0 multiplexer, as in setMuxUSB()
+ */
+static uint8_t usbLogMuxPower()
+{
+	return (_boot_version >= 'G') ? MUX0_PW : MUX_PW;
+}
+
+
+UsbLogger::UsbLogger()
+{
+	_lineStart = true;
+	_muxSaved = false;
+	_muxPower = LOW;
+	_muxSelect = LOW;
+	_crc = 0;
+}
+
+
+/*
+ * selectUsb: it switches the multiplexer to the USB, saving its state the
+ * first time since the last restoreMux()
+ */
+void UsbLogger::selectUsb()
+{
+	if (!_muxSaved)
+	{
+		_muxPower = digitalRead(usbLogMuxPower());
+		_muxSelect = digitalRead(MUX_USB_XBEE);
+		_muxSaved = true;
+	}
+	Utils.setMuxUSB();
+}
+
+
+/*
+ * restoreMux: it gives the multiplexer back as selectUsb() found it. The
+ * queue must be empty
+ */
+void UsbLogger::restoreMux()
+{
+	if (_muxSaved)
+	{
+		pinMode(usbLogMuxPower(), OUTPUT);
+		pinMode(MUX_USB_XBEE, OUTPUT);
+		digitalWrite(usbLogMuxPower(), _muxPower);
+		digitalWrite(MUX_USB_XBEE, _muxSelect);
+		_muxSaved = false;
+	}
+	_lineStart = true;
+}
+
+
+void UsbLogger::begin()
+{
+	beginSerial(USB_RATE, USB_LOG_UART);
+	selectUsb();
+	_lineStart = false;
+}
+
+
+void UsbLogger::flush()
+{
+	serialDrain(USB_LOG_UART);
+	restoreMux();
+}
+
+
+void UsbLogger::end()
+{
+	serialDrain(USB_LOG_UART);
+	USB.OFF();
+	_muxSaved = false;
+	_lineStart = true;
+}
+
+
+/*
+ * write: the UART is opened again if it was closed (i.e. by sleeping), and
+ * the multiplexer is selected again at the beginning of every line in case
+ * WaspUSB switched it off after printing
+ */
+size_t UsbLogger::write(uint8_t data)
+{
+	if (bit_is_clear(UCSR0B, TXEN0))
+	{
+		begin();
+	}
+	else if (_lineStart)
+	{
+		selectUsb();
+		_lineStart = false;
+	}
+
+	serialWrite(data, USB_LOG_UART);
+
+	if (data == '\n')
+	{
+		_lineStart = true;
+	}
+	return 1;
+}
+
+
+int UsbLogger::availableForWrite()
+{
+	return serialAvailableForWrite(USB_LOG_UART);
+}
+
+
+void UsbLogger::log_P(uint8_t level, const char* format, ...)
+{
+	FILE stream;
+	va_list args;
+
+	if (level > USB_LOG_DEBUG)
+	{
+		level = USB_LOG_DEBUG;
+	}
+
+	write(pgm_read_byte(&usbLogLevels[level]));
+	write(' ');
+	print(millis());
+	write(' ');
+
+	fdev_setup_stream(&stream, usbLogPut, NULL, _FDEV_SETUP_WRITE);
+	va_start(args, format);
+	vfprintf_P(&stream, format, args);
+	va_end(args);
+
+	println();
+}
+
+
+void UsbLogger::writeFrameByte(uint8_t data)
+{
+	_crc = _crc8_ccitt_update(_crc, data);
+	write(data);
+}
+
+
+void UsbLogger::frame(uint8_t type, const float* values, uint8_t count)
+{
+	unsigned long now = millis();
+
+	if (count > USB_LOG_FRAME_MAX_VALUES)
+	{
+		count = USB_LOG_FRAME_MAX_VALUES;
+	}
+
+	write(USB_LOG_FRAME_SYNC_1);
+	write(USB_LOG_FRAME_SYNC_2);
+
+	_crc = 0;
+	writeFrameByte(type);
+	writeFrameByte(count);
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		writeFrameByte((now >> (8 * i)) & 0xFF);
+	}
+
+	// the AVR stores floats in IEEE 754 little endian already
+	for (uint8_t i = 0; i < count; i++)
+	{
+		const uint8_t* bytes = (const uint8_t*)&values[i];
+		for (uint8_t j = 0; j < sizeof(float); j++)
+		{
+			writeFrameByte(bytes[j]);
+		}
+	}
+
+	write(_crc);
+}
+
+
+UsbLogger UsbLog = UsbLogger();
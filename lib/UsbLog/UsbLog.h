@@ -0,0 +1,147 @@
+/*! \file UsbLog.h
+    \brief Non-blocking USB log channel with levels and binary frames
+
+    WaspUSB prints every call synchronously and it switches the UART0
+    multiplexer on and off around each of them. UsbLog opens the USB port
+    once and writes into the UART0 transmission queue, which is sent from the
+    data register empty interrupt (see serialWrite()), so logging only costs
+    the time to format the message while the queue has room.
+
+    Messages are written with the LOG_ERROR(), LOG_WARN(), LOG_INFO() and
+    LOG_DEBUG() macros, which take a printf format kept in Flash. Levels
+    above USB_LOG_LEVEL are removed at compile time, strings included. The
+    AVR printf does not format floats: print them with UsbLog.print().
+
+    Measures can also be sent as compact binary frames (frame()), decoded by
+    PlotSeries.py --binary:
+
+		0xA5 0x5A | type | count | millis (uint32) | count x float | CRC-8
+
+    Multi-byte fields are little endian, floats are IEEE 754 single
+    precision and the CRC-8 (polynomial 0x07, initial value 0) covers from
+    'type' to the last value.
+
+    UART0 is shared with SOCKET0: call flush() before using a module on
+    SOCKET0, it gives the multiplexer back as it was before the first line
+    written. Sleeping closes the UART, which sends what is queued first.
+ */
+
+#ifndef UsbLog_h
+#define UsbLog_h
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+#include <Print.h>
+
+/******************************************************************************
+ * Definitions & Declarations
+ ******************************************************************************/
+
+//! Log levels
+#define USB_LOG_NONE	0
+#define USB_LOG_ERROR	1
+#define USB_LOG_WARN	2
+#define USB_LOG_INFO	3
+#define USB_LOG_DEBUG	4
+
+//! Highest level compiled in, i.e. -DUSB_LOG_LEVEL=USB_LOG_ERROR in production
+#ifndef USB_LOG_LEVEL
+#define USB_LOG_LEVEL	USB_LOG_INFO
+#endif
+
+//! Binary frame synchronization bytes
+#define USB_LOG_FRAME_SYNC_1	0xA5
+#define USB_LOG_FRAME_SYNC_2	0x5A
+
+//! Maximum number of values in a binary frame
+#define USB_LOG_FRAME_MAX_VALUES	16
+
+#if USB_LOG_LEVEL >= USB_LOG_ERROR
+#define LOG_ERROR(format, ...)	UsbLog.log_P(USB_LOG_ERROR, PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...)	do {} while (0)
+#endif
+
+#if USB_LOG_LEVEL >= USB_LOG_WARN
+#define LOG_WARN(format, ...)	UsbLog.log_P(USB_LOG_WARN, PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...)	do {} while (0)
+#endif
+
+#if USB_LOG_LEVEL >= USB_LOG_INFO
+#define LOG_INFO(format, ...)	UsbLog.log_P(USB_LOG_INFO, PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...)	do {} while (0)
+#endif
+
+#if USB_LOG_LEVEL >= USB_LOG_DEBUG
+#define LOG_DEBUG(format, ...)	UsbLog.log_P(USB_LOG_DEBUG, PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...)	do {} while (0)
+#endif
+
+/******************************************************************************
+ * Class
+ ******************************************************************************/
+
+class UsbLogger : public Print
+{
+private:
+
+	//! Next byte starts a line: the multiplexer is selected again there
+	bool _lineStart;
+
+	//! Multiplexer power and selection pins before switching it to the USB
+	bool _muxSaved;
+	uint8_t _muxPower;
+	uint8_t _muxSelect;
+
+	uint8_t _crc;
+
+	void writeFrameByte(uint8_t data);
+	void selectUsb();
+	void restoreMux();
+
+public:
+
+	UsbLogger();
+
+	//! It opens UART0 at USB_RATE and selects the USB on the multiplexer,
+	//! saving its previous state
+	void begin();
+
+	//! It waits until everything queued has been sent and restores the
+	//! multiplexer state saved when the USB was selected
+	virtual void flush();
+
+	//! It sends what is queued and releases UART0 as USB.OFF() does
+	void end();
+
+	//! It writes a line "<level letter> <millis> <message>\r\n"
+	/*!
+	\param uint8_t level: USB_LOG_ERROR to USB_LOG_DEBUG
+	\param const char* format: printf format in Flash (PSTR)
+	 */
+	void log_P(uint8_t level, const char* format, ...);
+
+	//! It writes a binary frame with a set of measures
+	/*!
+	\param uint8_t type: frame type, i.e. which measures are sent
+	\param const float* values: values of the frame
+	\param uint8_t count: number of values, up to USB_LOG_FRAME_MAX_VALUES
+	 */
+	void frame(uint8_t type, const float* values, uint8_t count);
+
+	virtual size_t write(uint8_t data);
+	virtual int availableForWrite();
+
+	using Print::write;
+};
+
+extern UsbLogger UsbLog;
+
+#endif
@@ -0,0 +1,117 @@
+/*! \file WallClock.cpp
+    \brief Software wall clock seeded from the RTC
+ */
+
+#ifndef __WPROGRAM_H__
+#include <WaspClasses.h>
+#endif
+
+#include "WallClock.h"
+
+
+static inline void writeDigits(char* buffer, uint8_t value)
+{
+	buffer[0] = '0' + (value / 10);
+	buffer[1] = '0' + (value % 10);
+}
+
+
+WallClock::WallClock()
+{
+	_epoch = 0;
+	_millis = 0;
+	_syncMillis = 0;
+	_synced = false;
+	_drift = 0;
+	_dayStart = 1;	// never a day start, forces the first breakTimeAbsolute()
+}
+
+void WallClock::sync()
+{
+	uint8_t status = RTC.isON;
+	if (!status)
+	{
+		RTC.ON();
+	}
+
+	unsigned long epoch = RTC.getEpochTime();
+	unsigned long now = millis();
+
+	if (!status)
+	{
+		RTC.OFF();
+	}
+
+	if (_synced)
+	{
+		_drift = (long)(epoch - (_epoch + (now - _millis) / 1000));
+	}
+	_epoch = epoch;
+	_millis = now;
+	_syncMillis = now;
+	_synced = true;
+}
+
+// Moves '_epoch' and '_millis' forward to the last whole second
+void WallClock::update()
+{
+	unsigned long now = millis();
+	if (!_synced || (now - _syncMillis >= WALL_CLOCK_RESYNC_TIME))
+	{
+		sync();
+		return;
+	}
+
+	unsigned long elapsed = now - _millis;
+	if (elapsed >= 1000)
+	{
+		unsigned long seconds = elapsed / 1000;
+		_epoch += seconds;
+		_millis += seconds * 1000;
+	}
+}
+
+unsigned long WallClock::getEpoch()
+{
+	update();
+	return _epoch;
+}
+
+uint8_t WallClock::getISO8601(char* buffer, uint8_t size)
+{
+	if (size < WALL_CLOCK_ISO8601_SIZE)
+	{
+		return 1;
+	}
+
+	unsigned long epoch = getEpoch();
+	unsigned long seconds = epoch - _dayStart;
+
+	// The date only has to be computed again when the day changes
+	if ((epoch < _dayStart) || (seconds >= SECS_PER_DAY))
+	{
+		RTC.breakTimeAbsolute(epoch, &_date);
+		_dayStart = epoch - (epoch % SECS_PER_DAY);
+		seconds = epoch - _dayStart;
+	}
+
+	// "YYYY-MM-DDTHH:MM:SSZ"
+	buffer[0] = '2';
+	buffer[1] = '0';
+	writeDigits(&buffer[2], _date.year);
+	buffer[4] = '-';
+	writeDigits(&buffer[5], _date.month);
+	buffer[7] = '-';
+	writeDigits(&buffer[8], _date.date);
+	buffer[10] = 'T';
+	writeDigits(&buffer[11], seconds / SECS_PER_HOUR);
+	buffer[13] = ':';
+	writeDigits(&buffer[14], (seconds / SECS_PER_MIN) % 60);
+	buffer[16] = ':';
+	writeDigits(&buffer[17], seconds % 60);
+	buffer[19] = 'Z';
+	buffer[20] = '\0';
+	return 0;
+}
+
+WallClock Clock = WallClock();
@@ -0,0 +1,87 @@
+/*! \file WallClock.h
+    \brief Software wall clock seeded from the RTC
+
+    Reading the time from the DS3231 is a full I2C transaction plus the BCD
+    decoding of every register. WallClock reads the RTC once (sync()) and
+    then advances the epoch with millis(), which is already driven by the
+    Timer0 overflow interrupt, so getting a timestamp costs no I2C traffic.
+
+    The RTC SQW output is not used as time base because it shares the
+    interrupt line with the RTC alarms that wake Waspmote up.
+
+    millis() is based on the main crystal and it stops while sleeping, so
+    the clock is resynced from the RTC every WALL_CLOCK_RESYNC_TIME and it
+    must be synced again after waking up.
+ */
+
+#ifndef WallClock_h
+#define WallClock_h
+
+/******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <inttypes.h>
+#include <WaspRTC.h>
+
+/******************************************************************************
+ * Definitions & Declarations
+ ******************************************************************************/
+
+//! Milliseconds between two RTC reads
+#define WALL_CLOCK_RESYNC_TIME	3600000UL
+
+//! Buffer size needed by getISO8601(): "YYYY-MM-DDTHH:MM:SSZ" + '\0'
+#define WALL_CLOCK_ISO8601_SIZE	21
+
+/******************************************************************************
+ * Class
+ ******************************************************************************/
+
+class WallClock
+{
+private:
+
+	//! Epoch and millis() at the last second boundary counted
+	unsigned long _epoch;
+	unsigned long _millis;
+	unsigned long _syncMillis;
+	bool _synced;
+	long _drift;
+
+	//! Cached broken down date of the day being formatted
+	unsigned long _dayStart;
+	timestamp_t _date;
+
+	void update();
+
+public:
+
+	WallClock();
+
+	//! It reads the RTC and seeds the clock. The RTC is switched on and off
+	//! if needed
+	void sync();
+
+	//! It marks the clock as not synced, i.e. after sleeping or after
+	//! setting the RTC, so the next read goes to the RTC
+	void invalidate() { _synced = false; }
+
+	//! It gets the seconds from 1st January 1970
+	unsigned long getEpoch();
+
+	//! It writes the time as "YYYY-MM-DDTHH:MM:SSZ"
+	/*!
+	\param char* buffer: output buffer
+	\param uint8_t size: size of 'buffer', at least WALL_CLOCK_ISO8601_SIZE
+	\return '0' if OK; '1' if the buffer is too small
+	 */
+	uint8_t getISO8601(char* buffer, uint8_t size);
+
+	//! Seconds corrected at the last resync (RTC minus software clock)
+	long getDrift() { return _drift; }
+};
+
+extern WallClock Clock;
+
+#endif
@@ -50,6 +50,520 @@ Wasp4G::Wasp4G()
 }
 
 
+// Wasp4GHttpStream Methods ///////////////////////////////////////////////////
+
+/* Function: 	It attaches the stream to the UART used by the module
+ * Parameters:	uart: UART where the body is received
+ * 				length: number of body bytes announced by the module
+ * Return:	void
+ */
+void Wasp4GHttpStream::begin(uint8_t uart, uint32_t length)
+{
+	_uart = uart;
+	_remaining = length;
+}
+
+/* Function: 	It discards the body bytes not read yet. The stream timeout
+ * 				bounds the time waiting for each of them
+ * Return:	void
+ */
+void Wasp4GHttpStream::end()
+{
+	char c;
+
+	while (_remaining > 0)
+	{
+		if (readBytes(&c, 1) == 0)
+		{
+			// timeout: the module stopped sending data
+			_remaining = 0;
+		}
+	}
+}
+
+/* Function: 	It returns the number of body bytes ready to be read
+ * Return:	number of bytes
+ */
+int Wasp4GHttpStream::available()
+{
+	int pending = serialAvailable(_uart);
+
+	if ((uint32_t)pending > _remaining)
+	{
+		pending = (int)_remaining;
+	}
+	return pending;
+}
+
+/* Function: 	It reads one byte of the body
+ * Return:	byte read or -1 if no data is available
+ */
+int Wasp4GHttpStream::read()
+{
+	if ((_remaining == 0) || (serialAvailable(_uart) == 0))
+	{
+		return -1;
+	}
+	_remaining--;
+	return serialRead(_uart);
+}
+
+/* Function: 	It returns the next byte of the body without consuming it
+ * Return:	byte or -1 if no data is available
+ */
+int Wasp4GHttpStream::peek()
+{
+	if ((_remaining == 0) || (serialAvailable(_uart) == 0))
+	{
+		return -1;
+	}
+	return serialPeek(_uart);
+}
+
+/* Function: 	The stream is read-only
+ * Return:	'0' always
+ */
+size_t Wasp4GHttpStream::write(uint8_t data)
+{
+	return 0;
+}
+
+
+
+// Wasp4GNmeaParser Methods ///////////////////////////////////////////////////
+
+/* Function: 	It converts an hexadecimal digit
+ * Return:	its value; 0xFF if 'c' is not an hexadecimal digit
+ */
+static uint8_t nmeaHexValue(char c)
+{
+	if ((c >= '0') && (c <= '9')) return c - '0';
+	if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+	if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+	return 0xFF;
+}
+
+/* Function: 	It copies a field truncated to 'size' bytes, '\0' included
+ */
+static void nmeaCopyField(char* dest, uint8_t size, const char* field)
+{
+	strncpy(dest, field, size - 1);
+	dest[size - 1] = '\0';
+}
+
+/* Function: 	It discards the sentence being decoded
+ * Return:	void
+ */
+void Wasp4GNmeaParser::reset()
+{
+	_state = NMEA_WAIT_START;
+	_sentence = 0;
+	_fieldIndex = 0;
+	_fieldLength = 0;
+	_length = 0;
+	_checksum = 0;
+}
+
+/* Function: 	It stores the field just finished if the sentence uses it
+ * Return:	void
+ */
+void Wasp4GNmeaParser::endField()
+{
+	_field[_fieldLength] = '\0';
+
+	// field 0: talker and sentence, i.e. "GPGGA" or "GNGGA"
+	if (_fieldIndex == 0)
+	{
+		if (_fieldLength != 5)						_sentence = 0;
+		else if (strcmp_P(&_field[2], PSTR("GGA")) == 0)	_sentence = NMEA_SENTENCE_GGA;
+		else if (strcmp_P(&_field[2], PSTR("GSA")) == 0)	_sentence = NMEA_SENTENCE_GSA;
+		else if (strcmp_P(&_field[2], PSTR("RMC")) == 0)	_sentence = NMEA_SENTENCE_RMC;
+		else										_sentence = 0;
+		return;
+	}
+
+	if (_sentence == NMEA_SENTENCE_GGA)
+	{
+		// $GPGGA,<hhmmss.ss>,<lat>,<N/S>,<lon>,<E/W>,<quality>,<nsat>,<HDOP>,<alt>,M,...
+		switch (_fieldIndex)
+		{
+			case 1: nmeaCopyField(time, sizeof(time), _field);				break;
+			case 2: nmeaCopyField(latitude, sizeof(latitude), _field);		break;
+			case 3: latitudeNS = _field[0];									break;
+			case 4: nmeaCopyField(longitude, sizeof(longitude), _field);	break;
+			case 5: longitudeEW = _field[0];								break;
+			case 6: quality = (uint8_t)atoi(_field);						break;
+			case 7: numSatellites = (uint8_t)atoi(_field);					break;
+			case 8: hdop = atof(_field);									break;
+			case 9: altitude = atof(_field);								break;
+		}
+	}
+	else if (_sentence == NMEA_SENTENCE_GSA)
+	{
+		// $GPGSA,<A/M>,<fix mode>,...
+		if (_fieldIndex == 2)
+		{
+			fixMode = (uint8_t)atoi(_field);
+		}
+	}
+	else if (_sentence == NMEA_SENTENCE_RMC)
+	{
+		// $GPRMC,<hhmmss.ss>,<A/V>,<lat>,<N/S>,<lon>,<E/W>,<knots>,<course>,<ddmmyy>,...
+		switch (_fieldIndex)
+		{
+			case 1: nmeaCopyField(time, sizeof(time), _field);				break;
+			case 2: status = _field[0];										break;
+			case 3: nmeaCopyField(latitude, sizeof(latitude), _field);		break;
+			case 4: latitudeNS = _field[0];									break;
+			case 5: nmeaCopyField(longitude, sizeof(longitude), _field);	break;
+			case 6: longitudeEW = _field[0];								break;
+			case 7: speedOG = atof(_field) * 1.852;							break;
+			case 8: nmeaCopyField(courseOG, sizeof(courseOG), _field);		break;
+			case 9: nmeaCopyField(date, sizeof(date), _field);				break;
+		}
+	}
+}
+
+/* Function: 	It feeds one character of the NMEA output
+ * Return:	the NMEA_SENTENCE_x decoded if 'c' completes a sentence with a
+ * 			valid checksum; '0' otherwise
+ */
+uint8_t Wasp4GNmeaParser::encode(char c)
+{
+	uint8_t value;
+	uint8_t sentence;
+
+	// '$' always starts a new sentence, so a corrupted one is resynced
+	if (c == '$')
+	{
+		reset();
+		_state = NMEA_FIELDS;
+		return 0;
+	}
+
+	switch (_state)
+	{
+		case NMEA_FIELDS:
+			if (c == '*')
+			{
+				endField();
+				_state = NMEA_CHECKSUM_HIGH;
+			}
+			else if ((c < ' ') || (c > '~') || (++_length > NMEA_MAX_SENTENCE))
+			{
+				reset();
+			}
+			else
+			{
+				// checksum: XOR of the characters between '$' and '*'
+				_checksum ^= c;
+
+				if (c == ',')
+				{
+					endField();
+					_fieldIndex++;
+					_fieldLength = 0;
+				}
+				else if (_fieldLength < NMEA_FIELD_SIZE)
+				{
+					_field[_fieldLength++] = c;
+				}
+			}
+			return 0;
+
+		case NMEA_CHECKSUM_HIGH:
+			value = nmeaHexValue(c);
+			if (value == 0xFF)
+			{
+				reset();
+				return 0;
+			}
+			_received = value << 4;
+			_state = NMEA_CHECKSUM_LOW;
+			return 0;
+
+		case NMEA_CHECKSUM_LOW:
+			value = nmeaHexValue(c);
+			sentence = _sentence;
+			if ((value == 0xFF) || ((_received | value) != _checksum))
+			{
+				sentence = 0;
+			}
+			reset();
+			return sentence;
+	}
+
+	return 0;
+}
+
+
+
+
+// Wasp4GSocketMux Methods ////////////////////////////////////////////////////
+
+//! class constructor
+Wasp4GSocketMux::Wasp4GSocketMux()
+{
+	memset(_ring, 0x00, sizeof(_ring));
+	_attached = 0;
+	_pending = 0;
+	_closed = 0;
+	_lastScan = 0;
+	_match = 0;
+	_urcId = 0;
+}
+
+/* Function: 	It starts tracking a socket with its own ring buffer
+ * Parameters:	socketId: number of the socket Id
+ * 				buffer: ring buffer for the received data
+ * 				size: size of 'buffer'
+ * Return:	void
+ */
+void Wasp4GSocketMux::attach(uint8_t socketId, uint8_t* buffer, uint16_t size)
+{
+	if (socketId >= SOCKET_MUX_SOCKETS)
+	{
+		return;
+	}
+
+	_ring[socketId].buffer = buffer;
+	_ring[socketId].size = size;
+	_ring[socketId].head = 0;
+	_ring[socketId].count = 0;
+
+	_attached |= (1 << socketId);
+	_closed &= ~(1 << socketId);
+
+	// data may have arrived before attaching: check it at the next poll()
+	_pending |= (1 << socketId);
+	_lastScan = millis() - SOCKET_MUX_RESCAN_TIME;
+}
+
+/* Function: 	It stops tracking a socket
+ * Return:	void
+ */
+void Wasp4GSocketMux::detach(uint8_t socketId)
+{
+	if (socketId >= SOCKET_MUX_SOCKETS)
+	{
+		return;
+	}
+
+	_attached &= ~(1 << socketId);
+	_pending &= ~(1 << socketId);
+	_closed &= ~(1 << socketId);
+	_ring[socketId].count = 0;
+}
+
+/* Function: 	It reads the URCs received while no command was running and
+ * 				marks the sockets announced by "SRING: <id>"
+ * Return:	void
+ */
+void Wasp4GSocketMux::scanURC()
+{
+	// "SRING: "
+	const char* urc = (char*)pgm_read_word(&(table_4G[23]));
+	uint8_t length = strlen_P(urc);
+	char c;
+
+	while (serialAvailable(_4G._uart))
+	{
+		c = serialRead(_4G._uart);
+
+		if (_match < length)
+		{
+			if (c == (char)pgm_read_byte(&urc[_match]))
+			{
+				_match++;
+			}
+			else
+			{
+				_match = (c == (char)pgm_read_byte(&urc[0])) ? 1 : 0;
+			}
+			_urcId = 0;
+		}
+		else if ((c >= '0') && (c <= '9'))
+		{
+			_urcId = (_urcId * 10) + (c - '0');
+		}
+		else
+		{
+			// end of "<connId>": connection IDs go from 1 to 6
+			if ((_urcId >= 1) && (_urcId <= SOCKET_MUX_SOCKETS))
+			{
+				_pending |= (1 << (_urcId - 1));
+			}
+			_match = 0;
+		}
+	}
+}
+
+/* Function: 	It checks the state of the attached sockets with AT#SS
+ * Return:	void
+ */
+void Wasp4GSocketMux::rescan()
+{
+	for (uint8_t id = 0; id < SOCKET_MUX_SOCKETS; id++)
+	{
+		if (!(_attached & (1 << id)) || (_closed & (1 << id)))
+		{
+			continue;
+		}
+
+		if (_4G.getSocketStatus(id) != 0)
+		{
+			continue;
+		}
+
+		if (_4G.socketStatus[id].state == Wasp4G::STATUS_CLOSED)
+		{
+			_closed |= (1 << id);
+		}
+		else if (_4G.socketStatus[id].state == Wasp4G::STATUS_SUSPENDED_DATA)
+		{
+			_pending |= (1 << id);
+		}
+	}
+
+	_lastScan = millis();
+}
+
+/* Function: 	It moves the data kept by the module to the ring buffer of
+ * 				the socket, as much as fits
+ * Return:	void
+ */
+void Wasp4GSocketMux::drain(uint8_t socketId)
+{
+	Ring_t* ring = &_ring[socketId];
+	uint16_t room = ring->size - ring->count;
+	uint16_t tail;
+
+	// the module keeps the data until there is room
+	if (room == 0)
+	{
+		return;
+	}
+
+	if (_4G.receive(socketId, 0, room) != 0)
+	{
+		// nothing left or error: the next rescan() finds any data missed
+		_pending &= ~(1 << socketId);
+		return;
+	}
+
+	tail = (ring->head + ring->count) % ring->size;
+	for (uint16_t i = 0; i < _4G._length; i++)
+	{
+		ring->buffer[tail] = _4G._buffer[i];
+		tail = (tail + 1 == ring->size) ? 0 : tail + 1;
+	}
+	ring->count += _4G._length;
+
+	// 'size' was read by receive() before requesting the data
+	if (_4G.socketInfo[socketId].size <= _4G._length)
+	{
+		_pending &= ~(1 << socketId);
+	}
+}
+
+/* Function: 	It waits until some attached socket has data or is closed
+ * Parameters:	timeout: milliseconds to wait, '0' to check once
+ * Return:	mask of the sockets ready (bit 'socketId')
+ */
+uint8_t Wasp4GSocketMux::poll(uint32_t timeout)
+{
+	uint32_t previous = millis();
+	uint8_t ready;
+
+	do
+	{
+		scanURC();
+
+		if (millis() - _lastScan >= SOCKET_MUX_RESCAN_TIME)
+		{
+			rescan();
+		}
+
+		ready = _closed & _attached;
+
+		for (uint8_t id = 0; id < SOCKET_MUX_SOCKETS; id++)
+		{
+			if (!(_attached & (1 << id)))
+			{
+				continue;
+			}
+
+			if (_pending & (1 << id))
+			{
+				drain(id);
+			}
+
+			if (_ring[id].count > 0)
+			{
+				ready |= (1 << id);
+			}
+		}
+
+		if (ready != 0)
+		{
+			return ready;
+		}
+	}
+	while (millis() - previous < timeout);
+
+	return 0;
+}
+
+/* Function: 	It gets the number of bytes buffered for a socket
+ */
+uint16_t Wasp4GSocketMux::available(uint8_t socketId)
+{
+	if (socketId >= SOCKET_MUX_SOCKETS)
+	{
+		return 0;
+	}
+	return _ring[socketId].count;
+}
+
+/* Function: 	It reads one byte buffered for a socket
+ * Return:	the byte; -1 if none
+ */
+int Wasp4GSocketMux::read(uint8_t socketId)
+{
+	uint8_t data;
+
+	if (read(socketId, &data, 1) == 0)
+	{
+		return -1;
+	}
+	return data;
+}
+
+/* Function: 	It reads the bytes buffered for a socket
+ * Return:	number of bytes copied to 'data'
+ */
+uint16_t Wasp4GSocketMux::read(uint8_t socketId, uint8_t* data, uint16_t length)
+{
+	Ring_t* ring;
+	uint16_t n = 0;
+
+	if (socketId >= SOCKET_MUX_SOCKETS)
+	{
+		return 0;
+	}
+
+	ring = &_ring[socketId];
+	while ((n < length) && (ring->count > 0))
+	{
+		data[n++] = ring->buffer[ring->head];
+		ring->head = (ring->head + 1 == ring->size) ? 0 : ring->head + 1;
+		ring->count--;
+	}
+
+	return n;
+}
+
+
 // Private Methods ////////////////////////////////////////////////////////////
 
 
@@ -204,7 +718,7 @@ uint8_t Wasp4G::checkDataConnection(uint8_t time)
 				#endif
 			}
 		}
-		delay(1000);
+		delayIdle(1000);
 
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
@@ -243,7 +757,7 @@ uint8_t Wasp4G::checkDataConnection(uint8_t time)
 				#endif
 			}
 		}
-		delay(1000);
+		delayIdle(1000);
 
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
@@ -327,16 +841,18 @@ uint8_t Wasp4G::httpRequest(uint8_t method,
 							uint16_t length)
 {
 	uint8_t answer;
-	char command_buffer[500];
 	char aux[3];
 	memset( aux, 0x00, sizeof(aux) );
 
+	// The commands are formatted straight into the UART from the Flash
+	// tables, so neither the url nor the resource are copied to the stack
+
 	// Step1: Configure HTTP parameters
 	// Generate: AT#HTTPCFG=0,"<url>",<port>\r
-	sprintf_P(command_buffer, (char*)pgm_read_word(&(table_HTTP[0])), url, port);
+	printCommand_P((char*)pgm_read_word(&(table_HTTP[0])), url, port);
 
-	// send command
-	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR, LE910_ERROR_CODE, 2000);
+	// wait answer
+	answer = waitFor_P(LE910_OK_P, LE910_ERROR_P, LE910_ERROR_CODE_P, 2000);
 
 	if (answer == 2)
 	{
@@ -363,10 +879,10 @@ uint8_t Wasp4G::httpRequest(uint8_t method,
 		(method == Wasp4G::HTTP_DELETE))
 	{
 		// AT#HTTPQRY=0,<method>,"<resource>"\r
-		sprintf_P(command_buffer, (char*)pgm_read_word(&(table_HTTP[1])), method, resource);
+		printCommand_P((char*)pgm_read_word(&(table_HTTP[1])), method, resource);
 
-		// send command
-		answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR, 5000);
+		// wait answer
+		answer = waitFor_P(LE910_OK_P, LE910_ERROR_P, 5000);
 
 		if (answer == 1)
 		{
@@ -382,14 +898,14 @@ uint8_t Wasp4G::httpRequest(uint8_t method,
 	{
 		// 2a. Send HTTP POST or PUT request
 		// AT#HTTPSND=0,<method>,"<resource>",<data_length>
-		sprintf_P(command_buffer, (char*)pgm_read_word(&(table_HTTP[2])),
+		printCommand_P((char*)pgm_read_word(&(table_HTTP[2])),
 				method - 3,
 				resource,
 				length,
 				_contentType);
 
-		// send command
-		answer = sendCommand(command_buffer, LE910_DATA_TO_MODULE, LE910_ERROR, 5000);
+		// wait answer
+		answer = waitFor_P(LE910_DATA_TO_MODULE_P, LE910_ERROR_P, 5000);
 		if (answer != 1)
 		{
 			return 2;
@@ -399,7 +915,8 @@ uint8_t Wasp4G::httpRequest(uint8_t method,
 		delay(100);
 
 		// 2b. Send POST/PUT data
-		answer = sendCommand((char*)data, LE910_OK ,LE910_ERROR, 5000);
+		sendCommand(data, length);
+		answer = waitFor_P(LE910_OK_P, LE910_ERROR_P, 5000);
 		if (answer != 1)
 		{
 			return 3;
@@ -416,13 +933,13 @@ uint8_t Wasp4G::httpRequest(uint8_t method,
 		strcpy_P(php_file, (char*)pgm_read_word(&(table_HTTP[5])));
 
 		// AT#HTTPSND=0,0,"<php_file>",<data_length>
-		sprintf_P(command_buffer, (char*)pgm_read_word(&(table_HTTP[2])),
+		printCommand_P((char*)pgm_read_word(&(table_HTTP[2])),
 				0,
 				php_file,
 				6 + (length * 2),
 				_contentType);
 
-		answer = sendCommand(command_buffer, LE910_DATA_TO_MODULE, LE910_ERROR, 5000);
+		answer = waitFor_P(LE910_DATA_TO_MODULE_P, LE910_ERROR_P, 5000);
 		if (answer != 1)
 		{
 			return 2;
@@ -432,8 +949,7 @@ uint8_t Wasp4G::httpRequest(uint8_t method,
 		delay(100);
 
 		// Add "frame="
-		strcpy_P(command_buffer, (char*)pgm_read_word(&(table_HTTP[6])));
-		printString(command_buffer, 1);
+		printCommand_P((char*)pgm_read_word(&(table_HTTP[6])));
 
 		// Add frame contents in ASCII representation: 3C3D3E...
 		for(uint16_t x = 0; x < length; x++)
@@ -446,7 +962,7 @@ uint8_t Wasp4G::httpRequest(uint8_t method,
 
 
 		// 2b. Send POST/PUT data
-		answer = waitFor(LE910_OK ,LE910_ERROR, 5000);
+		answer = waitFor_P(LE910_OK_P, LE910_ERROR_P, 5000);
 		if (answer != 1)
 		{
 			return 3;
@@ -478,19 +994,16 @@ uint8_t Wasp4G::httpWaitResponse(uint32_t wait_timeout)
 	char *pointer;
 	uint8_t answer;
 	uint16_t data_size;
-	char command_buffer[50];
 
 	// 1. Wait URC: "#HTTPRING: 0,"
-	strcpy_P(command_buffer, (char*)pgm_read_word(&(table_HTTP[3])));
-
-	answer = waitFor(command_buffer, wait_timeout);
+	answer = waitFor_P((char*)pgm_read_word(&(table_HTTP[3])), wait_timeout);
 	if (answer == 0)
 	{
 		return 1;
 	}
 
 	// 2. Read the whole response: "#HTTPRING: 0,<http_status_code>,<content_type>,<data_size>\r
-	answer = waitFor("\r", 5000);
+	answer = waitFor_P(LE910_CR_P, 5000);
 	if (answer == 0)
 	{
 		return 2;
@@ -531,16 +1044,16 @@ uint8_t Wasp4G::httpWaitResponse(uint32_t wait_timeout)
 	if (data_size > 0)
 	{
 		// AT#HTTPRCV=0,0\r
-		sprintf_P(command_buffer, (char*)pgm_read_word(&(table_HTTP[4])), 0, 0);
+		printCommand_P((char*)pgm_read_word(&(table_HTTP[4])), 0, 0);
 
-		// send command
-		answer = sendCommand(command_buffer, LE910_DATA_FROM_MODULE, LE910_ERROR, 2000);
+		// wait answer
+		answer = waitFor_P(LE910_DATA_FROM_MODULE_P, LE910_ERROR_P, 2000);
 
 		// check answer
 		if (answer == 1)
 		{
 			// Read the data
-			answer = waitFor("\r", 5000);
+			answer = waitFor_P(LE910_CR_P, 5000);
 			if (answer == 0)
 			{
 				return 5;
@@ -567,26 +1080,108 @@ uint8_t Wasp4G::httpWaitResponse(uint32_t wait_timeout)
 }
 
 
-/* Function: 	This function reads the size of a file in a FTP server
- * Parameters:	ftp_file: file
- * Return:	0 if "ok"
- * 			1 if error
+/* This function waits the URC code and opens the HTTP data for reading. The
+ * body is left in the UART so it can be read through 'httpStream'
+ * Parameters:	wait_timeout: timeout for URC
+ *	Return:	0 if OK
+ * 			1 if timeout waiting the URC
+ * 			2 if error reading the URC
+ * 			3 if error reading the HTTP status
+ * 			4 if error reading the HTTP data length
+ * 			5 if error reading the HTTP data
+ * 			6 if error code from 4G module
+ * 			7 if timeout waiting for data
+ * 			8 if data length is zero
+ */
+uint8_t Wasp4G::httpOpenResponse(uint32_t wait_timeout)
+{
+	char *pointer;
+	uint8_t answer;
+	uint32_t data_size;
+
+	httpStream.begin(_uart, 0);
+
+	// 1. Wait URC: "#HTTPRING: 0,"
+	answer = waitFor_P((char*)pgm_read_word(&(table_HTTP[3])), wait_timeout);
+	if (answer == 0)
+	{
+		return 1;
+	}
+
+	// 2. Read the whole response: "#HTTPRING: 0,<http_status_code>,<content_type>,<data_size>\r
+	answer = waitFor_P(LE910_CR_P, 5000);
+	if (answer == 0)
+	{
+		return 2;
+	}
+
+	// 3. Read <http_status_code>
+	pointer = strtok((char*)_buffer, ",");
+
+	if (pointer == NULL)
+	{
+		return 3;
+	}
+	_httpCode = atoi(pointer);
+
+	// 4. Skip <content_type>
+	strtok(NULL, ",");
+
+	// 5. Read <data_size>
+	pointer = strtok(NULL, ",\r");
+
+	if (pointer == NULL)
+	{
+		return 4;
+	}
+	data_size = strtoul(pointer, NULL, 10);
+
+	if (data_size == 0)
+	{
+		return 8;
+	}
+
+	// 6. Request the data: AT#HTTPRCV=0,0\r
+	printCommand_P((char*)pgm_read_word(&(table_HTTP[4])), 0, 0);
+
+	// stop right after the data prefix
+	answer = waitFor_P(LE910_DATA_FROM_MODULE_P, LE910_ERROR_P, 2000);
+
+	if (answer == 2)
+	{
+		return 6;
+	}
+	else if (answer != 1)
+	{
+		// Timeout
+		return 7;
+	}
+
+	// 7. From now on the body is read from the UART through the stream
+	httpStream.begin(_uart, data_size);
+
+	return 0;
+}
+
+
+/* Function: 	This function reads the size of a file in a FTP server
+ * Parameters:	ftp_file: file
+ * Return:	0 if "ok"
+ * 			1 if error
  */
 uint8_t Wasp4G::ftpFileSize( char* ftp_file)
 {
 	uint8_t answer;
 	char *pointer;
-	char command_buffer[50];
 
 	// init variable
 	_filesize = 0;
 
 	// AT#FTPFSIZE=<ftp_file>\r
-	memset(command_buffer,0x00,sizeof(command_buffer));
-	sprintf_P(command_buffer,(char*)pgm_read_word(&(table_FTP[5])),ftp_file);
+	printCommand_P((char*)pgm_read_word(&(table_FTP[5])), ftp_file);
 
-	// send command
-	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, 15000);
+	// wait answer
+	answer = waitFor_P(LE910_OK_P, LE910_ERROR_CODE_P, LE910_ERROR_P, 15000);
 
 	#if DEBUG_WASP4G > 0
 		PRINT_LE910(F("_buffer:"));
@@ -1137,15 +1732,24 @@ uint8_t Wasp4G::ON()
 	_baudrate = LE910_RATE;
 	beginUART();
 
+	// Fast resume, the module kept its session while Waspmote was asleep
+	if (resume() == 0)
+	{
+		return 0;
+	}
+
+	// The module is power cycled: a PSM session is lost until setPSM()
+	setSession(0);
+
 	// Power on the module
 	digitalWrite(GPRS_PW, LOW);
-	delay(500);
+	delayIdle(500);
 	digitalWrite(GPRS_PW, HIGH);
 	delay(10);
 
 	answer = check_DS2413();
 
-	if ( answer == 0) delay(10000);
+	if ( answer == 0) delayIdle(10000);
 	else
 	{
 		if (read_DS2413() == 0)
@@ -1230,6 +1834,81 @@ uint8_t Wasp4G::ON()
 	return 0;
 }
 
+/* Function: 	This function wakes the module if a previous boot left it
+ * 				registered in PSM, so the initialization can be skipped
+ * Return:	0 if the session can be reused
+ * 			1 otherwise
+ */
+uint8_t Wasp4G::resume()
+{
+	uint8_t answer;
+	unsigned long previous;
+
+	// OFF(), a power cycle or no PSM request since the last full ON()
+	if (Utils.readEEPROM(EEPROM_4G_SESSION) != LE910_SESSION_PSM)
+	{
+		return 1;
+	}
+
+	// GPRS_PW is an input after the reset: drive it high again without
+	// toggling it, a power cut loses the session (the probe below fails)
+	pinMode(GPRS_PW, OUTPUT);
+	digitalWrite(GPRS_PW, HIGH);
+
+	// The module may be awake already (active time or eDRX paging window)
+	answer = sendCommand("AT\r", LE910_OK, 100);
+
+	if (answer == 0)
+	{
+		// The UART is off in PSM: only the ON_OFF line wakes the module
+		// before its periodic TAU, and it is driven through the DS2413
+		oneWire.reset_search();
+		if (oneWire.search(DS2413_address) == 0)
+		{
+			return 1;
+		}
+		DS2413_present = 1;
+
+		write_DS2413(DS2413_INVERT_PIO);
+		delayIdle(LE910_PSM_WAKE_PULSE);
+		write_DS2413(DS2413_RESET);
+
+		previous = millis();
+		while ((answer == 0) && ((millis() - previous) < LE910_PSM_WAKE_TIMEOUT))
+		{
+			answer = sendCommand("AT\r", LE910_OK, 500);
+		}
+
+		if (answer == 0)
+		{
+			return 1;
+		}
+	}
+
+	// Registered, home network or roaming
+	if (checkConnection(5) != 0)
+	{
+		return 1;
+	}
+
+	// get module version
+	module_version = getModelVersion();
+
+	return 0;
+}
+
+/* Function: 	This function records in EEPROM whether the module is left
+ * 				registered in PSM. The byte is only written when it changes
+ * Parameters:	session: LE910_SESSION_PSM or 0
+ */
+void Wasp4G::setSession(uint8_t session)
+{
+	if (Utils.readEEPROM(EEPROM_4G_SESSION) != session)
+	{
+		Utils.writeEEPROM(EEPROM_4G_SESSION, session);
+	}
+}
+
 /* Function: 	This function powers off the LE910 module
  * Return:	 nothing
  */
@@ -1267,6 +1946,7 @@ void Wasp4G::OFF()
 	// power down
 	pinMode(GPRS_PW,OUTPUT);
 	digitalWrite(GPRS_PW, LOW);
+	setSession(0);
 
 }
 
@@ -1433,7 +2113,7 @@ uint8_t Wasp4G::checkConnection(uint8_t time)
 		else
 		{
 			// continue waiting for correct response
-			delay(1000);
+			delayIdle(1000);
 		}
 
 		// Condition to avoid an overflow (DO NOT REMOVE)
@@ -1532,7 +2212,7 @@ uint8_t Wasp4G::checkConnectionEPS(uint8_t time)
 			#endif
 		}
 
-		delay(1000);
+		delayIdle(1000);
 
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if (millis() < previous) previous = millis();
@@ -1835,7 +2515,7 @@ uint8_t	Wasp4G::manageSockets(uint32_t wait_time)
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
 
-		delay(500);
+		delayIdle(500);
 
 	} while (((millis() - previous) < wait_time));
 
@@ -1921,7 +2601,7 @@ uint8_t Wasp4G::configureSMS()
 	#endif
 
 	// delay to wait for operational SIM
-	delay(5000);
+	delayIdle(5000);
 
 /*	//// 1. Check connection
 	answer = checkConnection(60);
@@ -2002,7 +2682,7 @@ uint8_t Wasp4G::sendSMS(char* phone_number, char* sms_string)
 	}
 
 	// delay to wait for operational SIM
-	delay(5000);
+	delayIdle(5000);
 
 	//// 2. Send SMS
 	// AT+CMGS="<phone_number>"
@@ -2454,6 +3134,86 @@ uint8_t Wasp4G::http(	uint8_t method,
 
 
 
+/* Function: 	This function performs a HTTP request leaving the response body
+ * 				pending in the module to be read through 'httpStream'
+ * Parameters:
+ * 		method: selected HTTP method:	Wasp4G::HTTP_GET
+ * 										Wasp4G::HTTP_HEAD
+ * 										Wasp4G::HTTP_DELETE
+ * 										Wasp4G::HTTP_POST
+ * 										Wasp4G::HTTP_PUT
+ *		url: host name or IP address of the server
+ *		port: server port
+ *		resource: parameter indicating the HTTP resource, object of the	request
+ *		data: data to send in POST/PUT method (NULL if not needed)
+ *
+ * Return:	0 if OK
+ * 			'x' if error. See http()
+ */
+uint8_t Wasp4G::httpStreamRequest(	uint8_t method,
+									char* url,
+									uint16_t port,
+									char* resource,
+									char* data)
+{
+	uint8_t answer;
+
+	// 1. Check data connection
+	answer = checkDataConnection(60);
+	if (answer != 0)
+	{
+		return answer;	// 1 to 15 error codes
+	}
+
+	// 2. Configure parameters	and send the request
+	if (data == NULL)
+	{
+		answer = httpRequest(method, url, port, resource, (uint8_t*)"", 0);
+	}
+	else
+	{
+		answer = httpRequest(method, url, port, resource, data);
+	}
+	if (answer != 0)
+	{
+		return answer+15;	// 16 to 19 error codes
+	}
+
+	// 3. Wait for the response and leave its body in the UART
+	answer = httpOpenResponse(LE910_HTTP_TIMEOUT);
+	if (answer != 0)
+	{
+		return answer+19;	// 20 to 27 error codes
+	}
+
+	return 0;
+}
+
+
+/* Function: 	This function discards the pending bytes of the response body
+ * 				opened with httpStreamRequest() and waits for the final answer
+ * Return:	'0' if OK; '1' if error
+ */
+uint8_t Wasp4G::httpCloseResponse()
+{
+	uint8_t answer;
+
+	httpStream.setTimeout(1000);
+	httpStream.end();
+
+	// the module finishes the data transfer with "OK"
+	answer = waitFor(LE910_OK, LE910_ERROR, 2000);
+	if (answer != 1)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
+
+
 /* Function: 	This function performs a HTTP GET request to the Meshlium device
  * 				connected in port and host specified as input
  * Parameters:
@@ -2582,7 +3342,6 @@ uint8_t Wasp4G::ftpOpenSession(	char* server,
 								uint8_t mode)
 {
 	uint8_t answer;
-	char command_buffer[100];
 
 	#if DEBUG_WASP4G > 1
 		PRINT_LE910(F("Checking connection\n"));
@@ -2601,15 +3360,15 @@ uint8_t Wasp4G::ftpOpenSession(	char* server,
 
 	// 2. Configure FTP parameters and open the connection
 	// AT#FTPOPEN="<server>:<port>","<username>","<password>",<mode>\r
-	sprintf_P(command_buffer, (char*)pgm_read_word(&(table_FTP[0])),
+	printCommand_P((char*)pgm_read_word(&(table_FTP[0])),
 			server,
 			port,
 			username,
 			password,
 			mode);
 
-	// send command
-	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, LE910_FTP_CONF_TIMEOUT);
+	// wait answer
+	answer = waitFor_P(LE910_OK_P, LE910_ERROR_CODE_P, LE910_ERROR_P, LE910_FTP_CONF_TIMEOUT);
 	if (answer != 1)
 	{
 		if (answer == 2)
@@ -2624,14 +3383,16 @@ uint8_t Wasp4G::ftpOpenSession(	char* server,
 
 
 	// 3. Set binary transfer. Once connected we can call the AT#FTPTYPE command
-	// AT#FTPTYPE=0\r
-	strcpy_P(command_buffer, (char*)pgm_read_word(&(table_FTP[4])));
-
 	// mandatory delay
-	delay(2000);
+	delayIdle(2000);
 
-	// send command
-	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, 2000);
+	// AT#FTPTYPE=0\r
+	answer = sendCommand_P(	(char*)pgm_read_word(&(table_FTP[4])),
+							LE910_OK_P,
+							LE910_ERROR_CODE_P,
+							LE910_ERROR_P,
+							NULL,
+							2000);
 	if (answer != 1)
 	{
 		if (answer == 2)
@@ -2657,20 +3418,19 @@ uint8_t Wasp4G::ftpOpenSession(	char* server,
  */
 uint8_t Wasp4G::ftpCloseSession()
 {
-	char command_buffer[50];
 	uint8_t answer;
 
 	#if DEBUG_WASP4G > 1
 		PRINT_LE910(F("Closing FTP session\n"));
 	#endif
 
-	delay(1000);
+	delayIdle(1000);
 
 	//AT#FTPCLOSE\r
-	strcpy_P(command_buffer, (char*)pgm_read_word(&(table_FTP[1])));
+	const char* command = (char*)pgm_read_word(&(table_FTP[1]));
 
 	// First attempt
-	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, 10000);
+	answer = sendCommand_P(command, LE910_OK_P, LE910_ERROR_CODE_P, LE910_ERROR_P, NULL, 10000);
 
 	if (answer == 1)
 	{
@@ -2689,7 +3449,7 @@ uint8_t Wasp4G::ftpCloseSession()
 	}
 
 	// Second attempt
-	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, 1000);
+	answer = sendCommand_P(command, LE910_OK_P, LE910_ERROR_CODE_P, LE910_ERROR_P, NULL, 1000);
 
 	if (answer == 1)
 	{
@@ -2722,15 +3482,15 @@ uint8_t Wasp4G::ftpCloseSession()
 uint8_t Wasp4G::ftpGetWorkingDirectory()
 {
 	uint8_t answer;
-	char command_buffer[100];
 	char* pointer;
 
 	// AT#FTPPWD\r
-	memset(command_buffer, 0x00, sizeof(command_buffer));
-	strcpy_P(command_buffer,(char*)pgm_read_word(&(table_FTP[15])));
-
-	// send command
-	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, 15000);
+	answer = sendCommand_P(	(char*)pgm_read_word(&(table_FTP[15])),
+							LE910_OK_P,
+							LE910_ERROR_CODE_P,
+							LE910_ERROR_P,
+							NULL,
+							15000);
 
 	#if DEBUG_WASP4G > 1
 		PRINT_LE910(F("_buffer:"));
@@ -2776,14 +3536,12 @@ uint8_t Wasp4G::ftpGetWorkingDirectory()
 uint8_t Wasp4G::ftpChangeWorkingDirectory(char* dirname)
 {
 	uint8_t answer;
-	char command_buffer[100];
 
 	// AT#FTPCWD="dirname"\r
-	memset(command_buffer, 0x00, sizeof(command_buffer));
-	sprintf_P(command_buffer,(char*)pgm_read_word(&(table_FTP[17])), dirname);
+	printCommand_P((char*)pgm_read_word(&(table_FTP[17])), dirname);
 
-	// send command
-	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, 15000);
+	// wait answer
+	answer = waitFor_P(LE910_OK_P, LE910_ERROR_CODE_P, LE910_ERROR_P, 15000);
 
 	#if DEBUG_WASP4G > 0
 		PRINT_LE910(F("_buffer:"));
@@ -2824,14 +3582,12 @@ uint8_t Wasp4G::ftpChangeWorkingDirectory(char* dirname)
 uint8_t Wasp4G::ftpDelete(char* ftp_file)
 {
 	uint8_t answer;
-	char command_buffer[100];
 
 	// AT#FTPDELE="<ftp_file>"\r
-	memset(command_buffer, 0x00, sizeof(command_buffer));
-	sprintf_P(command_buffer,(char*)pgm_read_word(&(table_FTP[14])),ftp_file);
+	printCommand_P((char*)pgm_read_word(&(table_FTP[14])), ftp_file);
 
-	// send command
-	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, 15000);
+	// wait answer
+	answer = waitFor_P(LE910_OK_P, LE910_ERROR_CODE_P, LE910_ERROR_P, 15000);
 
 	#if DEBUG_WASP4G > 1
 		PRINT_LE910(F("_buffer:"));
@@ -2875,8 +3631,6 @@ uint8_t Wasp4G::ftpUpload( char* ftp_file, char* sd_file)
 {
 
 	uint8_t answer;
-	char command_answer[20];
-	char command_buffer[512];
 	int32_t file_size = 0;
 	int nBytes = 0;
 	uint8_t error_counter = 5;
@@ -2965,14 +3719,14 @@ uint8_t Wasp4G::ftpUpload( char* ftp_file, char* sd_file)
 	}
 
 	// mandatory delay so the module works ok
-	delay(1000);
+	delayIdle(1000);
 
 	// 5. Open the PUT connection
 	// AT#FTPPUT=<ftp_file>,0\r
-	sprintf_P(command_buffer, (char*)pgm_read_word(&(table_FTP[2])), ftp_file);
+	printCommand_P((char*)pgm_read_word(&(table_FTP[2])), ftp_file);
 
-	// send command
-	answer = sendCommand(command_buffer, "CONNECT", "NO CARRIER", 15000);
+	// wait "CONNECT" or "NO CARRIER"
+	answer = waitFor_P(LE910_CONNECT_P, (char*)pgm_read_word(&(table_FTP[12])), 15000);
 	if (answer != 1)
 	{
 		// Close file
@@ -2997,8 +3751,9 @@ uint8_t Wasp4G::ftpUpload( char* ftp_file, char* sd_file)
 	// 6. Send data to the server
 	while ((file_size > 0) && (error_counter > 0))
 	{
-		// 6a. Read data from SD
-		nBytes = file.read(command_buffer, 500);
+		// 6a. Read data from SD. Nothing is received from the module while
+		// in data mode, so '_buffer' holds the data instead of the stack
+		nBytes = file.read(_buffer, 500);
 
 		// 6b. Send the data if no errors
 		if (nBytes == -1)
@@ -3013,7 +3768,7 @@ uint8_t Wasp4G::ftpUpload( char* ftp_file, char* sd_file)
 		{
 			for (int i = 0; i < nBytes; i++)
 			{
-				printByte(command_buffer[i], 1);
+				printByte(_buffer[i], 1);
 			}
 
 			file_size -= nBytes;
@@ -3036,14 +3791,15 @@ uint8_t Wasp4G::ftpUpload( char* ftp_file, char* sd_file)
 	}
 
 	// 9. Exit from data mode
-	delay(1000);
-
-	// "+++"
-	strcpy_P(command_buffer, (char*)pgm_read_word(&(table_FTP[11])));
-	// "NO CARRIER"
-	strcpy_P(command_answer, (char*)pgm_read_word(&(table_FTP[12])));
-
-	answer = sendCommand(command_buffer, command_answer, LE910_ERROR_CODE, 15000);
+	delayIdle(1000);
+
+	// "+++" expecting "NO CARRIER"
+	answer = sendCommand_P(	(char*)pgm_read_word(&(table_FTP[11])),
+							(char*)pgm_read_word(&(table_FTP[12])),
+							LE910_ERROR_CODE_P,
+							NULL,
+							NULL,
+							15000);
 	if (answer != 1)
 	{
 		return 7;
@@ -3083,7 +3839,7 @@ uint8_t Wasp4G::ftpDownload( char* sd_file, char* ftp_file)
 	// init error code variable
 	_errorCode = 0;
 
-	delay(2000);
+	delayIdle(2000);
 
 	/// 1. Get filesize in FTP server
 	error = ftpFileSize(ftp_file);
@@ -3259,7 +4015,7 @@ uint8_t Wasp4G::ftpDownload( char* sd_file, char* ftp_file)
 	// permit good data transmission
 	setDelay(0);
 
-	delay(500);
+	delayIdle(500);
 
 	// "#FTPRECV: "
 	sprintf_P(command_answer, (char*)pgm_read_word(&(table_FTP[13])));
@@ -3297,7 +4053,7 @@ uint8_t Wasp4G::ftpDownload( char* sd_file, char* ftp_file)
 		{
 			error_counter--;
 			// Error could be that no data in the buffer, wait one second
-			delay(1000);
+			delayIdle(1000);
 			#if DEBUG_WASP4G > 0
 				PRINT_LE910(F("Error getting data\n"));
 			#endif
@@ -3413,14 +4169,426 @@ uint8_t Wasp4G::ftpDownload( char* sd_file, char* ftp_file)
 	#endif
 
 
-	// 8. Return the SD to the original state
-	if (sd_state == false)
+	// 8. Return the SD to the original state
+	if (sd_state == false)
+	{
+		SD.OFF();
+	}
+
+	setDelay(DEF_COMMAND_DELAY);
+
+	return 0;
+}
+
+
+
+/* Function: 	This function downloads the OTA binary into a contiguous file of
+ * 				the SD card, pipelining the module and the SD card and
+ * 				resuming an interrupted download of the same binary
+ * Parameters:	name: file in the FTP server and in the SD card
+ * 				size: size announced in LE910_OTA_FILE
+ * 				crc: CRC-32 announced in LE910_OTA_FILE
+ * 				checkCrc: true if 'crc' was announced
+ * Return:	'0' if OK
+ * 			'x' if error (see header)
+ */
+uint8_t Wasp4G::otaDownload(char* name, uint32_t size, uint32_t crc, bool checkCrc)
+{
+	Wasp4GOtaProgress progress;
+	SdFile file;
+	char command_buffer[50];
+	char command_answer[20];
+	bool sd_state;
+	uint8_t answer;
+	uint8_t error = 0;
+	uint8_t error_counter = 5;
+	int32_t packet_size;
+	uint16_t nBytes;
+	uint16_t pending = 0;
+	uint32_t offset = 0;
+	uint32_t remaining;
+	uint32_t checkpoint;
+	uint32_t stream_crc = 0;
+	uint32_t file_crc;
+
+	// init error code variable
+	_errorCode = 0;
+
+	delayIdle(2000);
+
+	/// 1. Check the file size in the FTP server
+	if (ftpFileSize(name) != 0)
+	{
+		#if DEBUG_WASP4G > 0
+			PRINT_LE910(F("Error retrieving file size\n"));
+		#endif
+		return 2;
+	}
+
+	if (_filesize == 0)
+	{
+		#if DEBUG_WASP4G > 0
+			PRINT_LE910(F("Server file size is zero\n"));
+		#endif
+		return 1;
+	}
+
+	if (_filesize != size)
+	{
+		#if DEBUG_WASP4G > 0
+			PRINT_LE910(F("Server file size does not match\n"));
+		#endif
+		return 13;
+	}
+
+	/// 2. Prepare SD card: continue the previous download or start a new one
+
+	// get current state of SD card power supply
+	sd_state = SPI.isSD;
+
+	SD.ON();
+	SD.goRoot();
+
+	if (!SD.isSD())
+	{
+		#if DEBUG_WASP4G > 0
+			PRINT_LE910(F("SD not present\n"));
+		#endif
+		if (sd_state == false)
+		{
+			SD.OFF();
+		}
+		return 3;
+	}
+
+	if ((otaLoadProgress(&progress) == 0)
+		&& (strcmp(progress.name, name) == 0)
+		&& (progress.size == size)
+		&& (progress.crc == crc)
+		&& (progress.done < size)
+		&& (SD.getFileSize(name) == (int32_t)size))
+	{
+		offset = progress.done;
+		stream_crc = progress.doneCrc;
+
+		#if DEBUG_WASP4G > 1
+			PRINT_LE910(F("Resume OTA download at "));
+			USB.println(offset);
+		#endif
+	}
+	else
+	{
+		if (SD.isFile(name) == 1)
+		{
+			SD.del(name);
+		}
+
+		// all clusters allocated now: the writes do not touch the FAT
+		if (!SD.createContiguous(name, size))
+		{
+			#if DEBUG_WASP4G > 0
+				PRINT_LE910(F("file not created\n"));
+			#endif
+			if (sd_state == false)
+			{
+				SD.OFF();
+			}
+			return 4;
+		}
+
+		memset(&progress, 0x00, sizeof(progress));
+		strncpy(progress.name, name, sizeof(progress.name) - 1);
+		progress.size = size;
+		progress.crc = crc;
+		otaSaveProgress(&progress);
+	}
+
+	// no O_SYNC: the file is synchronized at each checkpoint
+	if (!SD.openFile(name, &file, O_RDWR))
+	{
+		#if DEBUG_WASP4G > 0
+			PRINT_LE910(F("error opening file\n"));
+		#endif
+		if (sd_state == false)
+		{
+			SD.OFF();
+		}
+		return 5;
+	}
+
+	// select correct SPI slave for the rest of the function
+	SPI.setSPISlave(SD_SELECT);
+
+	/// 3. Set the restart position and open the GET connection
+	if (offset > 0)
+	{
+		// AT#FTPREST=<offset>\r
+		sprintf_P(command_buffer, (char*)pgm_read_word(&(table_FTP[18])), offset);
+
+		answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, LE910_FTP_TIMEOUT);
+
+		if (answer != 1)
+		{
+			// the server can not restart: download it all again
+			#if DEBUG_WASP4G > 0
+				PRINT_LE910(F("Restart not accepted\n"));
+			#endif
+			offset = 0;
+			stream_crc = 0;
+			progress.done = 0;
+			progress.doneCrc = 0;
+			otaSaveProgress(&progress);
+		}
+	}
+
+	if (!file.seekSet(offset))
+	{
+		#if DEBUG_WASP4G > 0
+			PRINT_LE910(F("setting file offset\n"));
+		#endif
+		file.close();
+		if (sd_state == false)
+		{
+			SD.OFF();
+		}
+		return 6;
+	}
+
+	// AT#FTPGETPKT="<name>"\r
+	sprintf_P(command_buffer, (char*)pgm_read_word(&(table_FTP[3])), name);
+
+	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, LE910_FTP_TIMEOUT);
+
+	if (answer != 1)
+	{
+		if (answer == 2)
+		{
+			getErrorCode();
+		}
+		file.close();
+		if (sd_state == false)
+		{
+			SD.OFF();
+		}
+		return 7;
+	}
+
+	setDelay(0);
+
+	delayIdle(500);
+
+	// "#FTPRECV: "
+	sprintf_P(command_answer, (char*)pgm_read_word(&(table_FTP[13])));
+
+	/// 4. Read data: the module sends packet N+1 while packet N is written
+	remaining = size - offset;
+	checkpoint = offset + LE910_OTA_CHECKPOINT;
+
+	while (error_counter > 0)
+	{
+		// checkpoint while no packet is on its way
+		if (offset >= checkpoint)
+		{
+			file.sync();
+			progress.done = offset;
+			progress.doneCrc = stream_crc;
+			otaSaveProgress(&progress);
+			SPI.setSPISlave(SD_SELECT);
+			checkpoint = offset + LE910_OTA_CHECKPOINT;
+		}
+
+		// a. request the next packet, without flushing the UART
+		if (remaining > 0)
+		{
+			packet_size = (remaining > LE910_OTA_PAYLOAD) ? LE910_OTA_PAYLOAD : remaining;
+
+			// AT#FTPRECV=<packet_size>\r
+			sprintf_P(command_buffer, (char*)pgm_read_word(&(table_FTP[6])), packet_size);
+			printString(command_buffer, _uart);
+		}
+
+		// b. meanwhile, write the last packet, still in '_buffer'
+		if (pending > 0)
+		{
+			if (file.write(_buffer, pending) != (int)pending)
+			{
+				#if DEBUG_WASP4G > 0
+					PRINT_LE910(F("Writing SD error"));
+				#endif
+				error = 11;
+				break;
+			}
+			stream_crc = Utils.crc32(stream_crc, _buffer, pending);
+			offset += pending;
+			pending = 0;
+		}
+
+		if (remaining == 0)
+		{
+			break;
+		}
+
+		// c. read the answer
+		answer = waitFor(command_answer, LE910_ERROR_CODE, LE910_ERROR, 2000);
+
+		if (answer == 2)
+		{
+			getErrorCode();
+			#if DEBUG_WASP4G > 0
+				printErrorCode();
+			#endif
+			error = 8;
+			break;
+		}
+		else if (answer != 1)
+		{
+			error_counter--;
+			// Error could be that no data in the buffer, wait one second
+			delayIdle(1000);
+			#if DEBUG_WASP4G > 0
+				PRINT_LE910(F("Error getting data\n"));
+			#endif
+			continue;
+		}
+
+		// number of bytes of the packet
+		waitFor("\r\n", 100);
+		if (parseInt32(&packet_size, "\r\n") == 1)
+		{
+			#if DEBUG_WASP4G > 0
+				PRINT_LE910(F("Error getting packet size\n"));
+			#endif
+			error = 9;
+			break;
+		}
+
+		// Read the data from the UART and stores in _buffer
+		nBytes = readBuffer(packet_size);
+
+		if ((int32_t)nBytes != packet_size)
+		{
+			#if DEBUG_WASP4G > 0
+				PRINT_LE910(F("Error in packet size mismatch\n"));
+			#endif
+			error = 10;
+			break;
+		}
+
+		pending = nBytes;
+		remaining -= nBytes;
+	}
+
+	if ((error == 0) && (error_counter == 0))
+	{
+		#if DEBUG_WASP4G > 0
+			PRINT_LE910(F("Error counter=0\n"));
+		#endif
+		error = 12;
+	}
+
+	setDelay(DEF_COMMAND_DELAY);
+
+	if (error != 0)
+	{
+		// keep what is written for the next attempt
+		file.sync();
+		if (offset > progress.done)
+		{
+			progress.done = offset;
+			progress.doneCrc = stream_crc;
+			otaSaveProgress(&progress);
+		}
+		file.close();
+		if (sd_state == false)
+		{
+			SD.OFF();
+		}
+		return error;
+	}
+
+	file.close();
+
+	/// 5. Read the file back and check its CRC
+	if ((SD.crc32(name, size, &file_crc) == 0)
+		|| (file_crc != stream_crc)
+		|| (checkCrc && (file_crc != crc)))
+	{
+		#if DEBUG_WASP4G > 0
+			PRINT_LE910(F("CRC mismatch\n"));
+		#endif
+		SD.del(name);
+		SD.del(LE910_OTA_RESUME_FILE);
+		if (sd_state == false)
+		{
+			SD.OFF();
+		}
+		return 14;
+	}
+
+	SD.del(LE910_OTA_RESUME_FILE);
+
+	#if DEBUG_WASP4G > 1
+		PRINT_LE910(F("DOWNLOAD OK\n"));
+	#endif
+
+	if (sd_state == false)
+	{
+		SD.OFF();
+	}
+
+	return 0;
+}
+
+
+/* Function: 	This function reads the OTA download progress from the SD card
+ * Return:	'0' if OK; '1' if there is no progress saved
+ */
+uint8_t Wasp4G::otaLoadProgress(Wasp4GOtaProgress* progress)
+{
+	SdFile file;
+	int nBytes;
+
+	memset(progress, 0x00, sizeof(Wasp4GOtaProgress));
+
+	if (!SD.openFile(LE910_OTA_RESUME_FILE, &file, O_READ))
+	{
+		return 1;
+	}
+
+	nBytes = file.read(progress, sizeof(Wasp4GOtaProgress));
+	file.close();
+
+	if (nBytes != (int)sizeof(Wasp4GOtaProgress))
+	{
+		memset(progress, 0x00, sizeof(Wasp4GOtaProgress));
+		return 1;
+	}
+
+	progress->name[sizeof(progress->name) - 1] = '\0';
+	return 0;
+}
+
+
+/* Function: 	This function writes the OTA download progress to the SD card
+ * Return:	'0' if OK; '1' if error
+ */
+uint8_t Wasp4G::otaSaveProgress(Wasp4GOtaProgress* progress)
+{
+	SdFile file;
+	int nBytes;
+
+	if (!SD.openFile(LE910_OTA_RESUME_FILE, &file, O_WRITE | O_CREAT | O_SYNC))
 	{
-		SD.OFF();
+		return 1;
 	}
 
-	setDelay(DEF_COMMAND_DELAY);
+	nBytes = file.write(progress, sizeof(Wasp4GOtaProgress));
+	file.close();
 
+	if (nBytes != (int)sizeof(Wasp4GOtaProgress))
+	{
+		return 1;
+	}
 	return 0;
 }
 
@@ -3660,7 +4828,7 @@ uint8_t Wasp4G::openSocketClient(uint8_t socketId,
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
 
-		delay(1000);
+		delayIdle(1000);
 
 	} while (((millis() - previous) < LE910_IP_TIMEOUT));
 
@@ -3952,7 +5120,7 @@ uint8_t Wasp4G::openSocketSSL(	uint8_t socketId,
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
 
-		delay(1000);
+		delayIdle(1000);
 
 	} while (((millis() - previous) < LE910_IP_TIMEOUT));
 
@@ -4033,7 +5201,7 @@ uint8_t Wasp4G::closeSocketClient(uint8_t socketId)
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
 
-		delay(1000);
+		delayIdle(1000);
 
 	} while ((millis() - previous) < LE910_IP_TIMEOUT);
 
@@ -4155,7 +5323,7 @@ uint8_t Wasp4G::closeSocketServer(uint8_t socketId, uint8_t protocol)
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
 
-		delay(1000);
+		delayIdle(1000);
 
 	} while ((millis() - previous) < LE910_IP_TIMEOUT);
 
@@ -4237,7 +5405,7 @@ uint8_t Wasp4G::closeSocketSSL(uint8_t socketId)
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
 
-		delay(1000);
+		delayIdle(1000);
 
 	} while ((millis() - previous) < LE910_IP_TIMEOUT);
 
@@ -4359,7 +5527,7 @@ uint8_t Wasp4G::send(uint8_t socketId,
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
 
-		delay(1000);
+		delayIdle(1000);
 
 	} while ((millis() - previous) < LE910_IP_TIMEOUT);
 
@@ -4498,7 +5666,7 @@ uint8_t Wasp4G::sendSSL(uint8_t socketId,
 		// Condition to avoid an overflow (DO NOT REMOVE)
 		if( millis() < previous) previous = millis();
 
-		delay(1000);
+		delayIdle(1000);
 
 	} while ((millis() - previous) < LE910_IP_TIMEOUT);
 
@@ -4523,6 +5691,18 @@ uint8_t Wasp4G::receive(uint8_t socketId)
  * Return: 		'0' if OK; 'x' if error
  */
 uint8_t Wasp4G::receive(uint8_t socketId, uint32_t timeout)
+{
+	return receive(socketId, timeout, LE910_MAX_DL_PAYLOAD);
+}
+
+/* Function: 	This function read data received in the module
+ * Parameters:	socketId: number of the socket Id
+ * 				timeout: number of ms to wait for incoming bytes
+ * 				max_bytes: maximum number of bytes to read, the rest are
+ * 				kept by the module
+ * Return: 		'0' if OK; 'x' if error
+ */
+uint8_t Wasp4G::receive(uint8_t socketId, uint32_t timeout, uint16_t max_bytes)
 {
 	uint8_t answer;
 	int incoming_bytes;
@@ -4559,7 +5739,7 @@ uint8_t Wasp4G::receive(uint8_t socketId, uint32_t timeout)
 			return 1;
 		}
 
-		delay(500);
+		delayIdle(500);
 	}
 	while (millis()-previous < timeout);
 
@@ -4578,10 +5758,14 @@ uint8_t Wasp4G::receive(uint8_t socketId, uint32_t timeout)
 	sprintf_P(command_answer,(char*)pgm_read_word(&(table_IP[9])), socketId+1);
 
 	// generate command
-	// AT#SRECV=<socketId>,<LE910_MAX_DL_PAYLOAD>\r
+	// AT#SRECV=<socketId>,<max_bytes>\r
+	if ((max_bytes == 0) || (max_bytes > LE910_MAX_DL_PAYLOAD))
+	{
+		max_bytes = LE910_MAX_DL_PAYLOAD;
+	}
 	sprintf_P(command_buffer,(char*)pgm_read_word(&(table_IP[26])),
 			socketId+1,
-			LE910_MAX_DL_PAYLOAD);
+			max_bytes);
 
 	// send command
 	answer = sendCommand(command_buffer, command_answer, 2000);
@@ -4781,7 +5965,7 @@ uint8_t Wasp4G::receiveSSL(uint8_t socketId, uint32_t timeout)
 		}
 
 		// wait 500 ms for the next attempt
-		delay(500);
+		delayIdle(500);
 	}
 	while ((millis()-previous < timeout));
 
@@ -5330,6 +6514,12 @@ uint8_t Wasp4G::gpsStop()
 	uint8_t answer;
 	char command_buffer[20];
 
+	// commands are not accepted while in data mode
+	if (gpsStreamStop() != 0)
+	{
+		return 1;
+	}
+
 	// AT$GPSP=0\r
 	sprintf_P(command_buffer, (char*)pgm_read_word(&(table_GPS[0])), 0);
 
@@ -5495,6 +6685,18 @@ int8_t Wasp4G::checkGPS()
 	char command_buffer[20];
 	char command_pattern[20];
 
+	// while streaming the module is in data mode and the attributes are
+	// updated from the unsolicited sentences
+	if (_gpsStreaming)
+	{
+		gpsStreamRead();
+		if ((_fixMode == 2) || (_fixMode == 3))
+		{
+			return 0;
+		}
+		return 2;
+	}
+
 	//// 1. Check if the GPS position is fixed
 	// AT$GPSACP\r
 	strcpy_P(command_buffer, (char*)pgm_read_word(&(table_GPS[4])));
@@ -5859,6 +7061,35 @@ uint8_t Wasp4G::waitForSignal(uint32_t timeout, float desired_HDOP)
 	// update variable status
 	_fixMode = 0;
 
+	//// 0. Streaming: the fix is checked as soon as each sentence arrives
+	// instead of polling the module
+	if (_gpsStreaming)
+	{
+		uint8_t decoded = 0;
+
+		while ((millis() - previous) < timeout)
+		{
+			// a fix mode and a HDOP received after entering the function
+			decoded |= gpsStreamRead();
+
+			if (((decoded & (NMEA_SENTENCE_GGA | NMEA_SENTENCE_GSA)) ==
+				 (NMEA_SENTENCE_GGA | NMEA_SENTENCE_GSA)) &&
+				((_fixMode == 2) || (_fixMode == 3)) &&
+				((desired_HDOP == -1.0) || (_hdop <= desired_HDOP)))
+			{
+				return 0;
+			}
+
+			// Condition to avoid an overflow (DO NOT REMOVE)
+			if( millis() < previous) previous = millis();
+		}
+
+		#if DEBUG_WASP4G > 0
+			PRINT_LE910(F("GPS stream timeout\n"));
+		#endif
+		return 1;
+	}
+
 	//// 1. get current gps status
 	while((_fixMode != 2) && (_fixMode != 3))
 	{
@@ -5897,7 +7128,7 @@ uint8_t Wasp4G::waitForSignal(uint32_t timeout, float desired_HDOP)
 			#endif
 		}
 
-		delay(500);
+		delayIdle(500);
 
 		if (millis()-previous > timeout)
 		{
@@ -5931,7 +7162,7 @@ uint8_t Wasp4G::waitForSignal(uint32_t timeout, float desired_HDOP)
 				}
 			}
 
-			delay(1000);
+			delayIdle(1000);
 		}
 
 		// if down the threshold then return ok
@@ -6086,6 +7317,160 @@ bool Wasp4G::getNMEAString(uint8_t NMEA)
 }
 
 
+/*
+ * Function: It enables the unsolicited GGA, GSA and RMC sentences
+ * Return:	'0' if OK; '1' if already streaming; '2' if error
+ */
+uint8_t Wasp4G::gpsStreamStart()
+{
+	uint8_t answer;
+
+	if (_gpsStreaming)
+	{
+		return 1;
+	}
+
+	// AT$GPSNMUN=3,<GGA>,<GLL>,<GSA>,<GSV>,<RMC>,<VTG>\r
+	printCommand_P((char*)pgm_read_word(&(table_GPS[17])), 1, 0, 1, 0, 1, 0);
+
+	// "CONNECT\r\n"
+	answer = waitFor_P(	(char*)pgm_read_word(&(table_GPS[6])),
+						LE910_ERROR_CODE_P,
+						LE910_ERROR_P,
+						5000);
+	if (answer != 1)
+	{
+		if (answer == 2)
+		{
+			getErrorCode();
+		}
+		return 2;
+	}
+
+	_nmea.reset();
+	_fixMode = 0;
+	_gpsStreaming = true;
+
+	return 0;
+}
+
+
+/*
+ * Function: It decodes the NMEA characters already received
+ * Return:	mask of the NMEA_SENTENCE_x decoded
+ */
+uint8_t Wasp4G::gpsStreamRead()
+{
+	uint8_t decoded = 0;
+	uint8_t sentence;
+
+	if (!_gpsStreaming)
+	{
+		return 0;
+	}
+
+	while (serialAvailable(_uart))
+	{
+		sentence = _nmea.encode(serialRead(_uart));
+		if (sentence != 0)
+		{
+			gpsStreamPublish(sentence);
+			decoded |= sentence;
+		}
+	}
+
+	return decoded;
+}
+
+
+/*
+ * Function: It copies the fields of a decoded sentence to the attributes
+ * used by checkGPS(), so the getters work the same in both modes
+ */
+void Wasp4G::gpsStreamPublish(uint8_t sentence)
+{
+	bool position = false;
+
+	switch (sentence)
+	{
+		case NMEA_SENTENCE_GGA:
+			_numSatellites = _nmea.numSatellites;
+			_hdop = _nmea.hdop;
+			if (_nmea.quality > 0)
+			{
+				_altitude = _nmea.altitude;
+				position = true;
+			}
+			break;
+
+		case NMEA_SENTENCE_GSA:
+			_fixMode = _nmea.fixMode;
+			break;
+
+		case NMEA_SENTENCE_RMC:
+			if (_nmea.date[0] != '\0')
+			{
+				strcpy(_date, _nmea.date);
+			}
+			if (_nmea.status == 'A')
+			{
+				_speedOG = _nmea.speedOG;
+				strcpy(_courseOG, _nmea.courseOG);
+				position = true;
+			}
+			break;
+	}
+
+	// GSA does not carry the time
+	if ((sentence != NMEA_SENTENCE_GSA) && (_nmea.time[0] != '\0'))
+	{
+		strcpy(_time, _nmea.time);
+	}
+
+	if (position)
+	{
+		strcpy(_latitude, _nmea.latitude);
+		_latitudeNS = _nmea.latitudeNS;
+		strcpy(_longitude, _nmea.longitude);
+		_longitudeEW = _nmea.longitudeEW;
+	}
+}
+
+
+/*
+ * Function: It leaves the data mode opened by gpsStreamStart()
+ * Return:	'0' if OK; '1' if error
+ */
+uint8_t Wasp4G::gpsStreamStop()
+{
+	uint8_t answer;
+
+	if (!_gpsStreaming)
+	{
+		return 0;
+	}
+
+	// guard time before the escape sequence
+	delayIdle(1000);
+
+	// "+++"
+	answer = sendCommand_P(	(char*)pgm_read_word(&(table_GPS[18])),
+							LE910_OK_P,
+							NULL,
+							NULL,
+							NULL,
+							2000);
+	if (answer != 1)
+	{
+		return 1;
+	}
+
+	_gpsStreaming = false;
+
+	return 0;
+}
+
+
 
 /* Function: This function gets the temperature interval or the temperature value
  * Parameters:	mode:	 0 for read the temperature interval
@@ -6489,6 +7874,105 @@ uint8_t Wasp4G::setWirelessNetwork(uint8_t n)
 }
 
 
+/* Function:	This function requests the 3GPP Power Saving Mode
+ * Parameters:
+ * 		mode: PSM_DISABLE or PSM_ENABLE
+ * 		tau: requested periodic TAU (T3412) as 8 bit string
+ * 		activeTime: requested active time (T3324) as 8 bit string
+ * Return:	0 if OK
+ * 			1 if error
+ */
+uint8_t Wasp4G::setPSM(uint8_t mode, char* tau, char* activeTime)
+{
+	uint8_t answer;
+	char command_buffer[40];
+
+	if (mode == PSM_ENABLE)
+	{
+		if ((tau == NULL) || (activeTime == NULL) ||
+			(strlen(tau) != 8) || (strlen(activeTime) != 8))
+		{
+			return 1;
+		}
+		// "AT+CPSMS=1,,,\"<tau>\",\"<active_time>\"\r"
+		sprintf_P(command_buffer, (char*)pgm_read_word(&(table_4G[45])), tau, activeTime);
+	}
+	else
+	{
+		// "AT+CPSMS=0\r"
+		strcpy_P(command_buffer, (char*)pgm_read_word(&(table_4G[46])));
+	}
+
+	// send command
+	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, 2000);
+
+	if (answer != 1)
+	{
+		if (answer == 2)
+		{
+			getErrorCode();
+		}
+		return 1;
+	}
+
+	// the next ON() resumes the session instead of power cycling the module
+	if (mode == PSM_ENABLE)
+	{
+		setSession(LE910_SESSION_PSM);
+	}
+	else
+	{
+		setSession(0);
+	}
+
+	return 0;
+}
+
+
+/* Function:	This function sets the eDRX parameters
+ * Parameters:
+ * 		mode: EDRX_DISABLE, EDRX_ENABLE or EDRX_ENABLE_URC
+ * 		accessTechnology: EDRX_LTE_M or EDRX_NB_IOT
+ * 		cycle: requested eDRX cycle as 4 bit string
+ * Return:	0 if OK
+ * 			1 if error
+ */
+uint8_t Wasp4G::setEDRX(uint8_t mode, uint8_t accessTechnology, char* cycle)
+{
+	uint8_t answer;
+	char command_buffer[30];
+
+	if (mode == EDRX_DISABLE)
+	{
+		// "AT+CEDRXS=0\r"
+		strcpy_P(command_buffer, (char*)pgm_read_word(&(table_4G[48])));
+	}
+	else
+	{
+		if ((cycle == NULL) || (strlen(cycle) != 4))
+		{
+			return 1;
+		}
+		// "AT+CEDRXS=<mode>,<AcT>,\"<cycle>\"\r"
+		sprintf_P(command_buffer, (char*)pgm_read_word(&(table_4G[47])), mode, accessTechnology, cycle);
+	}
+
+	// send command
+	answer = sendCommand(command_buffer, LE910_OK, LE910_ERROR_CODE, LE910_ERROR, 2000);
+
+	if (answer != 1)
+	{
+		if (answer == 2)
+		{
+			getErrorCode();
+		}
+		return 1;
+	}
+
+	return 0;
+}
+
+
 
 
 /*
@@ -7004,6 +8488,7 @@ uint8_t Wasp4G::requestOTA(	char* ftp_server,
 	char format_path[10];
 	char format_size[10];
 	char format_version[10];
+	char format_crc[10];
 	int length;
 	uint8_t error_flag;
 
@@ -7013,6 +8498,8 @@ uint8_t Wasp4G::requestOTA(	char* ftp_server,
 	char aux_str[10];
 	long int aux_size;
 	uint8_t aux_version;
+	uint32_t aux_crc = 0;
+	bool crc_found = false;
 
 
 	////////////////////////////////////////////////////////////////////////////
@@ -7099,6 +8586,8 @@ uint8_t Wasp4G::requestOTA(	char* ftp_server,
 	strcpy_P( format_size, (char*)pgm_read_word(&(table_OTA_LE910[4])));
 	// "VERSION:"
 	strcpy_P( format_version, (char*)pgm_read_word(&(table_OTA_LE910[5])));
+	// "CRC:"
+	strcpy_P( format_crc, (char*)pgm_read_word(&(table_OTA_LE910[6])));
 
 	// init SD
 	SD.ON();
@@ -7172,8 +8661,7 @@ uint8_t Wasp4G::requestOTA(	char* ftp_server,
 			USB.println(path);
 		#endif
 
-		// delete actual program
-		SD.del(aux_name);
+		// the binary is not deleted: a partial download of it is resumed
 	}
 	else
 	{
@@ -7249,6 +8737,28 @@ uint8_t Wasp4G::requestOTA(	char* ftp_server,
 		return 9;
 	}
 
+	/// 6. Search CRC (optional): CRC-32 of the binary in hexadecimal
+	str_pointer = strstr((char*) _buffer, format_crc);
+	if (str_pointer != NULL)
+	{
+		length = strchr(str_pointer, '\n')-1-strchr(str_pointer, ':');
+		// check length does not overflow
+		if (length >= (int)sizeof(aux_str))
+		{
+			length = sizeof(aux_str)-1;
+		}
+		strncpy(aux_str, strchr(str_pointer, ':')+1, length);
+		aux_str[length] = '\0';
+
+		aux_crc = strtoul(aux_str, NULL, 16);
+		crc_found = true;
+
+		#if DEBUG_WASP4G > 1
+			PRINT_LE910(F("CRC:"));
+			USB.println(aux_crc, HEX);
+		#endif
+	}
+
 
 
 	// get actual program version
@@ -7323,36 +8833,42 @@ uint8_t Wasp4G::requestOTA(	char* ftp_server,
 		PRINT_LE910(F("Downloading OTA FILE\n"));
 	#endif
 
-	// get binary file
-	error = ftpDownload((char*)aux_name, aux_name);
+	// get binary file, resuming a previous attempt, and check its CRC
+	error = otaDownload(aux_name, (uint32_t)aux_size, aux_crc, crc_found);
 
 	if (error == 0)
 	{
-		// check if size matches
 		SD.ON();
+		#if DEBUG_WASP4G > 1
+			SD.ls();
+		#endif
+		ftpCloseSession();
+
+		// a delta update is rebuilt from the running image first
+		char image[8];
+		error = Utils.applyOTAPatch(aux_name, image);
+
+		if (error == 1)
+		{
+			// complete image: call OTA function
+			Utils.loadOTA(aux_name,aux_version);
+			return 0;
+		}
+
+		SD.del(aux_name);
 
-		// get file size
-		int32_t sd_file_size = SD.getFileSize(aux_name);
-		if (sd_file_size != aux_size)
+		if (error != 0)
 		{
 			SD.OFF();
-			ftpCloseSession();
 			#if DEBUG_WASP4G > 0
-				PRINT_LE910(F("Size does not match\n"));
-				PRINT_LE910(F("sd_file_size:"));
-				USB.println(sd_file_size);
-				PRINT_LE910(F("UPGRADE.TXT size field:"));
-				USB.println(aux_size);
+				PRINT_LE910(F("Error applying patch: "));
+				USB.println(error, DEC);
 			#endif
-			return 11;
+			return 28;
 		}
-		#if DEBUG_WASP4G > 1
-			SD.ls();
-		#endif
-		ftpCloseSession();
 
 		// call OTA function
-		Utils.loadOTA(aux_name,aux_version);
+		Utils.loadOTA(image,aux_version);
 		return 0;
 	}
 	else
@@ -7363,7 +8879,16 @@ uint8_t Wasp4G::requestOTA(	char* ftp_server,
 		#if DEBUG_WASP4G > 0
 			PRINT_LE910(F("Error getting binary\n"));
 		#endif
-		return error_flag + 11; // error codes: 12 to 24
+		if (error_flag == 13)
+		{
+			// size does not match in UPGRADE.TXT and server
+			return 11;
+		}
+		if (error_flag == 14)
+		{
+			return 27;
+		}
+		return error_flag + 11; // error codes: 12 to 23
 	}
 
 }
@@ -7400,7 +8925,7 @@ uint8_t Wasp4G::check_DS2413()
 	else
 	{
 		DS2413_present = 1;
-		delay(6000);
+		delayIdle(6000);
 		write_DS2413(0x01);
 	}
 
@@ -7432,7 +8957,7 @@ uint8_t Wasp4G::on_DS2413()
 		// Turn on the module
 		write_DS2413(DS2413_INVERT_PIO);
 
-		delay(6000);
+		delayIdle(6000);
 		// Send reset pulse
 		write_DS2413(DS2413_RESET);
 
@@ -7487,7 +9012,7 @@ uint8_t Wasp4G::off_DS2413()
 		// Turn on the module
 		write_DS2413(DS2413_INVERT_PIO);
 
-		delay(5200);
+		delayIdle(5200);
 		// Send reset pulse
 		write_DS2413(DS2413_RESET);
 
@@ -35,6 +35,7 @@
 
 #include <inttypes.h>
 #include <WaspUART.h>
+#include <Stream.h>
 #include "./utility/Wasp4G_constants.h"
 
 /******************************************************************************
@@ -69,6 +70,7 @@
 
 
 static char LE910_OTA_FILE[] = "UPGRADE.TXT";
+static char LE910_OTA_RESUME_FILE[] = "UPGRADE.RES";
 
 
 // LE910 Baud Rate
@@ -81,6 +83,24 @@ static char LE910_OTA_FILE[] = "UPGRADE.TXT";
 #define LE910_RMC			4
 #define LE910_GSV			5
 
+// Sentences reported by Wasp4GNmeaParser::encode() and gpsStreamRead()
+#define NMEA_SENTENCE_GGA	0x01
+#define NMEA_SENTENCE_GSA	0x02
+#define NMEA_SENTENCE_RMC	0x04
+
+//! Longest NMEA field stored by the parser (longitude "dddmm.mmmmm")
+#define NMEA_FIELD_SIZE		12
+
+//! NMEA 0183 limits a sentence to 82 characters
+#define NMEA_MAX_SENTENCE	82
+
+//! Milliseconds between two AT#SS checks of the multiplexed sockets, which
+//! catch the data whose SRING was lost while another command was running
+#define SOCKET_MUX_RESCAN_TIME	10000UL
+
+//! Number of LE910 connection IDs
+#define SOCKET_MUX_SOCKETS		6
+
 // Incoming data options
 #define LE910_INCOMING_SMS	1
 #define LE910_INCOMING_IP	2
@@ -92,6 +112,21 @@ static char LE910_OTA_FILE[] = "UPGRADE.TXT";
 // Maximum packet size for FTP download
 #define LE910_MAX_DL_PAYLOAD 490
 
+// OTA download progress is saved every LE910_OTA_CHECKPOINT bytes
+#define LE910_OTA_CHECKPOINT 4096
+
+// OTA packet size: the next packet is requested while the SD writes the last
+// one, so header, data and the "OK" before must fit in the UART RX buffer
+#define LE910_OTA_PAYLOAD 448
+
+// The module was left registered in PSM (stored at EEPROM_4G_SESSION)
+#define LE910_SESSION_PSM		0xA5
+
+// ON_OFF pulse which wakes the module from PSM, far shorter than the one
+// which switches it off, and time for the module to answer afterwards (ms)
+#define LE910_PSM_WAKE_PULSE	1000
+#define LE910_PSM_WAKE_TIMEOUT	5000
+
 // DS2413 constants
 #define DS2413_ONEWIRE_PIN  GPRS_PIN
 
@@ -138,8 +173,209 @@ struct SocketStatusSSL_t
 /******************************************************************************
  * Class
  *****************************************************************************/
+
+//! Wasp4GHttpStream class
+/*!
+	Read-only Stream over the LE910 UART which delivers the body of an HTTP
+	response straight from the serial ring buffer, so it can be consumed
+	(i.e. by deserializeJson) without copying it into '_buffer' first.
+	It reports end of stream once the announced body length has been read.
+ */
+class Wasp4GHttpStream : public Stream
+{
+private:
+
+	uint8_t _uart;
+
+	//! Body bytes still pending to be read from the module
+	uint32_t _remaining;
+
+public:
+
+	Wasp4GHttpStream()
+	{
+		_uart = 1;
+		_remaining = 0;
+	};
+
+	//! It attaches the stream to 'uart' and expects 'length' bytes of body
+	void begin(uint8_t uart, uint32_t length);
+
+	//! It discards the body bytes not read yet
+	void end();
+
+	//! It returns the number of body bytes not read yet
+	uint32_t remaining() { return _remaining; }
+
+	virtual int available();
+	virtual int read();
+	virtual int peek();
+	virtual size_t write(uint8_t data);
+};
+
+
+//! Wasp4GNmeaParser class
+/*!
+	Incremental NMEA 0183 parser fed one character at a time, so sentences
+	are decoded as they arrive from the UART without buffering them. Only
+	the fields used by Wasp4G are kept (GGA, GSA and RMC sentences) and
+	they are published once the sentence checksum has been validated.
+ */
+class Wasp4GNmeaParser
+{
+private:
+
+	enum StateEnum
+	{
+		NMEA_WAIT_START,
+		NMEA_FIELDS,
+		NMEA_CHECKSUM_HIGH,
+		NMEA_CHECKSUM_LOW,
+	};
+
+	uint8_t _state;
+	uint8_t _sentence;
+	uint8_t _fieldIndex;
+	uint8_t _fieldLength;
+	uint8_t _length;
+	uint8_t _checksum;
+	uint8_t _received;
+	char _field[NMEA_FIELD_SIZE + 1];
+
+	void endField();
+
+public:
+
+	//! Fields of the sentences being decoded, valid when encode() returns
+	//! the sentence they belong to
+	char time[7];			// hhmmss (GGA, RMC)
+	char date[7];			// ddmmyy (RMC)
+	char latitude[11];		// ddmm.mmmm (GGA, RMC)
+	char latitudeNS;
+	char longitude[12];		// dddmm.mmmm (GGA, RMC)
+	char longitudeEW;
+	uint8_t quality;		// GGA fix quality, 0 if no fix
+	uint8_t numSatellites;	// GGA satellites in use
+	float hdop;				// GGA
+	float altitude;			// GGA
+	uint8_t fixMode;		// GSA: 1 no fix, 2 2D, 3 3D
+	char status;			// RMC: 'A' valid, 'V' not valid
+	float speedOG;			// RMC, converted to Km/hr
+	char courseOG[7];		// RMC
+
+	Wasp4GNmeaParser()
+	{
+		reset();
+	};
+
+	//! It discards the sentence being decoded
+	void reset();
+
+	//! It feeds one character from the receiver
+	/*!
+	\return	NMEA_SENTENCE_GGA, NMEA_SENTENCE_GSA or NMEA_SENTENCE_RMC when
+			'c' completes a sentence with a valid checksum; '0' otherwise
+	 */
+	uint8_t encode(char c);
+};
+
+
+//! Wasp4GSocketMux class
+/*!
+	Receive engine for several TCP/UDP sockets at once. Every socket is
+	attached with its own ring buffer, supplied by the caller so only the
+	sockets in use take RAM. poll() watches the "SRING: <id>" URCs, drains
+	the data announced by the module into the ring buffers and reports the
+	sockets ready to be read or closed, like select()/poll() do. Data is
+	left in the module while a ring buffer is full.
+
+	The URCs are only seen between commands, so the attached sockets are
+	also checked with AT#SS every SOCKET_MUX_RESCAN_TIME. SSL sockets are
+	not supported: the LE910 does not send SRING for them.
+ */
+class Wasp4GSocketMux
+{
+private:
+
+	struct Ring_t
+	{
+		uint8_t* buffer;
+		uint16_t size;
+		uint16_t head;
+		uint16_t count;
+	};
+
+	Ring_t _ring[SOCKET_MUX_SOCKETS];
+
+	//! Masks of attached sockets, with data in the module and closed
+	uint8_t _attached;
+	uint8_t _pending;
+	uint8_t _closed;
+
+	uint32_t _lastScan;
+
+	//! URC matcher: characters of "SRING: " matched and connection ID
+	uint8_t _match;
+	uint8_t _urcId;
+
+	void scanURC();
+	void rescan();
+	void drain(uint8_t socketId);
+
+public:
+
+	Wasp4GSocketMux();
+
+	//! It starts tracking 'socketId' (Wasp4G::CONNECTION_1..6)
+	/*!
+	\param uint8_t* buffer: ring buffer for the received data
+	\param uint16_t size: size of 'buffer'
+	 */
+	void attach(uint8_t socketId, uint8_t* buffer, uint16_t size);
+
+	//! It stops tracking 'socketId'. Buffered data is discarded
+	void detach(uint8_t socketId);
+
+	//! It waits until some attached socket is ready
+	/*!
+	\param uint32_t timeout: milliseconds to wait, '0' to check once
+	\return mask of sockets (bit 'socketId') with data buffered or closed
+	 */
+	uint8_t poll(uint32_t timeout);
+
+	//! Number of bytes buffered for 'socketId'
+	uint16_t available(uint8_t socketId);
+
+	//! It reads one byte of 'socketId'; -1 if none is buffered
+	int read(uint8_t socketId);
+
+	//! It reads up to 'length' bytes of 'socketId'
+	/*!
+	\return number of bytes copied to 'data'
+	 */
+	uint16_t read(uint8_t socketId, uint8_t* data, uint16_t length);
+
+	//! It returns true once the module reported 'socketId' closed. It is
+	//! cleared when the socket is attached again
+	bool closed(uint8_t socketId) { return (_closed >> socketId) & 0x01; }
+};
+
+
 //! Wasp4G class
 
+/*!
+ * Progress of an OTA download, kept in LE910_OTA_RESUME_FILE so an
+ * interrupted download continues where it stopped
+ */
+struct Wasp4GOtaProgress
+{
+	char name[8];		// binary file announced in UPGRADE.TXT
+	uint32_t size;		// announced size
+	uint32_t crc;		// announced CRC-32, '0' if none
+	uint32_t done;		// bytes written to the SD file and synchronized
+	uint32_t doneCrc;	// CRC-32 of those bytes
+};
+
 class Wasp4G : public WaspUART
 {
 
@@ -167,6 +403,29 @@ private:
 
 	uint8_t module_version = 0;
 
+	//! It reads the URCs straight from the UART
+	friend class Wasp4GSocketMux;
+
+	//! The module is in data mode sending unsolicited NMEA sentences
+	bool _gpsStreaming = false;
+
+	Wasp4GNmeaParser _nmea;
+
+	//! It copies the fields of a decoded sentence to the GPS attributes
+	void gpsStreamPublish(uint8_t sentence);
+
+	/*! This function wakes the module if it was left registered in PSM by a
+	 * previous boot (i.e. while Waspmote was in deep sleep with SOCKET1_ON),
+	 * so its initialization can be skipped. The session is recorded in
+	 * EEPROM because the RAM does not survive the reset
+	 *
+	 * @return '0' if the session can be reused; '1' otherwise
+	 */
+	uint8_t resume();
+
+	//! It records in EEPROM whether the module is left in a PSM session
+	void setSession(uint8_t session);
+
 	/*! This function parses the error copde returned by the module. At the
 	 * point this function is called, the UART is supposed to have received:
 	 * "+CME ERROR: <err>\r\n" and the first part of the response has been
@@ -223,6 +482,48 @@ private:
 	*/
 	uint8_t httpWaitResponse(uint32_t wait_timeout);
 
+	//! This function waits the URC code and opens the HTTP data for reading
+	/*!
+	 * The body is not copied into '_buffer', it is left in the UART to be
+	 * read through 'httpStream'
+	\param	uint32_t wait_timeout: timeout for URC
+	\return 	0 if OK
+				1 to 8 same error codes as httpWaitResponse()
+	 */
+	uint8_t httpOpenResponse(uint32_t wait_timeout);
+
+	/*! This function downloads the OTA binary through FTP into a file of
+	 * the SD card allocated at once in contiguous clusters. The next packet
+	 * is requested before writing the last one, so the module sends it while
+	 * the SD card writes, and the CRC-32 is computed on the fly. The progress
+	 * is saved every LE910_OTA_CHECKPOINT bytes and a download of the same
+	 * file, size and CRC continues from there (AT#FTPREST). Once complete,
+	 * the file is read back and its CRC checked.
+	 *
+	 * @return	0 if OK
+	 *			1 if the size is zero
+	 *			2 if error reading the file size in the server
+	 *			3 if SD not present
+	 *			4 if error creating the file in SD
+	 *			5 if error opening the file
+	 *			6 if error setting the pointer of the file
+	 *			7 if error opening the GET connection
+	 *			8 if the module returns an error code requesting data
+	 *			9 if error getting the packet size
+	 *			10 if packet size mismatch
+	 *			11 if error writing SD
+	 *			12 if no more retries getting data
+	 *			13 if the server size does not match 'size'
+	 *			14 if the CRC does not match (the file is deleted)
+	 */
+	uint8_t otaDownload(char* name, uint32_t size, uint32_t crc, bool checkCrc);
+
+	//! It reads LE910_OTA_RESUME_FILE. '0' if OK; '1' if there is none
+	uint8_t otaLoadProgress(Wasp4GOtaProgress* progress);
+
+	//! It writes LE910_OTA_RESUME_FILE. '0' if OK; '1' if error
+	uint8_t otaSaveProgress(Wasp4GOtaProgress* progress);
+
 	uint8_t check_DS2413();
 
 	uint8_t write_DS2413(uint8_t byte);
@@ -261,6 +562,9 @@ public:
 	SocketStatusSSL_t socketStatusSSL[1];
 	uint8_t _wirelessNetwork;
 
+	//! Body of the last HTTP response opened with httpStreamRequest()
+	Wasp4GHttpStream httpStream;
+
 	//! Profile definition for multiple sockets
 	enum ProfileSocketEnum
 	{
@@ -296,6 +600,28 @@ public:
 		NETWORK_UTRAN_EUTRAN	= 31,
 	};
 
+	//! Power Saving Mode enumeration
+	enum PowerSavingModeEnum
+	{
+		PSM_DISABLE		= 0,
+		PSM_ENABLE		= 1,
+	};
+
+	//! eDRX mode enumeration
+	enum EdrxModeEnum
+	{
+		EDRX_DISABLE		= 0,
+		EDRX_ENABLE			= 1,
+		EDRX_ENABLE_URC		= 2,
+	};
+
+	//! eDRX access technology enumeration
+	enum EdrxAccessTechnologyEnum
+	{
+		EDRX_LTE_M		= 4,
+		EDRX_NB_IOT		= 5,
+	};
+
 	//! GPS Mode Enumeration
 	enum GPSModeEnum
 	{
@@ -397,7 +723,10 @@ public:
 	Wasp4G();
 
 	/*!
-	\brief	This function inits the LE910 module
+	\brief	This function inits the LE910 module. If setPSM() left the module
+			registered in PSM during a previous boot (i.e. while Waspmote was
+			in deep sleep) it is woken and the initialization and the network
+			attach are skipped
 	\return 0 if OK
 			1 for no comunication
 			2 if error switching CME errors to numeric response
@@ -683,6 +1012,36 @@ public:
 					char* resource,
 					char* data);
 
+	/*!
+	\brief	This function performs a HTTP request leaving the response body
+			pending in the module. The body is then read through 'httpStream'
+			as it arrives, so it is not limited by the size of '_buffer'.
+			httpCloseResponse() must be called once the body has been read.
+	\param	uint8_t method: selected HTTP method:	Wasp4G::HTTP_GET
+													Wasp4G::HTTP_HEAD
+													Wasp4G::HTTP_DELETE
+													Wasp4G::HTTP_POST
+													Wasp4G::HTTP_PUT
+	\param	char* url: host name or IP address of the server
+	\param	uint16_t port: server port
+	\param	char* resource: parameter indicating the HTTP resource, object of the request
+	\param	char* data: data to send in POST/PUT method
+	\return	0 if OK
+			1 to 27 same error codes as http()
+	*/
+	uint8_t httpStreamRequest(	uint8_t method,
+								char* url,
+								uint16_t port,
+								char* resource,
+								char* data);
+
+	/*!
+	\brief	This function discards the pending bytes of the response body
+			opened with httpStreamRequest() and waits for the final answer
+	\return	'0' if OK; '1' if error
+	*/
+	uint8_t httpCloseResponse();
+
 
 	/*!
 	\brief	This function performs a HTTP request to send data to Meshlium. It
@@ -884,6 +1243,8 @@ public:
 			22 if error downloading binary file: error writing SD
 			23 if error downloading binary file: no more retries getting data
 			24 if error downloading binary file: size mismatch
+			27 if error downloading binary file: CRC mismatch
+			28 if error applying the delta OTA patch (see Utils.applyOTAPatch())
 	*/
 	uint8_t requestOTA(char* OTA_server,
 						uint16_t OTA_port,
@@ -923,6 +1284,8 @@ public:
 			22 if error downloading binary file: error writing SD
 			23 if error downloading binary file: no more retries getting data
 			24 if error downloading binary file: size mismatch
+			27 if error downloading binary file: CRC mismatch
+			28 if error applying the delta OTA patch (see Utils.applyOTAPatch())
 	*/
 	uint8_t requestOTA(	char* ftp_server,
 						uint16_t ftp_port,
@@ -1246,6 +1609,7 @@ public:
 			6 if error reading incoming bytes
 	*/
 	uint8_t receive(uint8_t socketId, uint32_t timeout);
+	uint8_t receive(uint8_t socketId, uint32_t timeout, uint16_t max_bytes);
 
 	/*!
 	\brief	This function reads data received in the module through SSL socket
@@ -1408,6 +1772,32 @@ public:
 	//! It gets the NMEA string
 	bool getNMEAString(uint8_t NMEA);
 
+	/*!
+	\brief	It enables the unsolicited GGA, GSA and RMC sentences. The module
+			stays in data mode sending them, so no other command can be sent
+			until gpsStreamStop(). The GPS must be started with gpsStart()
+	\return	'0' if OK; '1' if already streaming; '2' if error
+	 */
+	uint8_t gpsStreamStart();
+
+	/*!
+	\brief	It decodes the NMEA characters received so far without waiting
+			and updates the GPS attributes (position, HDOP, satellites...)
+			with every valid sentence
+	\return	mask of the sentences decoded: NMEA_SENTENCE_GGA,
+			NMEA_SENTENCE_GSA, NMEA_SENTENCE_RMC
+	 */
+	uint8_t gpsStreamRead();
+
+	/*!
+	\brief	It leaves the data mode and stops the unsolicited sentences
+	\return	'0' if OK; '1' if error
+	 */
+	uint8_t gpsStreamStop();
+
+	//! It returns true while the unsolicited sentences are enabled
+	bool gpsStreaming() { return _gpsStreaming; }
+
 	//! It sets the quality of service of GPS
 	uint8_t gpsSetQualityOfService(	uint32_t horiz_accuracy,
 									uint16_t vertic_accuracy,
@@ -1468,6 +1858,32 @@ public:
 	 */
 	uint8_t setWirelessNetwork(uint8_t n);
 
+	/*!
+	\brief 	This function requests the 3GPP Power Saving Mode (AT+CPSMS). The
+			module stays registered while sleeping, so ON() can resume the
+			session after Waspmote wakes up if the module is not switched off.
+			Resuming needs the DS2413 to pulse the ON_OFF line
+	\param 	uint8_t mode: Wasp4G::PSM_DISABLE or Wasp4G::PSM_ENABLE
+	\param 	char* tau: requested periodic TAU (T3412) as 8 bit string,
+			i.e. "00100001" for 1 hour
+	\param 	char* activeTime: requested active time (T3324) as 8 bit string,
+			i.e. "00000101" for 10 seconds
+	\return	0 if OK
+			1 if error
+	 */
+	uint8_t setPSM(uint8_t mode, char* tau, char* activeTime);
+
+	/*!
+	\brief 	This function sets the eDRX parameters (AT+CEDRXS)
+	\param 	uint8_t mode: Wasp4G::EDRX_DISABLE, Wasp4G::EDRX_ENABLE or
+			Wasp4G::EDRX_ENABLE_URC
+	\param 	uint8_t accessTechnology: Wasp4G::EDRX_LTE_M or Wasp4G::EDRX_NB_IOT
+	\param 	char* cycle: requested eDRX cycle as 4 bit string, i.e. "0101"
+	\return	0 if OK
+			1 if error
+	 */
+	uint8_t setEDRX(uint8_t mode, uint8_t accessTechnology, char* cycle);
+
 	/*!
 	\brief 	This function gets the current Wireless Network.
 			The _wirelessNetwork parameter will store the WDS-Side Stack
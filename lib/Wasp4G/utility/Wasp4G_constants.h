@@ -40,6 +40,18 @@
  ******************************************************************************/
 
 
+/// answers  ///////////////////////////////////////////////////////////////////
+
+// Flash copies of the module answers, for waitFor_P() and sendCommand_P()
+const char LE910_OK_P[]					PROGMEM = "OK";
+const char LE910_ERROR_P[]				PROGMEM = "ERROR\r\n";
+const char LE910_ERROR_CODE_P[]			PROGMEM = "ERROR:";
+const char LE910_DATA_TO_MODULE_P[]		PROGMEM = ">>>";
+const char LE910_DATA_FROM_MODULE_P[]	PROGMEM = "<<<";
+const char LE910_CR_P[]					PROGMEM = "\r";
+const char LE910_CONNECT_P[]			PROGMEM = "CONNECT";
+
+
 /// table_4G  //////////////////////////////////////////////////////////////////
 
 const char LE910_string_00[]	PROGMEM = "AT+CREG?\r";						//0
@@ -87,6 +99,10 @@ const char LE910_string_41[]	PROGMEM = "AT+CEREG?\r";					//41
 const char LE910_string_42[]	PROGMEM = "+CEREG: 0,";						//42
 const char LE910_string_43[]	PROGMEM = "AT+WS46?\r";						//43
 const char LE910_string_44[]	PROGMEM = "AT#SHDN\r";						//44
+const char LE910_string_45[]	PROGMEM = "AT+CPSMS=1,,,\"%s\",\"%s\"\r";	//45
+const char LE910_string_46[]	PROGMEM = "AT+CPSMS=0\r";					//46
+const char LE910_string_47[]	PROGMEM = "AT+CEDRXS=%u,%u,\"%s\"\r";		//47
+const char LE910_string_48[]	PROGMEM = "AT+CEDRXS=0\r";					//48
 
 const char* const table_4G[] PROGMEM = 
 {
@@ -135,6 +151,10 @@ const char* const table_4G[] PROGMEM =
 	LE910_string_42,
 	LE910_string_43,
 	LE910_string_44,
+	LE910_string_45,
+	LE910_string_46,
+	LE910_string_47,
+	LE910_string_48,
 };
 
 
@@ -272,6 +292,7 @@ const char LE910_FTP_14[]	PROGMEM = "AT#FTPDELE=\"%s\"\r";			// 14
 const char LE910_FTP_15[]	PROGMEM = "AT#FTPPWD\r";					// 15
 const char LE910_FTP_16[]	PROGMEM = "AT#FTPLIST\r";					// 16
 const char LE910_FTP_17[]	PROGMEM = "AT#FTPCWD=\"%s\"\r";				// 17
+const char LE910_FTP_18[]	PROGMEM = "AT#FTPREST=%lu\r";				// 18
 
 const char* const table_FTP[] PROGMEM = 
 {
@@ -293,6 +314,7 @@ const char* const table_FTP[] PROGMEM =
 	LE910_FTP_15,
 	LE910_FTP_16,
 	LE910_FTP_17,
+	LE910_FTP_18,
 };
 
 
@@ -453,6 +475,7 @@ const char LE910_OTA_02[]	PROGMEM = "FILE:";			//2
 const char LE910_OTA_03[]	PROGMEM = "PATH:";			//3
 const char LE910_OTA_04[]	PROGMEM = "SIZE:";			//4
 const char LE910_OTA_05[]	PROGMEM = "VERSION:";		//5
+const char LE910_OTA_06[]	PROGMEM = "CRC:";			//6
 
 const char* const table_OTA_LE910[] PROGMEM = 
 {
@@ -462,6 +485,7 @@ const char* const table_OTA_LE910[] PROGMEM =
 	LE910_OTA_03,
 	LE910_OTA_04,
 	LE910_OTA_05,
+	LE910_OTA_06,
 };
 
 
@@ -59,7 +59,7 @@ void WaspSensorSWIons::ON(void)
 	// Turn on the power switches in Waspmote
 	PWR.setSensorPower(SENS_5V, SENS_ON);
 	PWR.setSensorPower(SENS_3V3, SENS_ON);
-	delay(1000);
+	delayIdle(1000);
 	
 	// These pins manage the analog multiplexor
 	// Digital pin 2 is for selecting
@@ -166,7 +166,7 @@ float ionSensorClass::read(void)
 	// Ence the multiplexer is configured, configure and red the ADC
 	// Ion Sensors are connected in AIN1, and temperature in AIN2
 	myADC.configure(AIN1);
-	delay(2500);
+	delayIdle(2500);
 	
 	return myADC.readADC(AIN1);
 	
@@ -460,7 +460,7 @@ float pt1000Class::read(void)
 {
 	// Temperature sensor is connected in AIN2 of the ADC
 	myADC.configure(AIN2);
-	delay(2000);
+	delayIdle(2000);
 
 	float value = myADC.readADC(AIN2);  
 
@@ -515,7 +515,7 @@ float socket1Class::read()
 	
 	//Configure and read from the ADC 
 	myADC.configure(AIN1);
-	delay(2500);
+	delayIdle(2500);
 	
 	return myADC.readADC(AIN1);
 }
@@ -552,7 +552,7 @@ float socket2Class::read()
 	
 	//Configure and read from the ADC
 	myADC.configure(AIN1);
-	delay(2500);
+	delayIdle(2500);
 
 	return myADC.readADC(AIN1);
 }
@@ -590,7 +590,7 @@ float socket3Class::read()
 	
 	//Configure and read from the ADC
 	myADC. configure(AIN1);
-	delay(2500);
+	delayIdle(2500);
 	return myADC.readADC(AIN1);
 }
 
@@ -627,7 +627,7 @@ float socket4Class::read()
 	
 	//Configure and read from the ADC
 	myADC.configure(AIN1);
-	delay(2500);
+	delayIdle(2500);
 	return myADC.readADC(AIN1);
 }
 
@@ -2,8 +2,17 @@
 #include <Wasp4G.h>
 #include <smartWaterIons.h>
 #include <ArduinoJson.h>
+#include <JsonStreamFilter.h>
+#include <EepromConfig.h>
+#include <StreamingStats.h>
+#include <WallClock.h>
+#include <UsbLog.h>
+#include <HttpKeepAlive.h>
 
 #define PYTHON_GRAPH_OUT_ENABLE true
+// Graph samples as binary frames (PlotSeries.py --binary) instead of text lines
+#define PYTHON_GRAPH_BINARY_FRAMES false
+#define PYTHON_GRAPH_FRAME_IONS 1
 
 #define CONCENTRATION_ION_POINT_1 0.5F
 #define CONCENTRATION_ION_POINT_2 150.0F
@@ -30,19 +39,56 @@
 #define _4G_APN_USER "webgprs"
 #define _4G_APN_PASS "webgprs2002"
 
+// Power Saving Mode keeps the LE910 registered while Waspmote sleeps, so the
+// next _4G.ON() resumes the session instead of booting and attaching again.
+// SOCKET1 then stays powered during the deep sleep (SOCKET1_ON), which costs
+// the sleep current of the module. The periodic TAU must be longer than the
+// sleeping time. Waking the module needs a 4G board with the DS2413
+#define _4G_PSM_ENABLE true
+#define _4G_PSM_PERIODIC_TAU "00100001" // 1 hour
+#define _4G_PSM_ACTIVE_TIME "00000000"  // sleep right after the connection is released
+
 #define SERVER_HOST "clustervalley.agricos.mx"
 #define SERVER_PORT 80
 #define SERVER_RESOURCE "/api/Measure"
+// Socket of the module kept open for the POSTs of a cycle
+#define SERVER_SOCKET Wasp4G::CONNECTION_1
 
-// Global static resource for output data
-char http_data[512];
+// Global static resource for output data, never reallocated
+FixedString<767> http_data;
 
 #define CONCENTRATION_CALCULATION_MINUTES 30
+
+// Remote configuration, the defines above are the defaults used until a
+// valid configuration block is stored in EEPROM
+#define NODE_CONFIG_EEPROM_ADDRESS EEPROM_START
+#define NODE_CONFIG_LAYOUT_VERSION 1
+#define NODE_CONFIG_SMS_PREFIX "CFG "
+#define NODE_CONFIG_SMS_TIMEOUT 5000
 #define SECONDS_TO_MILIS(milis) (milis * 1000.0f)
 #define MINUTES_TO_SECONDS(min) (min * 60.0f)
 
 #define MINUTES_TO_MILLIS(min) (SECONDS_TO_MILIS(MINUTES_TO_SECONDS(min)))
 
+// Adaptive sampling, the interval between samples grows while the sensor
+// voltages are stable and shrinks when their variance exceeds the threshold
+#define ADAPTIVE_SAMPLING_MIN_INTERVAL 2000UL
+#define ADAPTIVE_SAMPLING_MAX_INTERVAL 60000UL
+#define ADAPTIVE_SAMPLING_VARIANCE_THRESHOLD 0.0001F // 10mV standard deviation
+#define ADAPTIVE_SAMPLING_ALPHA 0.2F
+#define ADAPTIVE_SAMPLING_WARMUP 5
+
+// Adds the median of every measure to the summary uploaded per window,
+// costs ~60 bytes of RAM per measure
+#define MEASURE_STATS_MEDIAN_ENABLE false
+
+// Reports the lowest free RAM of every phase (see MemoryFree.h) with each upload
+#define MEMORY_REPORT_ENABLE true
+#define MEMORY_PHASE_SAMPLE 0
+#define MEMORY_PHASE_SERIALIZE 1
+#define MEMORY_PHASE_UPLOAD 2
+#define MEMORY_CARRY_LAYOUT_VERSION 1
+
 void configure();
 void updateTime();
 void updateIonsConcentration();
@@ -51,8 +97,18 @@ void getTimeFrom4G();
 void awaitTimeBackground(long _delay, void (*process)(long));
 bool timeoutFunction(long timeout, bool (*process)(long));
 void ionsProcessFunc(long);
-void addMeasureToArray(JsonArray &arr, float _measure, const __FlashStringHelper *code);
+JsonObject addMeasureToArray(JsonArray &arr, float _measure, const __FlashStringHelper *code);
 void buildMeasuresJson();
+void loadConfig();
+void applyConfig();
+void receiveConfigFromSMS();
+bool configMemberHandler(const char *key, JsonVariant value);
+bool copyConfigPoints(float *points, JsonVariant value);
+bool copyConfigString(char *str, size_t size, JsonVariant value);
+void commitPendingConfig();
+void addMemoryToJson();
+void saveMemoryPhases();
+void logMemory();
 
 typedef enum
 {
@@ -71,8 +127,12 @@ private:
   float _voltage;
 
 public:
-  GenericIonSensor(IonSocket_e socket, float v_points[], float c_points[], uint8_t noPoints)
+  GenericIonSensor(IonSocket_e socket, const float v_points[], const float c_points[], uint8_t noPoints)
       : internal(socket), _socket(socket)
+  {
+    setCalibration(v_points, c_points, noPoints);
+  }
+  void setCalibration(const float v_points[], const float c_points[], uint8_t noPoints)
   {
     internal.setCalibrationPoints(v_points, c_points, noPoints);
   }
@@ -97,6 +157,83 @@ public:
   }
 };
 
+class AdaptiveSampler
+{
+private:
+  GenericIonSensor **_sensors;
+  uint8_t _count;
+  float _mean[NO_ION_SENSORS];
+  float _variance[NO_ION_SENSORS];
+  uint8_t _samples;
+  unsigned long _interval;
+  unsigned long _minInterval;
+  unsigned long _maxInterval;
+  float _threshold;
+
+public:
+  AdaptiveSampler(GenericIonSensor *sensors[], uint8_t count,
+                  unsigned long minInterval, unsigned long maxInterval, float threshold)
+      : _sensors(sensors), _count(count < NO_ION_SENSORS ? count : NO_ION_SENSORS),
+        _minInterval(minInterval), _maxInterval(maxInterval), _threshold(threshold)
+  {
+    reset();
+  }
+  void reset()
+  {
+    _samples = 0;
+    _interval = _minInterval;
+  }
+  // Feeds the last voltage of every sensor and returns the milliseconds to wait
+  // until the next sample. Mean and variance are exponentially weighted so the
+  // interval follows the recent behaviour of the signal instead of the whole window
+  unsigned long update()
+  {
+    bool unstable = false;
+    bool stable = true;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+      float x = _sensors[i]->voltage();
+      if (_samples == 0)
+      {
+        _mean[i] = x;
+        _variance[i] = 0;
+        continue;
+      }
+      float diff = x - _mean[i];
+      float increment = ADAPTIVE_SAMPLING_ALPHA * diff;
+      _mean[i] += increment;
+      _variance[i] = (1.0F - ADAPTIVE_SAMPLING_ALPHA) * (_variance[i] + diff * increment);
+
+      if (_variance[i] > _threshold)
+        unstable = true;
+      else if (_variance[i] > _threshold / 4)
+        stable = false; // Hysteresis band, keep the current interval
+    }
+
+    if (_samples < ADAPTIVE_SAMPLING_WARMUP)
+    {
+      _samples++;
+    }
+    else if (unstable)
+    {
+      _interval = max(_minInterval, _interval / 2);
+    }
+    else if (stable)
+    {
+      _interval = min(_maxInterval, _interval + _interval / 2);
+    }
+    return _interval;
+  }
+  unsigned long interval() const
+  {
+    return _interval;
+  }
+  float variance(uint8_t channel) const
+  {
+    return _variance[channel];
+  }
+};
+
 class BatteryInfo
 {
 public:
@@ -107,13 +244,13 @@ public:
 
   void printStatus()
   {
-    USB.print(F("       Battery: ["));
-    USB.print(getChargePercent(), DEC);
-    USB.print(F("%, "));
-    USB.print(getVoltage());
-    USB.print(F("V, "));
-    USB.print(isCharging() ? F(" charging") : F(" discharging"));
-    USB.println(F("]"));
+    UsbLog.print(F("       Battery: ["));
+    UsbLog.print(getChargePercent(), DEC);
+    UsbLog.print(F("%, "));
+    UsbLog.print(getVoltage());
+    UsbLog.print(F("V, "));
+    UsbLog.print(isCharging() ? F(" charging") : F(" discharging"));
+    UsbLog.println(F("]"));
   }
 };
 
@@ -132,9 +269,50 @@ public:
 
   void printStatus()
   {
-    USB.print(F("   Temperature: "));
-    USB.print(temperature);
-    USB.println(F("°C"));
+    UsbLog.print(F("   Temperature: "));
+    UsbLog.print(temperature);
+    UsbLog.println(F("°C"));
+  }
+};
+
+// Summary of one measure over the sampling window
+class MeasureStats
+{
+private:
+  RunningStats stats;
+#if MEASURE_STATS_MEDIAN_ENABLE
+  P2Quantile median;
+#endif
+
+public:
+#if MEASURE_STATS_MEDIAN_ENABLE
+  MeasureStats() : median(0.5F) {}
+#endif
+  void clear()
+  {
+    stats.clear();
+#if MEASURE_STATS_MEDIAN_ENABLE
+    median.clear();
+#endif
+  }
+  void add(float value)
+  {
+    stats.add(value);
+#if MEASURE_STATS_MEDIAN_ENABLE
+    median.add(value);
+#endif
+  }
+  // 'v' keeps being the measure value (the mean now) so the server reads it as before
+  void addToJson(JsonArray &arr, const __FlashStringHelper *code)
+  {
+    JsonObject measure = addMeasureToArray(arr, stats.mean(), code);
+    measure["n"] = stats.count();
+    measure["lo"] = stats.minimum();
+    measure["hi"] = stats.maximum();
+    measure["sd"] = stats.stddev();
+#if MEASURE_STATS_MEDIAN_ENABLE
+    measure["p50"] = median.value();
+#endif
   }
 };
 
@@ -143,11 +321,11 @@ struct IonMeasures
 private:
   void printConcentration(const __FlashStringHelper *name, float concentration, float rawVoltage)
   {
-    USB.print(name);
-    USB.print(concentration);
-    USB.print(F("ppm - "));
-    USB.print(rawVoltage);
-    USB.println(F("mV"));
+    UsbLog.print(name);
+    UsbLog.print(concentration);
+    UsbLog.print(F("ppm - "));
+    UsbLog.print(rawVoltage);
+    UsbLog.println(F("mV"));
   }
 
 public:
@@ -161,25 +339,55 @@ public:
   float nitrateVoltage;
   float potassiumVoltage;
 
+  MeasureStats calciumStats;
+  MeasureStats nitrateStats;
+  MeasureStats potassiumStats;
+  MeasureStats temperatureStats;
+  MeasureStats batteryStats;
+
+  // Adds the current values to the window statistics
+  void accumulate()
+  {
+    calciumStats.add(calciumConcentration);
+    nitrateStats.add(nitrateConcentration);
+    potassiumStats.add(potassiumConcentration);
+    temperatureStats.add(temperature);
+    batteryStats.add(batteryLevel);
+  }
+
+  void clearStats()
+  {
+    calciumStats.clear();
+    nitrateStats.clear();
+    potassiumStats.clear();
+    temperatureStats.clear();
+    batteryStats.clear();
+  }
+
   void addMeasuresToJson(JsonArray &measures)
   {
-    addMeasureToArray(measures, calciumConcentration, F("cCa"));
-    addMeasureToArray(measures, nitrateConcentration, F("cNo3"));
-    addMeasureToArray(measures, potassiumConcentration, F("cK"));
-    addMeasureToArray(measures, temperature, F("ion_temp"));
-    addMeasureToArray(measures, batteryLevel, F("ion_bl"));
+    calciumStats.addToJson(measures, F("cCa"));
+    nitrateStats.addToJson(measures, F("cNo3"));
+    potassiumStats.addToJson(measures, F("cK"));
+    temperatureStats.addToJson(measures, F("ion_temp"));
+    batteryStats.addToJson(measures, F("ion_bl"));
   }
 
-  void serializeToUSB()
+  void serializeToUSB(long restingTime)
   {
-#if PYTHON_GRAPH_OUT_ENABLE
-    USB.print(calciumVoltage);
-    USB.print(" ");
-    USB.print(nitrateVoltage);
-    USB.print(" ");
-    USB.println(potassiumVoltage);
+#if PYTHON_GRAPH_OUT_ENABLE && PYTHON_GRAPH_BINARY_FRAMES
+    float values[] = {(float)restingTime, calciumVoltage, nitrateVoltage, potassiumVoltage};
+    UsbLog.frame(PYTHON_GRAPH_FRAME_IONS, values, 4);
+#elif PYTHON_GRAPH_OUT_ENABLE
+    UsbLog.print(restingTime);
+    UsbLog.print(' ');
+    UsbLog.print(calciumVoltage);
+    UsbLog.print(' ');
+    UsbLog.print(nitrateVoltage);
+    UsbLog.print(' ');
+    UsbLog.println(potassiumVoltage);
 #else
-    USB.println(F(" Ion measures ---------------------------------------------"));
+    UsbLog.println(F(" Ion measures ---------------------------------------------"));
     printConcentration(F("       Calcium: "), calciumConcentration, calciumVoltage);
     printConcentration(F("       Nitrate: "), nitrateConcentration, nitrateVoltage);
     printConcentration(F("     Potassium: "), potassiumConcentration, potassiumVoltage);
@@ -187,51 +395,98 @@ public:
   }
 };
 
-float ionConcentrationPoints[ION_NO_POINTS] = {
-    CONCENTRATION_ION_POINT_1,
-    CONCENTRATION_ION_POINT_2,
-    CONCENTRATION_ION_POINT_3};
-float ionCalciumVoltage[ION_NO_POINTS] = {
-    ION_CALCIUM_VOLTAGE_P1,
-    ION_CALCIUM_VOLTAGE_P2,
-    ION_CALCIUM_VOLTAGE_P3};
-float ionNitrateVoltage[ION_NO_POINTS] = {
-    ION_NITRATE_VOLTAGE_P1,
-    ION_NITRATE_VOLTAGE_P2,
-    ION_NITRATE_VOLTAGE_P3};
-float ionPotassiumVoltage[ION_NO_POINTS] = {
-    ION_POTASSIUM_VOLTAGE_P1,
-    ION_POTASSIUM_VOLTAGE_P2,
-    ION_POTASSIUM_VOLTAGE_P3};
-
-GenericIonSensor calciumSensor(ION_SOCKET_A, ionCalciumVoltage, ionConcentrationPoints, ION_NO_POINTS);
-GenericIonSensor nitrateSensor(ION_SOCKET_C, ionNitrateVoltage, ionConcentrationPoints, ION_NO_POINTS);
-GenericIonSensor potassiumSensor(ION_SOCKET_D, ionPotassiumVoltage, ionConcentrationPoints, ION_NO_POINTS);
+// Binary layout stored in EEPROM, bump NODE_CONFIG_LAYOUT_VERSION on any change
+struct NodeConfig
+{
+  uint32_t revision;
+  float concentrationPoints[ION_NO_POINTS];
+  float calciumVoltage[ION_NO_POINTS];
+  float nitrateVoltage[ION_NO_POINTS];
+  float potassiumVoltage[ION_NO_POINTS];
+  uint16_t samplingMinutes;
+  char serverHost[48];
+  uint16_t serverPort;
+  char serverResource[32];
+};
+
+NodeConfig config = {
+    0,
+    {CONCENTRATION_ION_POINT_1, CONCENTRATION_ION_POINT_2, CONCENTRATION_ION_POINT_3},
+    {ION_CALCIUM_VOLTAGE_P1, ION_CALCIUM_VOLTAGE_P2, ION_CALCIUM_VOLTAGE_P3},
+    {ION_NITRATE_VOLTAGE_P1, ION_NITRATE_VOLTAGE_P2, ION_NITRATE_VOLTAGE_P3},
+    {ION_POTASSIUM_VOLTAGE_P1, ION_POTASSIUM_VOLTAGE_P2, ION_POTASSIUM_VOLTAGE_P3},
+    CONCENTRATION_CALCULATION_MINUTES,
+    SERVER_HOST,
+    SERVER_PORT,
+    SERVER_RESOURCE};
+
+// Configuration being received, committed only if it is valid and newer than 'config'
+NodeConfig pendingConfig;
+bool pendingConfigValid;
+EepromConfig configStore(NODE_CONFIG_EEPROM_ADDRESS, NODE_CONFIG_LAYOUT_VERSION, sizeof(NodeConfig));
+
+// Keys of a configuration document, i.e.
+// {"rev":2,"pts":[0.5,150,2000],"cCa":[2.78,3.5,3.7],"min":30,"port":80}
+const char *configKeys[] = {"rev", "pts", "cCa", "cNo3", "cK", "min", "host", "port", "res"};
+JsonStreamFilter configFilter(configKeys, sizeof(configKeys) / sizeof(configKeys[0]));
+
+// One connection to the server for every POST until the module sleeps
+HttpKeepAlive server(SERVER_SOCKET, false);
+
+GenericIonSensor calciumSensor(ION_SOCKET_A, config.calciumVoltage, config.concentrationPoints, ION_NO_POINTS);
+GenericIonSensor nitrateSensor(ION_SOCKET_C, config.nitrateVoltage, config.concentrationPoints, ION_NO_POINTS);
+GenericIonSensor potassiumSensor(ION_SOCKET_D, config.potassiumVoltage, config.concentrationPoints, ION_NO_POINTS);
 
 GenericIonSensor *ionSensorsBus[NO_ION_SENSORS] = {&calciumSensor, &nitrateSensor, &potassiumSensor};
+AdaptiveSampler sampler(ionSensorsBus, NO_ION_SENSORS, ADAPTIVE_SAMPLING_MIN_INTERVAL,
+                        ADAPTIVE_SAMPLING_MAX_INTERVAL, ADAPTIVE_SAMPLING_VARIANCE_THRESHOLD);
 
 StaticJsonDocument<1024> jsonDocument;
 BatteryInfo Battery;
 TemperatureInfo Temperature;
-timestamp_t Time;
-char timeString[50];
+char timeString[WALL_CLOCK_ISO8601_SIZE];
 IonMeasures measures;
 
+// Lowest free RAM while serializing and uploading. Both end after the report
+// is built, so each report carries the figures of the previous cycle, kept
+// in EEPROM right after the configuration block (RAM starts over every cycle).
+// Bump MEMORY_CARRY_LAYOUT_VERSION on any change
+struct MemoryCarry
+{
+  int serialize;
+  int upload;
+};
+EepromConfig memoryCarryStore(NODE_CONFIG_EEPROM_ADDRESS + EEPROM_CONFIG_HEADER_SIZE + sizeof(NodeConfig),
+                              MEMORY_CARRY_LAYOUT_VERSION, sizeof(MemoryCarry));
+
 void setup()
 {
 #if !PYTHON_GRAPH_OUT_ENABLE
-  USB.println(F("Configuring ION..."));
+  LOG_INFO("Configuring ION...");
 #endif
   configure();
 #if !PYTHON_GRAPH_OUT_ENABLE
-  USB.println(F("Reading ION..."));
+  LOG_INFO("Reading ION...");
 #endif
-  awaitTimeBackground(MINUTES_TO_MILLIS(CONCENTRATION_CALCULATION_MINUTES), ionsProcessFunc);
-  USB.println(F("Creating json output"));
+  measures.clearStats();
+  memoryPhase(MEMORY_PHASE_SAMPLE);
+  awaitTimeBackground(MINUTES_TO_MILLIS(config.samplingMinutes), ionsProcessFunc);
+  LOG_INFO("Creating json output");
+  memoryPhase(MEMORY_PHASE_SERIALIZE);
   buildMeasuresJson();
-  USB.println(F("Posting to server data"));
+  LOG_INFO("Posting to server data");
+  memoryPhase(MEMORY_PHASE_UPLOAD);
   sendDataToServer();
+  memoryPhase(MEMORY_PHASE_NONE);
+  saveMemoryPhases();
+  logMemory();
+  // The module only enters PSM once the connection is released
+  server.close();
+#if _4G_PSM_ENABLE && !PYTHON_GRAPH_OUT_ENABLE
+  PWR.deepSleep("31:00:00:00", RTC_OFFSET, RTC_ALM1_MODE1, SOCKET1_ON);
+#else
   PWR.deepSleep("31:00:00:00", RTC_OFFSET, RTC_ALM1_MODE1, ALL_OFF);
+#endif
 }
 
 void loop() {}
@@ -239,40 +494,34 @@ void loop() {}
 void configure()
 {
   USB.ON();
+  loadConfig();
 #if !PYTHON_GRAPH_OUT_ENABLE
-  USB.println(F("   RTC: ON"));
+  LOG_INFO("   RTC: ON");
   RTC.ON();
-  USB.println(F("   4G: ON"));
+  LOG_INFO("   4G: ON");
   _4G.ON();
   _4G.set_APN(_4G_APN_HOST, _4G_APN_USER, _4G_APN_PASS);
+#if _4G_PSM_ENABLE
+  _4G.setPSM(Wasp4G::PSM_ENABLE, _4G_PSM_PERIODIC_TAU, _4G_PSM_ACTIVE_TIME);
+#endif
 #endif
 #if !PYTHON_GRAPH_OUT_ENABLE
-  USB.println(F("   SmartWaterBoard: ON"));
+  LOG_INFO("   SmartWaterBoard: ON");
 #endif
   SWIonsBoard.ON();
   pinMode(DIGITAL8, OUTPUT);
   digitalWrite(DIGITAL8, LOW);
 #if !PYTHON_GRAPH_OUT_ENABLE
-  USB.println(F("   Get time from 4G"));
+  LOG_INFO("   Get time from 4G");
   getTimeFrom4G();
+  LOG_INFO("   Check configuration SMS");
+  receiveConfigFromSMS();
 #endif
 }
 
 void updateTime()
 {
-  RTC.getTime();
-  Time.second = RTC.second;
-  Time.minute = RTC.minute;
-  Time.hour = RTC.hour;
-  Time.day = RTC.day;
-  Time.date = RTC.date;
-  Time.month = RTC.month;
-  Time.year = RTC.year;
-
-  for (size_t i = 0; i < 50; i++)
-    timeString[i] = 0x00;
-  sprintf(timeString, "20%i-%02i-%02iT%02i:%02i:%02iZ",
-          Time.year, Time.month, Time.day, Time.hour, Time.minute, Time.second);
+  Clock.getISO8601(timeString, sizeof(timeString));
 }
 
 void updateIonsConcentration()
@@ -285,8 +534,43 @@ void updateIonsConcentration()
 
 void sendDataToServer()
 {
-  _4G.httpSetContentType("application/json");
-  _4G.http(Wasp4G::HTTP_POST, SERVER_HOST, SERVER_PORT, SERVER_RESOURCE, http_data);
+  // A truncated document would be rejected by the server anyway
+  if (http_data.overflow())
+  {
+    LOG_ERROR("Measures do not fit in %u bytes", (unsigned int)http_data.capacity());
+    return;
+  }
+  uint16_t status;
+  uint8_t error = server.connect(config.serverHost, config.serverPort);
+  if (error == 0)
+  {
+    error = server.post(config.serverResource, "application/json", (uint8_t *)http_data.c_str(), http_data.length());
+  }
+  if (error == 0)
+  {
+    error = server.readHeaders(&status);
+  }
+  if (error != 0)
+  {
+    LOG_ERROR("POST to %s failed: %u", config.serverHost, (unsigned int)error);
+    return;
+  }
+  if ((status >= 200) && (status < 300))
+  {
+    // The server may answer with a configuration document
+    pendingConfig = config;
+    pendingConfigValid = true;
+    if (configFilter.parse(server, jsonDocument, configMemberHandler) == DeserializationError::Ok)
+    {
+      commitPendingConfig();
+    }
+    jsonDocument.clear();
+  }
+  else
+  {
+    LOG_ERROR("POST to %s answered %u", config.serverHost, (unsigned int)status);
+  }
+  server.endResponse();
 }
 
 void getTimeFrom4G()
@@ -295,6 +579,8 @@ void getTimeFrom4G()
     return !_4G.checkConnection(1);
   });
   _4G.setTimeFrom4G();
+  // The RTC has just been set, seed the software clock from it
+  Clock.sync();
 }
 
 void awaitTimeBackground(long _delay, void (*process)(long))
@@ -330,7 +616,7 @@ bool timeoutFunction(long timeout, bool (*process)(long))
 void ionsProcessFunc(long restingTime)
 {
 #if !PYTHON_GRAPH_OUT_ENABLE
-  USB.println(F(" Update ion concentration measures"));
+  LOG_INFO(" Update ion concentration measures");
 #endif
   updateIonsConcentration();
 
@@ -342,35 +628,31 @@ void ionsProcessFunc(long restingTime)
   measures.potassiumVoltage = potassiumSensor.voltage();
   measures.batteryLevel = Battery.getChargePercent();
   measures.temperature = Temperature.read();
+  measures.accumulate();
+  unsigned long interval = sampler.update();
 
 #if !PYTHON_GRAPH_OUT_ENABLE
-  if (restingTime < 0)
-  {
-    USB.println(F(" Resting seconds: 0s"));
-  }
-  else
-  {
-    USB.print(F(" Resting seconds: "));
-    USB.print(restingTime / 1000);
-    USB.println(F("s"));
-  }
-#else
-  USB.print(restingTime);
-  USB.print(" ");
+  LOG_INFO(" Resting seconds: %lds", restingTime < 0 ? 0L : restingTime / 1000);
 #endif
-  measures.serializeToUSB();
+  measures.serializeToUSB(restingTime);
 #if !PYTHON_GRAPH_OUT_ENABLE
   Battery.printStatus();
   Temperature.printStatus();
-  USB.println();
+  LOG_INFO(" Next sample in: %lus", interval / 1000);
 #endif
+  // Never wait past the end of the sampling window
+  if (restingTime > 0)
+  {
+    delay(min(interval, (unsigned long)restingTime));
+  }
 }
 
-void addMeasureToArray(JsonArray &arr, float _measure, const __FlashStringHelper *code)
+JsonObject addMeasureToArray(JsonArray &arr, float _measure, const __FlashStringHelper *code)
 {
   JsonObject measure = arr.createNestedObject();
   measure["m"] = code;
   measure["v"] = _measure;
+  return measure;
 }
 
 void buildMeasuresJson()
@@ -378,10 +660,177 @@ void buildMeasuresJson()
   JsonObject dispositivo = jsonDocument.createNestedArray("d").createNestedObject();
   JsonArray mediciones = dispositivo.createNestedArray("m");
 
+  updateTime();
   jsonDocument["s"] = timeString;
   dispositivo["k"] = ION_STATION_CODE;
   measures.addMeasuresToJson(mediciones);
+  addMemoryToJson();
 
+  http_data.clear();
   serializeJson(jsonDocument, http_data);
   jsonDocument.clear();
 }
+
+void loadConfig()
+{
+  if (configStore.load(&config))
+  {
+#if !PYTHON_GRAPH_OUT_ENABLE
+    LOG_INFO("   Configuration revision: %lu", (unsigned long)config.revision);
+#endif
+  }
+  applyConfig();
+}
+
+void applyConfig()
+{
+  calciumSensor.setCalibration(config.calciumVoltage, config.concentrationPoints, ION_NO_POINTS);
+  nitrateSensor.setCalibration(config.nitrateVoltage, config.concentrationPoints, ION_NO_POINTS);
+  potassiumSensor.setCalibration(config.potassiumVoltage, config.concentrationPoints, ION_NO_POINTS);
+}
+
+void receiveConfigFromSMS()
+{
+  if (_4G.configureSMS() != 0 || _4G.readNewSMS(NODE_CONFIG_SMS_TIMEOUT) != 0)
+  {
+    return;
+  }
+
+  char *body = (char *)_4G._buffer;
+  uint8_t prefixLength = strlen(NODE_CONFIG_SMS_PREFIX);
+  // Skip the line break between header and body
+  while (*body == '\r' || *body == '\n')
+    body++;
+  if (strncmp(body, NODE_CONFIG_SMS_PREFIX, prefixLength) != 0)
+  {
+    return;
+  }
+
+  pendingConfig = config;
+  pendingConfigValid = true;
+  if (deserializeJson(jsonDocument, body + prefixLength) == DeserializationError::Ok)
+  {
+    for (JsonPair member : jsonDocument.as<JsonObject>())
+    {
+      if (!configMemberHandler(member.key().c_str(), member.value()))
+        break;
+    }
+    commitPendingConfig();
+  }
+  jsonDocument.clear();
+  _4G.deleteSMS(_4G._smsIndex);
+}
+
+// Returns false to stop parsing when a member is malformed, the whole document is discarded then
+bool configMemberHandler(const char *key, JsonVariant value)
+{
+  bool valid = true;
+  if (strcmp(key, "rev") == 0)
+    pendingConfig.revision = value.as<uint32_t>();
+  else if (strcmp(key, "pts") == 0)
+    valid = copyConfigPoints(pendingConfig.concentrationPoints, value);
+  else if (strcmp(key, "cCa") == 0)
+    valid = copyConfigPoints(pendingConfig.calciumVoltage, value);
+  else if (strcmp(key, "cNo3") == 0)
+    valid = copyConfigPoints(pendingConfig.nitrateVoltage, value);
+  else if (strcmp(key, "cK") == 0)
+    valid = copyConfigPoints(pendingConfig.potassiumVoltage, value);
+  else if (strcmp(key, "min") == 0)
+    pendingConfig.samplingMinutes = value.as<uint16_t>();
+  else if (strcmp(key, "host") == 0)
+    valid = copyConfigString(pendingConfig.serverHost, sizeof(pendingConfig.serverHost), value);
+  else if (strcmp(key, "port") == 0)
+    pendingConfig.serverPort = value.as<uint16_t>();
+  else if (strcmp(key, "res") == 0)
+    valid = copyConfigString(pendingConfig.serverResource, sizeof(pendingConfig.serverResource), value);
+
+  pendingConfigValid = pendingConfigValid && valid;
+  return valid;
+}
+
+bool copyConfigPoints(float *points, JsonVariant value)
+{
+  JsonArray arr = value.as<JsonArray>();
+  if (arr.isNull() || arr.size() != ION_NO_POINTS)
+  {
+    return false;
+  }
+  for (uint8_t i = 0; i < ION_NO_POINTS; i++)
+  {
+    points[i] = arr[i].as<float>();
+  }
+  return true;
+}
+
+bool copyConfigString(char *str, size_t size, JsonVariant value)
+{
+  const char *content = value.as<const char *>();
+  if (content == NULL || strlen(content) >= size)
+  {
+    return false;
+  }
+  strcpy(str, content);
+  return true;
+}
+
+void commitPendingConfig()
+{
+  // Only newer revisions are accepted, so stale or replayed documents are ignored
+  if (!pendingConfigValid ||
+      pendingConfig.revision <= config.revision ||
+      pendingConfig.samplingMinutes == 0 ||
+      pendingConfig.serverHost[0] == 0x00)
+  {
+    return;
+  }
+  config = pendingConfig;
+  configStore.save(&config);
+  applyConfig();
+#if !PYTHON_GRAPH_OUT_ENABLE
+  LOG_INFO("Configuration updated to revision %lu", (unsigned long)config.revision);
+#endif
+}
+
+// The serialization and the upload of this window are still to come, so "ser"
+// and "up" are the ones of the previous cycle (-1 until one has been stored)
+void addMemoryToJson()
+{
+#if MEMORY_REPORT_ENABLE
+  memory_stats_t stats;
+  memoryStats(&stats);
+  MemoryCarry carry = {-1, -1};
+  memoryCarryStore.load(&carry);
+
+  JsonObject memory = jsonDocument.createNestedObject("mem");
+  memory["min"] = stats.minFreeGap;
+  memory["smp"] = memoryPhaseMinFree(MEMORY_PHASE_SAMPLE);
+  memory["ser"] = carry.serialize;
+  memory["up"] = carry.upload;
+  memory["hf"] = stats.heapFree;
+  memory["frag"] = stats.fragmentation;
+#endif
+}
+
+// Keeps the serialization and upload figures of this cycle for the next report
+void saveMemoryPhases()
+{
+#if MEMORY_REPORT_ENABLE
+  MemoryCarry carry;
+  carry.serialize = memoryPhaseMinFree(MEMORY_PHASE_SERIALIZE);
+  carry.upload = memoryPhaseMinFree(MEMORY_PHASE_UPLOAD);
+  memoryCarryStore.save(&carry);
+#endif
+}
+
+void logMemory()
+{
+  memory_stats_t stats;
+  memoryStats(&stats);
+  LOG_INFO("RAM free %d, lowest %d (sample %d, serialize %d, upload %d)",
+           stats.freeGap, stats.minFreeGap,
+           memoryPhaseMinFree(MEMORY_PHASE_SAMPLE),
+           memoryPhaseMinFree(MEMORY_PHASE_SERIALIZE),
+           memoryPhaseMinFree(MEMORY_PHASE_UPLOAD));
+  LOG_INFO("Heap %d bytes, %d free in %u blocks, %u%% fragmented",
+           stats.heapSize, stats.heapFree, stats.freeBlocks, stats.fragmentation);
+}
@@ -0,0 +1,143 @@
+/*
+  JsonStreamFilterTest.cpp - host test of JsonStreamFilter (make test)
+*/
+
+#include <string.h>
+#include "host/Test.h"
+
+#define ARDUINOJSON_ENABLE_ARDUINO_STREAM 1
+// g++ >= 8 has no_sanitize but rejects it where ArduinoJson 6.10 places it
+#include <src/ArduinoJson/Polyfills/attributes.hpp>
+#undef ARDUINOJSON_NO_SANITIZE
+#define ARDUINOJSON_NO_SANITIZE(check)
+#define __WPROGRAM_H__
+#include "../lib/JsonStreamFilter/JsonStreamFilter.cpp"
+
+// the stream never waits: there is no more data once the string is read
+unsigned long millis()
+{
+	return 0;
+}
+
+class StringStream : public Stream
+{
+	const char* _data;
+
+public:
+	StringStream(const char* data) : _data(data) { _timeout = 0; }
+
+	int available() { return strlen(_data); }
+	int read() { return *_data ? (uint8_t)*_data++ : -1; }
+	int peek() { return *_data ? (uint8_t)*_data : -1; }
+	const char* rest() { return _data; }
+};
+
+static int matches = 0;
+static int stopAfter = 0;
+static char matched[96];
+
+// it appends "key=value;" to 'matched' for every wanted member
+static bool collect(const char* key, JsonVariant value)
+{
+	size_t n = strlen(matched);
+
+	matches++;
+	n += snprintf(&matched[n], sizeof(matched) - n, "%s=", key);
+	n += serializeJson(value, &matched[n], sizeof(matched) - n);
+	snprintf(&matched[n], sizeof(matched) - n, ";");
+
+	return (matches != stopAfter);
+}
+
+static DeserializationError parse(const char* const* keys, uint8_t count,
+	const char* json, const char* rest = "")
+{
+	StaticJsonDocument<64> doc;
+	JsonStreamFilter filter(keys, count);
+	StringStream input(json);
+	DeserializationError err;
+
+	matches = 0;
+	matched[0] = '\0';
+	err = filter.parse(input, doc, collect);
+	CHECK(strcmp(input.rest(), rest) == 0);
+	return err;
+}
+
+// only the wanted members reach the handler, whatever their type; the
+// others are skipped including nested values and quoted braces
+static void testWantedMembers()
+{
+	const char* keys[] = {"window", "server", "points"};
+
+	CHECK(parse(keys, 3, "{\"cal\":{\"a\":[1,{\"b\":\"}\"}]},\"window\": 60 ,"
+		"'server':\"host:80\",\"x\":true,points:[0.5,150]}") ==
+		DeserializationError::Ok);
+	CHECK(matches == 3);
+	CHECK(strcmp(matched, "window=60;server=\"host:80\";points=[0.5,150];") == 0);
+
+	CHECK(parse(keys, 3, "{ }") == DeserializationError::Ok);
+	CHECK(matches == 0);
+}
+
+// the handler stops the parsing: the rest of the stream is not read
+static void testHandlerStops()
+{
+	const char* keys[] = {"a", "b"};
+
+	stopAfter = 1;
+	CHECK(parse(keys, 2, "{\"a\":1,\"b\":2}", ",\"b\":2}") ==
+		DeserializationError::Ok);
+	stopAfter = 0;
+	CHECK(matches == 1);
+	CHECK(strcmp(matched, "a=1;") == 0);
+}
+
+// truncated or malformed documents are reported
+static void testErrors()
+{
+	const char* keys[] = {"a"};
+
+	CHECK(parse(keys, 1, "{\"a\":1,\"b\":[1,2") ==
+		DeserializationError::IncompleteInput);
+	CHECK(parse(keys, 1, "[1]", "1]") == DeserializationError::InvalidInput);
+}
+
+// a key longer than the key buffer never matches its truncated prefix,
+// quoted or not
+static void testLongKeysNeverMatch()
+{
+	// the 31 chars which fit in the buffer
+	const char* keys[] = {"abcdefghijklmnopqrstuvwxyz01234"};
+
+	parse(keys, 1, "{\"abcdefghijklmnopqrstuvwxyz0123456789\":1}");
+	CHECK(matches == 0);
+
+	parse(keys, 1, "{abcdefghijklmnopqrstuvwxyz0123456789:2}");
+	CHECK(matches == 0);
+
+	parse(keys, 1, "{abcdefghijklmnopqrstuvwxyz01234:3}");
+	CHECK(matches == 1);
+	CHECK(strcmp(matched, "abcdefghijklmnopqrstuvwxyz01234=3;") == 0);
+}
+
+// the members following a long key are still filtered
+static void testMembersAfterLongKey()
+{
+	const char* keys[] = {"b"};
+
+	parse(keys, 1, "{abcdefghijklmnopqrstuvwxyz0123456789:[1,2],b:4}");
+	CHECK(matches == 1);
+	CHECK(strcmp(matched, "b=4;") == 0);
+}
+
+int main()
+{
+	testWantedMembers();
+	testHandlerStops();
+	testErrors();
+	testLongKeysNeverMatch();
+	testMembersAfterLongKey();
+
+	return testResult("JsonStreamFilterTest");
+}
@@ -0,0 +1,78 @@
+/*
+  SeriesEncoderTest.cpp - host test of SeriesEncoder (make test)
+*/
+
+#include <string.h>
+#include "host/Test.h"
+#include "../lib/SeriesEncoder/SeriesEncoder.cpp"
+
+// a block started after clear() is encoded as by a new encoder: the decoder
+// starts every block from scratch
+static void testClearStartsNewBlock()
+{
+	uint8_t reused[64];
+	uint8_t fresh[64];
+	SeriesEncoder a(reused, sizeof(reused));
+	SeriesEncoder b(fresh, sizeof(fresh));
+	float value;
+
+	a.addChannel(SERIES_SCALED, 2);
+	a.addChannel(SERIES_FLOAT, 0);
+	b.addChannel(SERIES_SCALED, 2);
+	b.addChannel(SERIES_FLOAT, 0);
+
+	float first[] = {1.5f, 21.25f};
+	float second[] = {1.6f, 21.5f};
+	float third[] = {2.0f, 22.0f};
+
+	CHECK(a.add(1000, first) == 0);
+	CHECK(a.add(1060, second) == 0);
+	a.clear();
+	CHECK(a.add(1120, third) == 0);
+	CHECK(b.add(1120, third) == 0);
+
+	CHECK(a.samples() == 1);
+	CHECK(a.length() == b.length());
+	CHECK(memcmp(reused, fresh, b.length()) == 0);
+
+	// header (4 + 2 channels), raw timestamp, then 200 as a zigzag varint
+	CHECK(reused[10] == 0x90);
+	CHECK(reused[11] == 0x03);
+
+	// raw IEEE754 value of the float channel follows
+	uint32_t bits = ((uint32_t)reused[12] << 24) | ((uint32_t)reused[13] << 16) |
+		((uint32_t)reused[14] << 8) | reused[15];
+	memcpy(&value, &bits, sizeof(value));
+	CHECK(value == 22.0f);
+}
+
+// a channel added after clear() does not inherit any state either
+static void testAddChannelAfterClear()
+{
+	uint8_t reused[64];
+	uint8_t fresh[64];
+	SeriesEncoder a(reused, sizeof(reused));
+	SeriesEncoder b(fresh, sizeof(fresh));
+
+	float sample[] = {3.25f};
+	a.addChannel(SERIES_SCALED, 1);
+	CHECK(a.add(500, sample) == 0);
+	a.clear();
+	CHECK(a.addChannel(SERIES_SCALED, 1) == 0);
+	b.addChannel(SERIES_SCALED, 1);
+	b.addChannel(SERIES_SCALED, 1);
+
+	float pair[] = {4.5f, 7.0f};
+	CHECK(a.add(560, pair) == 0);
+	CHECK(b.add(560, pair) == 0);
+	CHECK(a.length() == b.length());
+	CHECK(memcmp(reused, fresh, b.length()) == 0);
+}
+
+int main()
+{
+	testClearStartsNewBlock();
+	testAddChannelAfterClear();
+
+	return testResult("SeriesEncoderTest");
+}
@@ -0,0 +1,42 @@
+/*
+  Stream.h - host stand-in of the core Stream class for the host tests
+  (make test). Only the members used by the libraries under test.
+*/
+
+#ifndef Stream_h
+#define Stream_h
+
+#include <inttypes.h>
+#include <stddef.h>
+
+unsigned long millis();
+
+class Stream
+{
+  protected:
+    unsigned long _timeout;
+
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    Stream() {_timeout=1000;}
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    unsigned long getTimeout(void) { return _timeout; }
+
+    size_t readBytes(char *buffer, size_t length)
+    {
+      size_t count = 0;
+      while (count < length) {
+        int c = read();
+        if (c < 0) break;
+        *buffer++ = (char)c;
+        count++;
+      }
+      return count;
+    }
+};
+
+#endif
@@ -0,0 +1,23 @@
+/*
+  Test.h - checks shared by the host tests (make test)
+*/
+
+#ifndef Test_h
+#define Test_h
+
+#include <stdio.h>
+
+static int failures = 0;
+
+// a failed check is printed and counted, the test goes on
+#define CHECK(condition) \
+	do { if (!(condition)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// it prints the result of the test and returns the exit code of main()
+static int testResult(const char* name)
+{
+	printf("%s: %s\n", name, failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
+
+#endif